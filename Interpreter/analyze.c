@@ -0,0 +1,653 @@
+//
+//  analyze.c
+//
+//  Screw Interpreter
+//
+//  Proves runtime checks unnecessary before a run. The compiled program is
+//  interpreted over ranges instead of values: where the cursor can be, and
+//  what the cells near it can hold. A shift whose every landing cell is on
+//  the tape (or a block whose every cell is), an 'A' that can't pass the
+//  largest cell value and an 'S' that can't go below 0 are flagged F_SAFE,
+//  and the engines that care skip their checks. Loops are run to a fixed
+//  point, widening what keeps growing, so a loop that ends where it started
+//  keeps the cursor range it was entered with.
+//
+//  The proof depends on the tape length, cell width and policies, so it is
+//  redone for every run and never cached. --explain-checks prints it. A
+//  loop has no check of its own: what it lists for one only sums up the
+//  checks inside it.
+//
+
+#include <stdio.h>
+#include <stdlib.h>         // For calloc() and free()
+#include <string.h>         // For memcmp()
+#include <limits.h>         // For CHAR_MIN, CHAR_MAX, INT_MIN, INT_MAX
+#include "screw.h"
+
+#define KNOWN_CELLS 8       // Cells whose values are tracked one by one; the rest share one range
+#define MAX_NESTING 256     // Loops nested deeper than this are not analyzed
+#define LOOP_ROUNDS 8       // Passes over a loop body before giving it the widest state
+#define WIDEN_AFTER 2       // Passes over a loop body before ranges that still grow are widened
+
+typedef struct {            // A cell whose value range is tracked by itself
+    long cell;
+    int lo, hi;
+} Known;
+
+typedef struct {            // What can be true before an instruction
+    _Bool dead;             // Nothing: the instruction can't be reached this way
+    long lo, hi;            // Cells the cursor can be on
+    int rest_lo, rest_hi;   // Values any cell not in known can hold
+    int count;              // Cells in known
+    Known known[KNOWN_CELLS];   // Sorted by cell
+} State;
+
+typedef struct {            // A loop body's state on entry and on reaching its '}', kept for reuse
+    State in, out;
+} Memo;
+
+typedef struct {            // The analysis of one program
+    Instr *code;
+    int count;              // Instructions, OP_HALT included
+    long last;              // Last cell of the tape
+    int vmin, vmax;         // Values a cell can hold
+    int limit;              // Largest value 'A' may reach
+    int overflow;           // OVERFLOW_*
+    int eof;                // EOF_*
+    int width;              // Bytes in a cell
+    _Bool moves_checked;    // False on an unchecked tape, where there is nothing to prove
+    unsigned char *seen;    // seen[i]: instruction i was reached in some pass
+    unsigned char *unsafe;  // unsafe[i]: its check could fail in some pass
+    long *cur_lo, *cur_hi;  // Cursor ranges instruction i was reached with, over all passes
+    int *val_lo, *val_hi;   // Values its cell held
+    Memo **memos;           // Last pass over each nested loop, by the index of its OP_LOOP
+    long long budget;       // Instructions left to visit before giving up
+    int depth;              // Loops being analyzed
+    _Bool gave_up;          // Ran out of budget: nothing is proven
+} Analysis;
+
+static void topState(const Analysis *, State *);               // Anything can be true
+static void readCell(const State *, int, int *, int *);        // Values the cell off away from the cursor can hold
+static void writeCell(State *, int, int, int);                  // It now holds one of these
+static void setKnown(State *, long, int, int);                  // Track a cell by itself
+static void joinStates(State *, const State *);                 // Either can be true
+static void widenState(const Analysis *, const State *, State *);   // Push what grew to its limits
+static _Bool sameState(const State *, const State *);
+static void refine(State *, _Bool);                             // The cell is (not) 0
+static void note(Analysis *, int, const State *, _Bool);         // Record a check and whether it passes
+static void analyzeRange(Analysis *, int, int, State *);         // Run instructions from..to-1
+static void analyzeLoop(Analysis *, int, State *);               // Run a loop to its fixed point
+static _Bool checkable(const Analysis *, const Instr *);        // Whether an instruction has a check to prove
+static long loopShift(const Instr *, int, int, _Bool *);        // Net shift of a pass over a loop body
+static void explain(const Analysis *, const Source *, const size_t *);  // Print the proof
+
+// Flags the checks of code that can't fail when it runs with opts (clearing old flags first).
+// With src and origins, also prints which checks were removed and why. Returns the number of
+// checks removed, or -1 if there was no memory to analyze (and nothing is flagged).
+int proveChecks(Instr *code, const Options *opts, const Source *src, const size_t *origins){
+    Analysis an;
+    State state;
+    int removed = 0;
+
+    memset(&an, 0, sizeof(an));
+    while(code[an.count].op != OP_HALT)
+        code[an.count++].flags &= ~F_SAFE;
+    code[an.count++].flags &= ~F_SAFE;
+    an.code = code;
+    an.last = opts->cells - 1;
+    an.width = opts->width;
+    an.vmin = opts->width == 1 ? CHAR_MIN : opts->width == 2 ? -32768 : INT_MIN;
+    an.vmax = opts->width == 1 ? CHAR_MAX : opts->width == 2 ? 32767 : INT_MAX;
+    an.limit = opts->width == 1 ? 127 : an.vmax;
+    an.overflow = opts->overflow;
+    an.eof = opts->eof;
+    an.moves_checked = opts->tape != TAPE_UNCHECKED;
+    an.budget = 64LL * an.count + 1000000;
+    an.seen = (unsigned char *)calloc(an.count, 1);
+    an.unsafe = (unsigned char *)calloc(an.count, 1);
+    an.cur_lo = (long *)malloc(an.count * sizeof(long));
+    an.cur_hi = (long *)malloc(an.count * sizeof(long));
+    an.val_lo = (int *)malloc(an.count * sizeof(int));
+    an.val_hi = (int *)malloc(an.count * sizeof(int));
+    an.memos = (Memo **)calloc(an.count, sizeof(Memo *));
+    if(an.seen == NULL || an.unsafe == NULL || an.cur_lo == NULL || an.cur_hi == NULL
+       || an.val_lo == NULL || an.val_hi == NULL || an.memos == NULL){
+        removed = -1;
+        goto done;
+    }
+
+    memset(&state, 0, sizeof(state));                  // The cursor starts on cell 0 and every cell is 0
+    analyzeRange(&an, 0, an.count, &state);
+
+    for(int i = 0; i < an.count && !an.gave_up; ++i)
+        if(checkable(&an, &code[i]) && an.seen[i] && !an.unsafe[i]){
+            code[i].flags |= F_SAFE;
+            ++removed;
+        }
+    if(src != NULL)
+        explain(&an, src, origins);
+
+done:
+    if(an.memos != NULL)
+        for(int i = 0; i < an.count; ++i)
+            free(an.memos[i]);
+    free(an.memos);
+    free(an.seen);
+    free(an.unsafe);
+    free(an.cur_lo);
+    free(an.cur_hi);
+    free(an.val_lo);
+    free(an.val_hi);
+    return removed;
+}
+
+static void topState(const Analysis *an, State *s){
+    s->dead = 0;
+    s->lo = 0;
+    s->hi = an->last;
+    s->rest_lo = an->vmin;
+    s->rest_hi = an->vmax;
+    s->count = 0;
+}
+
+static void readCell(const State *s, int off, int *lo, int *hi){
+    long first = s->lo + off, last = s->hi + off;
+
+    *lo = s->rest_lo;
+    *hi = s->rest_hi;
+    for(int k = 0; k < s->count; ++k){
+        if(s->known[k].cell < first || s->known[k].cell > last)
+            continue;
+        if(first == last){                             // The very cell
+            *lo = s->known[k].lo;
+            *hi = s->known[k].hi;
+            return;
+        }
+        *lo = s->known[k].lo < *lo ? s->known[k].lo : *lo;
+        *hi = s->known[k].hi > *hi ? s->known[k].hi : *hi;
+    }
+}
+
+static void writeCell(State *s, int off, int lo, int hi){
+    long first = s->lo + off, last = s->hi + off;
+
+    if(first == last){
+        setKnown(s, first, lo, hi);
+        return;
+    }
+    for(int k = 0; k < s->count; ++k)                  // Any of these cells may be the one written
+        if(s->known[k].cell >= first && s->known[k].cell <= last){
+            s->known[k].lo = lo < s->known[k].lo ? lo : s->known[k].lo;
+            s->known[k].hi = hi > s->known[k].hi ? hi : s->known[k].hi;
+        }
+    s->rest_lo = lo < s->rest_lo ? lo : s->rest_lo;
+    s->rest_hi = hi > s->rest_hi ? hi : s->rest_hi;
+}
+
+static void setKnown(State *s, long cell, int lo, int hi){
+    int k = 0;
+
+    while(k < s->count && s->known[k].cell < cell)
+        ++k;
+    if(k < s->count && s->known[k].cell == cell){
+        s->known[k].lo = lo;
+        s->known[k].hi = hi;
+        return;
+    }
+    if(s->count == KNOWN_CELLS){                       // Full: the cell furthest from this one joins the rest
+        int far = cell - s->known[0].cell > s->known[KNOWN_CELLS - 1].cell - cell ? 0 : KNOWN_CELLS - 1;
+        s->rest_lo = s->known[far].lo < s->rest_lo ? s->known[far].lo : s->rest_lo;
+        s->rest_hi = s->known[far].hi > s->rest_hi ? s->known[far].hi : s->rest_hi;
+        memmove(&s->known[far], &s->known[far + 1], (s->count - far - 1) * sizeof(Known));
+        --s->count;
+        if(far < k)
+            --k;
+    }
+    memmove(&s->known[k + 1], &s->known[k], (s->count - k) * sizeof(Known));
+    s->known[k].cell = cell;
+    s->known[k].lo = lo;
+    s->known[k].hi = hi;
+    ++s->count;
+}
+
+static void joinStates(State *s, const State *t){
+    State joined;
+    int i = 0, j = 0;
+
+    if(t->dead)
+        return;
+    if(s->dead){
+        *s = *t;
+        return;
+    }
+    joined.dead = 0;
+    joined.lo = s->lo < t->lo ? s->lo : t->lo;
+    joined.hi = s->hi > t->hi ? s->hi : t->hi;
+    joined.rest_lo = s->rest_lo < t->rest_lo ? s->rest_lo : t->rest_lo;
+    joined.rest_hi = s->rest_hi > t->rest_hi ? s->rest_hi : t->rest_hi;
+    joined.count = 0;
+    while(i < s->count || j < t->count){               // Merge the known cells; one missing on a side has its rest
+        long cell = j == t->count || (i < s->count && s->known[i].cell < t->known[j].cell) ? s->known[i].cell : t->known[j].cell;
+        int slo = s->rest_lo, shi = s->rest_hi, tlo = t->rest_lo, thi = t->rest_hi;
+        if(i < s->count && s->known[i].cell == cell){
+            slo = s->known[i].lo;
+            shi = s->known[i++].hi;
+        }
+        if(j < t->count && t->known[j].cell == cell){
+            tlo = t->known[j].lo;
+            thi = t->known[j++].hi;
+        }
+        if(joined.count < KNOWN_CELLS){
+            joined.known[joined.count].cell = cell;
+            joined.known[joined.count].lo = slo < tlo ? slo : tlo;
+            joined.known[joined.count++].hi = shi > thi ? shi : thi;
+        }
+        else{                                          // No room: it joins the rest
+            joined.rest_lo = slo < joined.rest_lo ? slo : joined.rest_lo;
+            joined.rest_lo = tlo < joined.rest_lo ? tlo : joined.rest_lo;
+            joined.rest_hi = shi > joined.rest_hi ? shi : joined.rest_hi;
+            joined.rest_hi = thi > joined.rest_hi ? thi : joined.rest_hi;
+        }
+    }
+    *s = joined;
+}
+
+// Widens next, which joins old with what one more pass over a loop body gave: every bound that
+// moved goes straight to its limit, so loops that keep shifting or counting settle quickly.
+static void widenState(const Analysis *an, const State *old, State *next){
+    if(old->dead || next->dead)
+        return;
+    if(next->lo < old->lo)
+        next->lo = 0;
+    if(next->hi > old->hi)
+        next->hi = an->last;
+    if(next->rest_lo < old->rest_lo)
+        next->rest_lo = an->vmin;
+    if(next->rest_hi > old->rest_hi)
+        next->rest_hi = an->vmax;
+    for(int k = 0; k < next->count; ++k){
+        int lo = old->rest_lo, hi = old->rest_hi;
+        for(int j = 0; j < old->count; ++j)
+            if(old->known[j].cell == next->known[k].cell){
+                lo = old->known[j].lo;
+                hi = old->known[j].hi;
+            }
+        if(next->known[k].lo < lo)
+            next->known[k].lo = an->vmin;
+        if(next->known[k].hi > hi)
+            next->known[k].hi = an->vmax;
+    }
+}
+
+static _Bool sameState(const State *s, const State *t){
+    if(s->dead || t->dead)
+        return s->dead == t->dead;
+    return s->lo == t->lo && s->hi == t->hi && s->rest_lo == t->rest_lo && s->rest_hi == t->rest_hi
+           && s->count == t->count && memcmp(s->known, t->known, s->count * sizeof(Known)) == 0;
+}
+
+// After a test of the current cell: it is 0 (zero) or it isn't. Only a cursor on one known
+// cell says anything, and a range that can't hold the outcome means the way is never taken.
+static void refine(State *s, _Bool zero){
+    int lo = 0, hi = 0;
+
+    if(s->dead || s->lo != s->hi)
+        return;
+    readCell(s, 0, &lo, &hi);
+    if(zero){
+        if(lo > 0 || hi < 0)
+            s->dead = 1;
+        else
+            writeCell(s, 0, 0, 0);
+        return;
+    }
+    if(lo == 0 && hi == 0){
+        s->dead = 1;
+        return;
+    }
+    writeCell(s, 0, lo == 0 ? 1 : lo, hi == 0 ? -1 : hi);
+}
+
+static void note(Analysis *an, int i, const State *s, _Bool safe){
+    int lo = 0, hi = 0;
+
+    readCell(s, an->code[i].off, &lo, &hi);            // The cell of an 'A' or 'S' (the others don't look)
+    if(!an->seen[i]){
+        an->seen[i] = 1;
+        an->cur_lo[i] = s->lo;
+        an->cur_hi[i] = s->hi;
+        an->val_lo[i] = lo;
+        an->val_hi[i] = hi;
+    }
+    an->cur_lo[i] = s->lo < an->cur_lo[i] ? s->lo : an->cur_lo[i];
+    an->cur_hi[i] = s->hi > an->cur_hi[i] ? s->hi : an->cur_hi[i];
+    an->val_lo[i] = lo < an->val_lo[i] ? lo : an->val_lo[i];
+    an->val_hi[i] = hi > an->val_hi[i] ? hi : an->val_hi[i];
+    if(!safe)
+        an->unsafe[i] = 1;
+}
+
+// Adds a to every value of lo..hi the way a cell wraps: exact unless some value wraps around.
+static void wrapAdd(const Analysis *an, long long a, int *lo, int *hi){
+    long long span = (long long)an->vmax - an->vmin + 1;
+    long long step = ((a % span) + span) % span;        // a, reduced to the cell's own arithmetic
+    long long new_lo = 0, new_hi = 0;
+
+    if(step > an->vmax)
+        step -= span;
+    new_lo = *lo + step;
+    new_hi = *hi + step;
+    if(new_lo < an->vmin || new_hi > an->vmax){
+        *lo = an->vmin;
+        *hi = an->vmax;
+        return;
+    }
+    *lo = (int)new_lo;
+    *hi = (int)new_hi;
+}
+
+static void analyzeRange(Analysis *an, int from, int to, State *s){
+    for(int i = from; i < to && !s->dead; ){
+        const Instr *in = &an->code[i];
+        int lo = 0, hi = 0;
+
+        if(an->gave_up || --an->budget < 0){
+            an->gave_up = 1;
+            topState(an, s);
+            return;
+        }
+        readCell(s, in->off, &lo, &hi);                // The cell it works on, if it works on one
+        switch(in->op){
+            case OP_MOVE:
+                note(an, i, s, s->lo + in->a >= 0 && s->hi + in->a <= an->last);
+                s->lo = s->lo + in->a < 0 ? 0 : s->lo + in->a;     // Only the moves that stay on the tape go on
+                s->hi = s->hi + in->a > an->last ? an->last : s->hi + in->a;
+                if(s->lo > s->hi)
+                    s->dead = 1;
+                break;
+            case OP_INC:
+                wrapAdd(an, in->a, &lo, &hi);
+                writeCell(s, in->off, lo, hi);
+                break;
+            case OP_IN:                                // A byte, or whatever the end of the input leaves
+                if(an->width == 1)
+                    lo = an->vmin, hi = an->vmax;
+                else if(an->eof == EOF_KEEP)
+                    lo = lo < -1 ? lo : -1, hi = hi > 255 ? hi : 255;
+                else
+                    lo = an->eof == EOF_ZERO ? 0 : -1, hi = 255;
+                writeCell(s, in->off, lo, hi);
+                break;
+            case OP_DUMP:
+                if(in->b - in->a < KNOWN_CELLS)
+                    for(int cell = in->a; cell <= in->b; ++cell)
+                        setKnown(s, cell, 0, 0);
+                else{                                  // Too many to track one by one: 0 joins what the rest may hold
+                    for(int k = 0; k < s->count; ++k)
+                        if(s->known[k].cell >= in->a && s->known[k].cell <= in->b)
+                            s->known[k].lo = s->known[k].hi = 0;
+                    s->rest_lo = s->rest_lo < 0 ? s->rest_lo : 0;
+                    s->rest_hi = s->rest_hi > 0 ? s->rest_hi : 0;
+                }
+                s->lo = s->hi = in->a;
+                break;
+            case OP_ADD:
+                note(an, i, s, (long long)hi + in->a <= an->limit);
+                if(an->overflow == OVERFLOW_WRAP)
+                    wrapAdd(an, in->a, &lo, &hi);
+                else{                                  // Past the limit the run ends, or stops at it
+                    lo = (long long)lo + in->a > an->limit ? an->limit : lo + in->a;
+                    hi = (long long)hi + in->a > an->limit ? an->limit : hi + in->a;
+                }
+                writeCell(s, in->off, lo, hi);
+                break;
+            case OP_SUB:
+                note(an, i, s, (long long)lo - in->a >= 0);
+                if(an->overflow == OVERFLOW_WRAP)
+                    wrapAdd(an, -(long long)in->a, &lo, &hi);
+                else{
+                    lo = (long long)lo - in->a < 0 ? 0 : lo - in->a;
+                    hi = (long long)hi - in->a < 0 ? 0 : hi - in->a;
+                }
+                writeCell(s, in->off, lo, hi);
+                break;
+            case OP_LOOP:
+                analyzeLoop(an, i, s);
+                i = in->a;                             // Past its '}'
+                continue;
+            case OP_CLEAR:
+                writeCell(s, in->off, 0, 0);
+                break;
+            case OP_MUL_LOOP:{                         // Fused instructions, then the original loop either way
+                State fused = *s;
+                _Bool safe = s->lo + in->off >= 0 && s->hi + in->b <= an->last;
+                note(an, i, s, safe);
+                refine(&fused, 0);
+                if(fused.lo < -in->off)                // The fused instructions only run where the body fits
+                    fused.lo = -in->off;
+                if(fused.hi > an->last - in->b)
+                    fused.hi = an->last - in->b;
+                if(fused.lo > fused.hi)
+                    fused.dead = 1;
+                analyzeRange(an, i + 1, in->a, &fused);
+                if(safe)                               // Otherwise the loop also runs when the body doesn't fit
+                    refine(s, 1);
+                joinStates(s, &fused);
+                i = in->a;
+                continue;
+            }
+            case OP_MUL:
+                writeCell(s, in->off, an->vmin, an->vmax);
+                break;
+            case OP_SCAN:                              // Somewhere further along, or off the tape
+                if(in->a > 0)
+                    s->hi = an->last;
+                else
+                    s->lo = 0;
+                break;
+            case OP_BLOCK:{                            // The offset version where the cells fit, the original
+                State kept = *s;                       // code at a where they don't; both come back after it
+                _Bool safe = s->lo + in->off >= 0 && s->hi + in->b <= an->last;
+                int back = in->a, end = 0;
+                while(an->code[back].op != OP_JUMP)
+                    ++back;
+                end = an->code[back].a;
+                note(an, i, s, safe);
+                if(safe)
+                    kept.dead = 1;
+                else
+                    analyzeRange(an, in->a, back, &kept);
+                if(s->lo < -in->off)
+                    s->lo = -in->off;
+                if(s->hi > an->last - in->b)
+                    s->hi = an->last - in->b;
+                if(s->lo > s->hi)
+                    s->dead = 1;
+                analyzeRange(an, i + 1, end, s);
+                joinStates(s, &kept);
+                i = end;
+                continue;
+            }
+            case OP_JUMP:
+                i = in->a;
+                continue;
+            case OP_OUT:
+                break;
+            default:                                   // OP_HALT, OP_ERROR, and an OP_END not reached from its loop
+                s->dead = 1;
+                break;
+        }
+        ++i;
+    }
+}
+
+// A loop at index i, entered with s, leaves s as it is after the loop. The body is run over
+// until what can be true at its start stops changing; a nested loop entered the same way as
+// last time reuses what it gave then.
+static void analyzeLoop(Analysis *an, int i, State *s){
+    int end = an->code[i].a - 1;                       // Its OP_END
+    State body = *s, start, out, next, exit = *s;
+    Memo *memo = an->memos[i];
+
+    refine(&body, 0);
+    refine(&exit, 1);
+    start = body;
+    if(body.dead){
+        *s = exit;
+        return;
+    }
+    if(an->depth >= MAX_NESTING){                      // Too deep to follow: anything can happen in it
+        topState(an, s);
+        return;
+    }
+    if(memo != NULL && sameState(&memo->in, &start)){
+        joinStates(&exit, &memo->out);
+        *s = exit;
+        return;
+    }
+
+    ++an->depth;
+    for(int round = 1; ; ++round){
+        out = body;
+        analyzeRange(an, i + 1, end, &out);
+        next = out;
+        refine(&next, 0);                          // '}' jumps back while the cell isn't 0
+        joinStates(&next, &body);
+        if(sameState(&next, &body) || an->gave_up)
+            break;
+        if(round >= LOOP_ROUNDS)
+            topState(an, &next);
+        else if(round >= WIDEN_AFTER)
+            widenState(an, &body, &next);
+        body = next;
+    }
+    --an->depth;
+
+    refine(&out, 1);                               // '}' falls through once the cell is 0
+    if(an->depth > 0 && !an->gave_up){                 // Only nested loops are entered again
+        if(memo == NULL && (memo = an->memos[i] = (Memo *)malloc(sizeof(Memo))) == NULL){
+            an->gave_up = 1;
+            return;
+        }
+        memo->in = start;
+        memo->out = out;
+    }
+    joinStates(&exit, &out);
+    *s = exit;
+}
+
+static _Bool checkable(const Analysis *an, const Instr *in){
+    switch(in->op){
+        case OP_MOVE: return an->moves_checked && !(in->flags & F_COVERED);
+        case OP_MUL_LOOP: case OP_BLOCK: return an->moves_checked;
+        case OP_ADD: case OP_SUB: return an->overflow == OVERFLOW_ERROR;
+        default: return 0;
+    }
+}
+
+// Net shift of one pass over the body from..to-1, if it is the same every pass.
+static long loopShift(const Instr *code, int from, int to, _Bool *fixed){
+    long shift = 0;
+
+    *fixed = 1;
+    for(int i = from; i < to && *fixed; ++i){
+        if(code[i].op == OP_MOVE)
+            shift += code[i].a;
+        else if(code[i].op == OP_DUMP || code[i].op == OP_SCAN)
+            *fixed = 0;
+        else if(code[i].op == OP_LOOP || code[i].op == OP_MUL_LOOP){
+            int inner = code[i].op == OP_LOOP ? i : code[i].a;
+            if(loopShift(code, inner + 1, code[inner].a - 1, fixed) != 0)
+                *fixed = 0;
+            i = code[inner].a - 1;
+        }
+    }
+    return shift;
+}
+
+static void explain(const Analysis *an, const Source *src, const size_t *origins){
+    Position *positions = (Position *)malloc(an->count * sizeof(Position));
+    int checks = 0, removed = 0, unreached = 0;
+
+    if(positions == NULL || locateTokens(src, origins, an->count, positions) != 0){
+        fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+        free(positions);
+        return;
+    }
+    for(int i = 0; i < an->count; ++i)
+        if(checkable(an, &an->code[i]) && !an->seen[i])
+            ++unreached;
+        else if(checkable(an, &an->code[i])){
+            ++checks;
+            removed += (an->code[i].flags & F_SAFE) != 0;
+        }
+    fprintf(stderr, "%sChecks:%s %d of %d removed (%ld cells of %d bits, %s on overflow%s)\n", YELLOW, RESET, removed, checks,
+            an->last + 1, 8 * an->width, an->overflow == OVERFLOW_ERROR ? "error" : an->overflow == OVERFLOW_WRAP ? "wrap" : "saturate",
+            an->moves_checked ? "" : ", shifts unchecked");
+    if(unreached > 0 && !an->gave_up)
+        fprintf(stderr, "  %d more never reached, such as the original code kept for fused loops and blocks\n", unreached);
+    if(an->gave_up){
+        fprintf(stderr, "  The program is too big to analyze; every check stays\n");
+        free(positions);
+        return;
+    }
+
+    for(int i = 0, header = 0; i < an->count; ++i){    // Loops, outermost first in source order
+        const Instr *in = &an->code[i];
+        int first = in->op == OP_MUL_LOOP ? in->a : i;
+        int loop_checks = 0, loop_removed = 0;
+        long shift = 0;
+        _Bool fixed = 0;
+        char where[48];
+        if(in->op != OP_LOOP && in->op != OP_MUL_LOOP)
+            continue;
+        for(int j = i; j < an->code[first].a; ++j)     // The checks it reached, nested loops included
+            if(checkable(an, &an->code[j]) && an->seen[j]){
+                ++loop_checks;
+                loop_removed += (an->code[j].flags & F_SAFE) != 0;
+            }
+        if(in->op == OP_MUL_LOOP)
+            i = first;                                 // Its original loop is counted with it
+        if(loop_checks == 0)
+            continue;
+        if(!header++)
+            fprintf(stderr, "  %-12s %8s %8s\n", "Loops", "checks", "removed");
+        shift = loopShift(an->code, first + 1, an->code[first].a - 1, &fixed);
+        snprintf(where, sizeof(where), "%zu:%zu", positions[i].line, positions[i].col);
+        fprintf(stderr, "  %-12s %8d %8d  %s", where, loop_checks, loop_removed,
+                loop_removed == loop_checks ? "check-free" : loop_removed > 0 ? "partly proven" : "kept");
+        if(fixed)
+            fprintf(stderr, ", net shift %ld per pass", shift);
+        fprintf(stderr, "\n");
+    }
+
+    fprintf(stderr, "  Checks\n");
+    for(int i = 0; i < an->count; ++i){
+        const Instr *in = &an->code[i];
+        _Bool safe = (in->flags & F_SAFE) != 0;
+        char where[48], why[160];
+        if(!checkable(an, in))
+            continue;
+        snprintf(where, sizeof(where), "%zu:%zu", positions[i].line, positions[i].col);
+        if(!an->seen[i])
+            snprintf(why, sizeof(why), "never reached");
+        else if(in->op == OP_MOVE && safe)
+            snprintf(why, sizeof(why), "cursor on %ld..%ld lands on %ld..%ld", an->cur_lo[i], an->cur_hi[i],
+                     an->cur_lo[i] + in->a, an->cur_hi[i] + in->a);
+        else if(in->op == OP_MOVE)
+            snprintf(why, sizeof(why), "cursor on %ld..%ld could land on %ld", an->cur_lo[i], an->cur_hi[i],
+                     in->a < 0 ? an->cur_lo[i] + in->a : an->cur_hi[i] + in->a);
+        else if(in->op == OP_MUL_LOOP || in->op == OP_BLOCK)
+            snprintf(why, sizeof(why), "cursor on %ld..%ld, %s reaches %ld..%ld", an->cur_lo[i], an->cur_hi[i],
+                     in->op == OP_BLOCK ? "block" : "loop body", an->cur_lo[i] + in->off, an->cur_hi[i] + in->b);
+        else if(in->op == OP_ADD)
+            snprintf(why, sizeof(why), "cell holds %d..%d, +%d %s %d", an->val_lo[i], an->val_hi[i], in->a,
+                     safe ? "stays within" : "could pass", an->limit);
+        else
+            snprintf(why, sizeof(why), "cell holds %d..%d, -%d %s", an->val_lo[i], an->val_hi[i], in->a,
+                     safe ? "stays at 0 or above" : "could go below 0");
+        fprintf(stderr, "  %-12s %c %-8s %s\n", where, in->op == OP_MOVE ? (in->a > 0 ? '>' : '<') : in->op == OP_ADD ? 'A'
+                : in->op == OP_SUB ? 'S' : in->op == OP_BLOCK ? '=' : '{', safe ? "removed" : "kept", why);
+    }
+    free(positions);
+}
@@ -0,0 +1,426 @@
+//
+//  batch.c
+//
+//  Screw Interpreter
+//
+//  --batch: runs every job of a manifest on a pool of worker threads. Each
+//  line of the manifest is a job,
+//
+//      <program>.scw [<input file> [<output file>]]
+//
+//  with blank lines and lines starting with '#' skipped. Every distinct
+//  program is loaded and compiled once, however many jobs run it. A job
+//  gets its own tape, reads its input file (or nothing) from memory and
+//  captures its output in memory, written to its output file at the end.
+//  Each worker takes jobs from the back of its own deque and, once that is
+//  empty, steals from the front of the others', so a few long jobs don't
+//  hold up the rest. A tab-separated status line per job is printed at the
+//  end, in manifest order.
+//
+
+#include <stdio.h>
+#include <stdlib.h>         // For malloc(), realloc(), free(), realpath()
+#include <string.h>         // For strcmp(), strdup(), strtok()
+#include <pthread.h>        // For pthread_create(), pthread_mutex_*
+#include <time.h>           // For clock_gettime()
+#include <unistd.h>         // For sysconf()
+#include <limits.h>         // For PATH_MAX
+#include "screw.h"
+
+enum {                      // How a job ended
+    JOB_OK,                 // Ran to the end
+    JOB_ERROR,              // Stopped with a runtime error
+    JOB_LIMIT,              // Stopped by --max-steps or --timeout
+    JOB_FAILED              // Could not be run (error is a FAIL_*)
+};
+
+enum {                      // Why a job could not be run
+    FAIL_PROGRAM,
+    FAIL_INPUT,
+    FAIL_OUTPUT,
+    FAIL_MEMORY
+};
+
+static const char *const failures[] = {
+    [FAIL_PROGRAM] = "Cannot load the program",
+    [FAIL_INPUT] = "Cannot read the input",
+    [FAIL_OUTPUT] = "Cannot write the output",
+    [FAIL_MEMORY] = "Out of memory"
+};
+
+typedef struct {            // A distinct program of the manifest
+    char *path;             // Path it was loaded from (resolved)
+    Instr *code;            // Compiled program, NULL if it could not be loaded
+} Program;
+
+typedef struct {            // One line of the manifest
+    int line;               // Line number in the manifest
+    char *name;             // Program as written in the manifest
+    int program;            // Index into the programs
+    char *input;            // Input file, NULL for none
+    char *output;           // Output file, NULL to discard the output
+    int status;             // JOB_*
+    int error;              // Runtime error with the symbol in bits 8-15, or FAIL_*
+    size_t out_bytes;       // Bytes of output
+    unsigned long long steps;   // Steps taken, if stopped by a limit
+    double seconds;         // Time taken
+} Job;
+
+typedef struct {            // Jobs not yet started by one worker
+    int *jobs;              // Job indexes, owner pops at tail, thieves take at head
+    int head;
+    int tail;
+    pthread_mutex_t lock;
+} Deque;
+
+typedef struct {            // Everything the workers share
+    Program *programs;
+    int program_count;
+    Job *jobs;
+    int job_count;
+    Deque *deques;          // One per worker
+    int workers;
+    const Options *opts;
+} Batch;
+
+typedef struct {            // What a worker thread is handed
+    Batch *batch;
+    int id;
+} Worker;
+
+static int parseManifest(Batch *, const char *);        // Read the jobs and their distinct programs
+static int findProgram(Batch *, const char *, int *, int);     // Index of a program, added if new (-1 if out of memory)
+static void *work(void *);                              // Worker thread
+static int takeJob(Batch *, int);                       // Next job for a worker, stolen if need be (-1 when all are taken)
+static void runJob(Batch *, Job *);
+static char *readFile(const char *, size_t *);          // Whole file in memory
+static double now(void);                                // Seconds on a monotonic clock
+static unsigned long hashString(const char *);          // FNV-1a
+
+int runBatch(const char *manifest, int level, const Options *opts, int workers){ // Run every job of a manifest, returning 0 if all ran to the end
+    Batch batch = { NULL, 0, NULL, 0, NULL, 0, opts };
+    pthread_t *threads = NULL;
+    _Bool *started = NULL;                             // Which threads were created
+    Worker *args = NULL;
+    int failed = 0;
+    double start = now();
+
+    if(parseManifest(&batch, manifest) != 0)
+        return 1;
+
+    for(int p = 0; p < batch.program_count; ++p){      // Load and compile each distinct program once
+        Source source;
+        if(loadSource(batch.programs[p].path, &source) != 0)
+            continue;
+        batch.programs[p].code = compile(source.tokens, source.count, level, NULL);
+        if(batch.programs[p].code != NULL)
+            proveChecks(batch.programs[p].code, opts, NULL, NULL);  // Every job runs with the same options
+        freeSource(&source);
+    }
+
+    if(workers <= 0){
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+    if(workers > batch.job_count)
+        workers = batch.job_count > 0 ? batch.job_count : 1;
+    batch.workers = workers;
+    batch.deques = (Deque *)calloc(workers, sizeof(Deque));
+    threads = (pthread_t *)calloc(workers, sizeof(pthread_t));
+    started = (_Bool *)calloc(workers, sizeof(_Bool));
+    args = (Worker *)calloc(workers, sizeof(Worker));
+    if(batch.deques == NULL || threads == NULL || started == NULL || args == NULL){
+        fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+        return 1;
+    }
+    for(int w = 0; w < workers; ++w){                  // Deal the jobs out round-robin
+        int share = batch.job_count / workers + (w < batch.job_count % workers);
+        Deque *deque = &batch.deques[w];
+        if((deque->jobs = (int *)malloc((share + 1) * sizeof(int))) == NULL){
+            fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+            return 1;
+        }
+        for(int j = w; j < batch.job_count; j += workers)
+            deque->jobs[deque->tail++] = j;
+        pthread_mutex_init(&deque->lock, NULL);
+    }
+
+    for(int w = 0; w < workers; ++w){
+        args[w].batch = &batch;
+        args[w].id = w;
+        started[w] = (pthread_create(&threads[w], NULL, work, &args[w]) == 0);
+    }
+    for(int w = 0; w < workers; ++w){
+        if(!started[w])                                // No thread to spare: run what the others haven't stolen here
+            work(&args[w]);
+    }
+    for(int w = 0; w < workers; ++w)
+        if(started[w])
+            pthread_join(threads[w], NULL);
+
+    for(int j = 0; j < batch.job_count; ++j){          // Report in manifest order
+        Job *job = &batch.jobs[j];
+        printf("%d\t%s\t%s\t%zu\t%.6f\t", job->line, job->name,
+               job->status == JOB_OK ? "ok" : job->status == JOB_ERROR ? "error" : job->status == JOB_LIMIT ? "limit" : "failed",
+               job->out_bytes, job->seconds);
+        if(job->status == JOB_ERROR)
+            printf(errorMessage(job->error & 0xff), (char)(job->error >> 8));
+        else if(job->status == JOB_LIMIT)
+            printf("%s (%llu steps)", errorMessage(job->error), job->steps);
+        else if(job->status == JOB_FAILED)
+            printf("%s", failures[job->error]);
+        printf("\n");
+        failed |= (job->status != JOB_OK);
+    }
+    fflush(stdout);
+    fprintf(stderr, "%d job%s of %d program%s on %d worker%s in %.3fs\n", batch.job_count, batch.job_count == 1 ? "" : "s",
+            batch.program_count, batch.program_count == 1 ? "" : "s", workers, workers == 1 ? "" : "s", now() - start);
+
+    for(int w = 0; w < workers; ++w){
+        free(batch.deques[w].jobs);
+        pthread_mutex_destroy(&batch.deques[w].lock);
+    }
+    for(int p = 0; p < batch.program_count; ++p){
+        free(batch.programs[p].path);
+        free(batch.programs[p].code);
+    }
+    for(int j = 0; j < batch.job_count; ++j){
+        free(batch.jobs[j].name);
+        free(batch.jobs[j].input);
+        free(batch.jobs[j].output);
+    }
+    free(batch.programs);
+    free(batch.jobs);
+    free(batch.deques);
+    free(threads);
+    free(started);
+    free(args);
+    return failed;
+}
+
+static int parseManifest(Batch *batch, const char *manifest){
+    FILE *in = fopen(manifest, "r");
+    char *line = NULL;
+    size_t line_cap = 0;
+    int line_number = 0;
+    int job_cap = 0, program_cap = 0;
+    int *table = NULL;                                 // Hash table of program indexes + 1, 0 for empty
+    int table_size = 0;
+
+    if(in == NULL){
+        fprintf(stderr, "%sError:%s %s doesn't exist!\n", RED, RESET, manifest);
+        return -1;
+    }
+    while(getline(&line, &line_cap, in) != -1){
+        char *words[4] = { NULL, NULL, NULL, NULL };
+        int count = 0;
+        Job *job = NULL;
+
+        ++line_number;
+        for(char *word = strtok(line, " \t\r\n"); word != NULL && count < 4; word = strtok(NULL, " \t\r\n"))
+            words[count++] = word;
+        if(count == 0 || words[0][0] == '#')
+            continue;
+        if(count > 3){
+            fprintf(stderr, "%sError:%s %s:%d: Expected <program>.scw [<input> [<output>]]\n", RED, RESET, manifest, line_number);
+            goto fail;
+        }
+        if(batch->job_count == job_cap){
+            Job *grown = (Job *)realloc(batch->jobs, (job_cap ? job_cap * 2 : 256) * sizeof(Job));
+            if(grown == NULL)
+                goto oom;
+            batch->jobs = grown;
+            job_cap = job_cap ? job_cap * 2 : 256;
+        }
+        if(batch->program_count * 2 >= table_size){    // Keep the table at most half full
+            int size = table_size ? table_size * 2 : 512;
+            int *grown = (int *)calloc(size, sizeof(int));
+            if(grown == NULL)
+                goto oom;
+            for(int p = 0; p < batch->program_count; ++p){
+                unsigned long slot = hashString(batch->programs[p].path) % size;
+                while(grown[slot] != 0)
+                    slot = (slot + 1) % size;
+                grown[slot] = p + 1;
+            }
+            free(table);
+            table = grown;
+            table_size = size;
+        }
+        if(batch->program_count == program_cap){
+            Program *grown = (Program *)realloc(batch->programs, (program_cap ? program_cap * 2 : 64) * sizeof(Program));
+            if(grown == NULL)
+                goto oom;
+            batch->programs = grown;
+            program_cap = program_cap ? program_cap * 2 : 64;
+        }
+
+        job = &batch->jobs[batch->job_count];
+        memset(job, 0, sizeof(Job));
+        job->line = line_number;
+        job->name = strdup(words[0]);
+        job->input = words[1] != NULL ? strdup(words[1]) : NULL;
+        job->output = words[2] != NULL ? strdup(words[2]) : NULL;
+        ++batch->job_count;
+        if(job->name == NULL || (words[1] != NULL && job->input == NULL) || (words[2] != NULL && job->output == NULL))
+            goto oom;
+        if((job->program = findProgram(batch, words[0], table, table_size)) == -1)
+            goto oom;
+    }
+    free(line);
+    free(table);
+    fclose(in);
+    return 0;
+
+oom:
+    fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+fail:
+    free(line);
+    free(table);
+    fclose(in);
+    return -1;
+}
+
+// Finds the program at path in the hash table, adding it if it is new. Paths are resolved
+// first, so two spellings of one file compile once.
+static int findProgram(Batch *batch, const char *path, int *table, int table_size){
+    char resolved[PATH_MAX];
+    const char *key = realpath(path, resolved) != NULL ? resolved : path;
+    unsigned long slot = hashString(key) % table_size;
+
+    for(; table[slot] != 0; slot = (slot + 1) % table_size)
+        if(strcmp(batch->programs[table[slot] - 1].path, key) == 0)
+            return table[slot] - 1;
+    if((batch->programs[batch->program_count].path = strdup(key)) == NULL)
+        return -1;
+    batch->programs[batch->program_count].code = NULL;
+    table[slot] = batch->program_count + 1;
+    return batch->program_count++;
+}
+
+static void *work(void *arg){
+    Worker *worker = (Worker *)arg;
+    int job = -1;
+
+    while((job = takeJob(worker->batch, worker->id)) != -1)
+        runJob(worker->batch, &worker->batch->jobs[job]);
+    return NULL;
+}
+
+static int takeJob(Batch *batch, int id){
+    Deque *own = &batch->deques[id];
+    int job = -1;
+
+    pthread_mutex_lock(&own->lock);                    // Newest of its own first
+    if(own->tail > own->head)
+        job = own->jobs[--own->tail];
+    pthread_mutex_unlock(&own->lock);
+
+    for(int w = 1; job == -1 && w < batch->workers; ++w){  // Then the oldest of someone else's
+        Deque *victim = &batch->deques[(id + w) % batch->workers];
+        pthread_mutex_lock(&victim->lock);
+        if(victim->tail > victim->head)
+            job = victim->jobs[victim->head++];
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return job;
+}
+
+static void runJob(Batch *batch, Job *job){
+    const Instr *code = batch->programs[job->program].code;
+    Output *io = NULL;                                 // The job's captured I/O
+    Budget budget;                                     // How far it got
+    char *input = NULL;
+    size_t input_len = 0;
+    double start = now();
+    int result = 0;
+
+    job->status = JOB_FAILED;
+    if(code == NULL){
+        job->error = FAIL_PROGRAM;
+        return;
+    }
+    if(job->input != NULL && (input = readFile(job->input, &input_len)) == NULL){
+        job->error = FAIL_INPUT;
+        return;
+    }
+    if((io = (Output *)malloc(sizeof(Output))) == NULL){
+        free(input);
+        job->error = FAIL_MEMORY;
+        return;
+    }
+    initOutput(io, -1, FLUSH_FULL);
+    captureOutput(io, input != NULL ? input : "", input_len);
+
+    result = execute(code, batch->opts, io, NULL, &budget);
+    job->out_bytes = io->captured;
+    if(result == -1)
+        job->error = FAIL_MEMORY;
+    else{
+        job->status = result == 0 ? JOB_OK : result == ERR_STEP_LIMIT || result == ERR_TIMEOUT ? JOB_LIMIT : JOB_ERROR;
+        job->error = result;
+        job->steps = budget.steps;
+    }
+    if(result != -1 && job->output != NULL){
+        FILE *out = fopen(job->output, "wb");
+        if(out == NULL || fwrite(io->capture, 1, io->captured, out) != io->captured){
+            job->status = JOB_FAILED;
+            job->error = FAIL_OUTPUT;
+        }
+        if(out != NULL && fclose(out) != 0){
+            job->status = JOB_FAILED;
+            job->error = FAIL_OUTPUT;
+        }
+    }
+    job->seconds = now() - start;
+
+    free(io->capture);
+    free(io);
+    free(input);
+}
+
+static char *readFile(const char *path, size_t *len){
+    FILE *in = fopen(path, "rb");
+    char *data = NULL;
+    size_t cap = 0;
+
+    *len = 0;
+    if(in == NULL)
+        return NULL;
+    for(;;){
+        size_t got = 0;
+        if(*len == cap){
+            char *grown = (char *)realloc(data, cap ? cap * 2 : 4096);
+            if(grown == NULL){
+                free(data);
+                fclose(in);
+                return NULL;
+            }
+            data = grown;
+            cap = cap ? cap * 2 : 4096;
+        }
+        got = fread(data + *len, 1, cap - *len, in);
+        *len += got;
+        if(got == 0)
+            break;
+    }
+    if(ferror(in)){
+        free(data);
+        data = NULL;
+    }
+    fclose(in);
+    return data;
+}
+
+static double now(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static unsigned long hashString(const char *text){
+    unsigned long hash = 2166136261ul;
+    for(; *text != '\0'; ++text)
+        hash = (hash ^ (unsigned char)*text) * 16777619ul;
+    return hash;
+}
@@ -0,0 +1,250 @@
+//
+//  cache.c
+//
+//  Screw Interpreter
+//
+//  --cache: compiled programs are saved under $XDG_CACHE_HOME/scrint (or
+//  ~/.cache/scrint), named by a hash of the source and the optimization
+//  level. A later run of the same source maps the image straight in and
+//  skips tokenizing and compiling. Images hold the instructions exactly as
+//  they are in memory, behind a header that is checked before any are used,
+//  and then what the program did before it needed input (a Snapshot), so
+//  that part needn't run again either.
+//
+
+#include <stdio.h>
+#include <stdlib.h>         // For getenv()
+#include <string.h>         // For memcpy(), memcmp()
+#include <fcntl.h>          // For open()
+#include <unistd.h>         // For write(), close(), rename(), unlink(), getpid()
+#include <sys/mman.h>       // For mmap(), munmap()
+#include <sys/stat.h>       // For fstat(), mkdir()
+#include "screw.h"
+
+#define IMAGE_VERSION 6     // Bump whenever Instr or what compile() emits changes
+
+typedef struct {            // Start of an image file
+    char magic[8];          // "SCRWIMG" and a NUL
+    unsigned int version;   // IMAGE_VERSION
+    unsigned int instr_size;    // sizeof(Instr), which also tells byte order and padding apart
+    unsigned long long key;     // Hash of the source
+    unsigned long long source_size; // Bytes in the source
+    int level;              // Optimization level
+    int count;              // Instructions that follow, OP_HALT included
+    int prefixed;           // 1 if a SnapshotHeader follows the instructions
+} ImageHeader;
+
+typedef struct {            // A snapshot, followed by its cells and its output
+    long long cells;        // The Snapshot's fields, at fixed widths
+    int width;
+    int overflow;
+    int at;
+    long long cursor;
+    long long used;
+    unsigned long long output_len;
+    unsigned long long steps;
+} SnapshotHeader;
+
+static const char magic[8] = "SCRWIMG";
+
+static int cacheDir(char *, size_t);                   // Find (and make) the cache directory
+static void mapPrefix(Image *, const ImageHeader *);   // Find the snapshot after the instructions, if any
+
+// Finds where the image of src at level belongs and maps it if it is there. Returns 0 and
+// sets image->code on a hit, -1 on a miss; either way image can be passed to saveImage().
+int openImage(const Source *src, int level, Image *image){
+    char dir[4096];
+    struct stat info;
+    const ImageHeader *header = NULL;
+    int fd = -1;
+
+    image->code = NULL;
+    image->map = NULL;
+    image->map_len = 0;
+    image->key = hashSource(src);
+    image->source_size = src->size;
+    image->level = level;
+    image->path[0] = '\0';
+    image->prefixed = 0;
+    if(cacheDir(dir, sizeof(dir)) != 0)
+        return -1;
+    if(snprintf(image->path, sizeof(image->path), "%s/%016llx-O%d.img", dir, image->key, level) >= (int)sizeof(image->path)){
+        image->path[0] = '\0';
+        return -1;
+    }
+
+    if((fd = open(image->path, O_RDONLY)) == -1)
+        return -1;
+    if(fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(ImageHeader)){
+        close(fd);
+        return -1;
+    }
+    image->map_len = (size_t)info.st_size;
+    image->map = mmap(NULL, image->map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);   // Flags are set per run
+    close(fd);
+    if(image->map == MAP_FAILED){
+        image->map = NULL;
+        return -1;
+    }
+
+    header = (const ImageHeader *)image->map;
+    if(memcmp(header->magic, magic, sizeof(magic)) != 0 || header->version != IMAGE_VERSION
+       || header->instr_size != sizeof(Instr) || header->key != image->key
+       || header->source_size != (unsigned long long)src->size || header->level != level || header->count < 1
+       || (size_t)header->count > (image->map_len - sizeof(ImageHeader)) / sizeof(Instr)){
+        closeImage(image);                             // Stale, foreign or cut short: compile afresh and overwrite it
+        return -1;
+    }
+    image->code = (Instr *)(header + 1);
+    if(image->code[header->count - 1].op != OP_HALT){
+        closeImage(image);
+        return -1;
+    }
+    if(header->prefixed)
+        mapPrefix(image, header);
+    return 0;
+}
+
+// Writes code out as the image openImage() looked for, with snap unless it is NULL. The
+// image is written to a temporary file and renamed into place, so other runs only ever see a
+// whole one. Failures are quiet: the cache just misses again next time.
+void saveImage(const Image *image, const Instr *code, const Snapshot *snap){
+    char temp[sizeof(image->path) + 32];
+    ImageHeader header;
+    SnapshotHeader prefix;
+    int count = 1, fd = -1;
+    const char *p = NULL;
+    size_t left = 0;
+    _Bool ok = 1;
+
+    if(image->path[0] == '\0')
+        return;
+    while(code[count - 1].op != OP_HALT)
+        ++count;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = IMAGE_VERSION;
+    header.instr_size = sizeof(Instr);
+    header.key = image->key;
+    header.source_size = image->source_size;
+    header.level = image->level;
+    header.count = count;
+    header.prefixed = snap != NULL;
+    memset(&prefix, 0, sizeof(prefix));
+    if(snap != NULL){
+        prefix.cells = snap->cells;
+        prefix.width = snap->width;
+        prefix.overflow = snap->overflow;
+        prefix.at = snap->at;
+        prefix.cursor = snap->cursor;
+        prefix.used = snap->used;
+        prefix.output_len = snap->output_len;
+        prefix.steps = snap->steps;
+    }
+
+    if(snprintf(temp, sizeof(temp), "%s.%ld.tmp", image->path, (long)getpid()) >= (int)sizeof(temp))
+        return;
+    if((fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+        return;
+    for(int part = 0; part < (snap != NULL ? 5 : 2) && ok; ++part){    // Header, instructions, then the snapshot
+        p = part == 0 ? (const char *)&header : part == 1 ? (const char *)code : part == 2 ? (const char *)&prefix
+            : part == 3 ? snap->tape : (const char *)snap->output;
+        left = part == 0 ? sizeof(header) : part == 1 ? count * sizeof(Instr) : part == 2 ? sizeof(prefix)
+               : part == 3 ? (size_t)snap->used * snap->width : snap->output_len;
+        while(left > 0){
+            ssize_t wrote = write(fd, p, left);
+            if(wrote <= 0){
+                ok = 0;
+                break;
+            }
+            p += wrote;
+            left -= (size_t)wrote;
+        }
+    }
+    if(close(fd) != 0 || !ok || rename(temp, image->path) != 0)
+        unlink(temp);
+}
+
+void closeImage(Image *image){                         // Unmap a cached image
+    if(image->map != NULL)
+        munmap(image->map, image->map_len);
+    image->map = NULL;
+    image->code = NULL;
+    image->prefixed = 0;
+}
+
+// Points image->prefix into the map if a whole snapshot for these instructions follows them;
+// otherwise the image is used without one.
+static void mapPrefix(Image *image, const ImageHeader *header){
+    size_t at = sizeof(ImageHeader) + (size_t)header->count * sizeof(Instr);
+    const SnapshotHeader *prefix = (const SnapshotHeader *)((const char *)image->map + at);
+    size_t cells = 0;
+
+    if(image->map_len - at < sizeof(SnapshotHeader))
+        return;
+    at += sizeof(SnapshotHeader);
+    if((prefix->width != 1 && prefix->width != 2 && prefix->width != 4) || prefix->at < 0 || prefix->at >= header->count
+       || prefix->cells < CELLS_MIN || prefix->cursor < 0 || prefix->cursor >= prefix->cells
+       || prefix->used < 0 || prefix->used > prefix->cells)
+        return;
+    cells = (size_t)prefix->used * prefix->width;
+    if(image->map_len - at < cells || image->map_len - at - cells < prefix->output_len)
+        return;
+    image->prefix.cells = (long)prefix->cells;
+    image->prefix.width = prefix->width;
+    image->prefix.overflow = prefix->overflow;
+    image->prefix.at = prefix->at;
+    image->prefix.cursor = (long)prefix->cursor;
+    image->prefix.used = (long)prefix->used;
+    image->prefix.tape = (const char *)image->map + at;
+    image->prefix.output_len = (size_t)prefix->output_len;
+    image->prefix.output = (const unsigned char *)image->map + at + cells;
+    image->prefix.steps = prefix->steps;
+    image->prefix.input_read = image->prefix.written = 0;  // It stopped before the first '?', having written only output
+    image->prefix.own = NULL;
+    image->prefixed = 1;
+}
+
+// FNV-1a taken eight bytes at a time, with the high half folded back in after every step so
+// every byte reaches the low bits, which makes hashing a big source cost about as much as
+// reading it. Only used to name and check images and checkpoints, so it needs to spread well,
+// not resist attack.
+unsigned long long hashSource(const Source *src){
+    const unsigned char *p = (const unsigned char *)src->text;
+    size_t left = src->size;
+    unsigned long long hash = 0xcbf29ce484222325ULL;
+
+    for(; left >= 8; p += 8, left -= 8){
+        unsigned long long word;
+        memcpy(&word, p, 8);
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 32;
+    }
+    for(; left > 0; ++p, --left)
+        hash = (hash ^ *p) * 0x100000001b3ULL;
+    return hash;
+}
+
+static int cacheDir(char *dir, size_t size){           // $XDG_CACHE_HOME/scrint or ~/.cache/scrint, made if missing
+    const char *base = getenv("XDG_CACHE_HOME");
+    int len = 0;
+
+    if(base != NULL && base[0] == '/')
+        len = snprintf(dir, size, "%s/scrint", base);
+    else if((base = getenv("HOME")) != NULL && base[0] != '\0'){
+        if((len = snprintf(dir, size, "%s/.cache", base)) >= (int)size)
+            return -1;
+        mkdir(dir, 0755);
+        len = snprintf(dir, size, "%s/.cache/scrint", base);
+    }
+    else
+        return -1;
+    if(len >= (int)size)
+        return -1;
+    if(mkdir(dir, 0755) != 0){
+        struct stat info;
+        if(stat(dir, &info) != 0 || !S_ISDIR(info.st_mode))
+            return -1;
+    }
+    return 0;
+}
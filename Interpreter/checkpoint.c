@@ -0,0 +1,235 @@
+//
+//  checkpoint.c
+//
+//  Screw Interpreter
+//
+//  --checkpoint-every N: every N steps, where the run is goes out to a
+//  checkpoint file, which --restore reads back to go on from there. A
+//  checkpoint holds the instruction to go on from, the cursor, the steps
+//  taken, how much input was read and output written, and the tape a page
+//  at a time, leaving out the pages of zeros. It is taken where the engines
+//  charge their steps: at a loop going round, which goes on at the loop's
+//  start, or a scan that stopped, which goes on after it.
+//
+//  The run doesn't wait for the file to be written: it forks, and the child
+//  writes out its copy-on-write view of the tape while the run goes on. One
+//  that falls due while the last is still being written is skipped. The
+//  file is written next to its place and renamed into it, so a run killed
+//  part way leaves the last checkpoint whole.
+//
+//  Output is flushed at every checkpoint, so none written before it is
+//  lost; what was written after it is written again by the restored run. A
+//  checkpoint only holds for the source, optimization level, tape length,
+//  cell width, overflow policy and end-of-input policy it was taken with.
+//
+
+#include <stdio.h>
+#include <stdlib.h>         // For calloc() and free()
+#include <string.h>         // For memcpy(), memcmp(), memset()
+#include <fcntl.h>          // For open()
+#include <unistd.h>         // For fork(), read(), write(), close(), rename(), unlink(), _exit()
+#include <sys/wait.h>       // For waitpid()
+#include "screw.h"
+
+#define CHECKPOINT_VERSION 3    // Bump whenever the layout below or the instructions a run goes on from change
+
+typedef struct {            // Start of a checkpoint file, followed by its pages
+    char magic[8];          // "SCRWCKP" and a NUL
+    unsigned int version;   // CHECKPOINT_VERSION
+    int level;              // Optimization level of the program
+    unsigned long long key;     // Hash of its source
+    unsigned long long source_size; // Bytes in the source
+    long long cells;        // Length of the tape
+    int width;              // Bytes in a cell
+    int overflow;           // What 'A' and 'S' do past the cell range (OVERFLOW_*)
+    int at;                 // Instruction the run goes on from
+    int eof;                // What '?' does at the end of the input (EOF_*)
+    long long cursor;       // Cell the cursor is on
+    unsigned long long steps;   // Steps taken
+    unsigned long long input_read;  // Bytes of input read
+    unsigned long long written; // Bytes of output written
+    unsigned long long pages;   // Pages that follow: the page's number, then its bytes (fewer in the last)
+} CheckpointHeader;
+
+static const char magic[8] = "SCRWCKP";
+static const char zeros[CHECKPOINT_PAGE];              // A page that is left out
+
+static int writeCheckpoint(const Checkpoint *, const CheckpointHeader *);   // Write the file (0 if it was)
+static int writeAll(int, const void *, size_t);        // write() until everything is out (0 if it was)
+static int readAll(int, void *, size_t);               // read() until everything is in (0 if it was)
+
+// Takes a checkpoint of the run at instruction at, which charged its steps (steps in all)
+// with the cursor on cell cursor, and hands it to a child process to write.
+void takeCheckpoint(Checkpoint *ck, int at, long cursor, unsigned long long steps){
+    CheckpointHeader header;
+    int status = 0, child = 0;
+
+    if(ck->writer > 0){
+        if(waitpid(ck->writer, &status, WNOHANG) == 0)
+            return;                                    // Still writing the last one: skip this one rather than wait
+        ck->writer = 0;
+    }
+    flushOutput(ck->out);                              // So what it wrote so far can't be lost
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = CHECKPOINT_VERSION;
+    header.level = ck->level;
+    header.key = ck->key;
+    header.source_size = ck->source_size;
+    header.cells = ck->tape->size;
+    header.width = ck->tape->width;
+    header.overflow = ck->overflow;
+    header.eof = ck->eof;
+    header.at = ck->code[at].op == OP_END ? ck->code[at].a : at + 1;   // The loop going round, or the scan done
+    header.cursor = cursor;
+    header.steps = steps;
+    header.input_read = ck->out->input_base + ck->out->input_pos;
+    header.written = ck->out->written;
+
+    if((child = (int)fork()) == 0)
+        _exit(writeCheckpoint(ck, &header) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    if(child < 0)
+        writeCheckpoint(ck, &header);                  // No process to spare: write it here and now
+    else
+        ck->writer = child;
+}
+
+void finishCheckpoints(Checkpoint *ck){                // Wait for the last checkpoint to be written
+    int status = 0;
+
+    if(ck->writer > 0)
+        waitpid(ck->writer, &status, 0);
+    ck->writer = 0;
+}
+
+// Reads the checkpoint in path back as a Snapshot a run with opts can start from, after
+// checking it was taken of the program expect describes with the same tape. Prints what is
+// wrong and returns NULL if it can't be used.
+Snapshot *loadCheckpoint(const char *path, const Checkpoint *expect, const Options *opts){
+    CheckpointHeader header;
+    Snapshot *snap = NULL;
+    size_t size = 0;                                   // Bytes in the tape
+    int count = 1, fd = -1;
+
+    if((fd = open(path, O_RDONLY)) == -1){
+        fprintf(stderr, "%sError:%s Could not open %s\n", RED, RESET, path);
+        goto fail;
+    }
+    if(readAll(fd, &header, sizeof(header)) != 0 || memcmp(header.magic, magic, sizeof(magic)) != 0
+       || header.version != CHECKPOINT_VERSION){
+        fprintf(stderr, "%sError:%s %s is not a checkpoint\n", RED, RESET, path);
+        goto fail;
+    }
+    while(expect->code[count - 1].op != OP_HALT)
+        ++count;
+    if(header.key != expect->key || header.source_size != expect->source_size || header.level != expect->level
+       || header.at < 0 || header.at >= count){
+        fprintf(stderr, "%sError:%s %s is a checkpoint of another program (or another -O level)\n", RED, RESET, path);
+        goto fail;
+    }
+    if(header.cells != opts->cells || header.width != opts->width || header.overflow != opts->overflow
+       || header.eof != opts->eof){             // The checks proven away hold for the states its run could reach
+        fprintf(stderr, "%sError:%s %s was taken with another --cells, --cell-bits, --overflow or --eof\n", RED, RESET, path);
+        goto fail;
+    }
+    size = (size_t)opts->cells * opts->width;
+    if((snap = (Snapshot *)calloc(1, sizeof(Snapshot))) == NULL || (snap->own = calloc(size, 1)) == NULL){
+        fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+        goto fail;
+    }
+    for(unsigned long long page = 0; page < header.pages; ++page){
+        unsigned long long number = 0;
+        size_t from = 0, len = 0;
+        if(readAll(fd, &number, sizeof(number)) != 0 || number >= (size + CHECKPOINT_PAGE - 1) / CHECKPOINT_PAGE){
+            fprintf(stderr, "%sError:%s %s is cut short or damaged\n", RED, RESET, path);
+            goto fail;
+        }
+        from = (size_t)number * CHECKPOINT_PAGE;
+        len = size - from < CHECKPOINT_PAGE ? size - from : CHECKPOINT_PAGE;
+        if(readAll(fd, (char *)snap->own + from, len) != 0){
+            fprintf(stderr, "%sError:%s %s is cut short or damaged\n", RED, RESET, path);
+            goto fail;
+        }
+        if((long)((from + len) / opts->width) > snap->used)
+            snap->used = (long)((from + len) / opts->width);
+    }
+    if(header.cursor < 0 || header.cursor >= header.cells){
+        fprintf(stderr, "%sError:%s %s is cut short or damaged\n", RED, RESET, path);
+        goto fail;
+    }
+    close(fd);
+    snap->cells = opts->cells;
+    snap->width = opts->width;
+    snap->overflow = opts->overflow;
+    snap->at = header.at;
+    snap->cursor = (long)header.cursor;
+    snap->tape = (const char *)snap->own;
+    snap->steps = header.steps;
+    snap->input_read = header.input_read;
+    snap->written = header.written;
+    return snap;
+
+fail:
+    if(fd != -1)
+        close(fd);
+    freeSnapshot(snap);
+    return NULL;
+}
+
+// Writes header and the pages of the tape that aren't all zeros to a temporary file, then
+// renames it over the last checkpoint.
+static int writeCheckpoint(const Checkpoint *ck, const CheckpointHeader *header){
+    char temp[4160];
+    CheckpointHeader head = *header;
+    const char *cells = ck->tape->cells;
+    size_t size = (size_t)ck->tape->size * ck->tape->width;
+    unsigned long long pages = (size + CHECKPOINT_PAGE - 1) / CHECKPOINT_PAGE;
+    int fd = -1, ok = 1;
+
+    for(unsigned long long page = 0; page < pages; ++page){
+        size_t from = (size_t)page * CHECKPOINT_PAGE;
+        if(memcmp(cells + from, zeros, size - from < CHECKPOINT_PAGE ? size - from : CHECKPOINT_PAGE) != 0)
+            ++head.pages;
+    }
+    if(snprintf(temp, sizeof(temp), "%s.%ld.tmp", ck->path, (long)getpid()) >= (int)sizeof(temp)
+       || (fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1)
+        return -1;
+    ok = writeAll(fd, &head, sizeof(head)) == 0;
+    for(unsigned long long page = 0; page < pages && ok; ++page){
+        size_t from = (size_t)page * CHECKPOINT_PAGE;
+        size_t len = size - from < CHECKPOINT_PAGE ? size - from : CHECKPOINT_PAGE;
+        if(memcmp(cells + from, zeros, len) != 0)
+            ok = writeAll(fd, &page, sizeof(page)) == 0 && writeAll(fd, cells + from, len) == 0;
+    }
+    if(close(fd) != 0 || !ok || rename(temp, ck->path) != 0){
+        unlink(temp);
+        return -1;
+    }
+    return 0;
+}
+
+static int writeAll(int fd, const void *bytes, size_t n){
+    const char *p = (const char *)bytes;
+
+    while(n > 0){
+        ssize_t wrote = write(fd, p, n);
+        if(wrote <= 0)
+            return -1;
+        p += wrote;
+        n -= (size_t)wrote;
+    }
+    return 0;
+}
+
+static int readAll(int fd, void *bytes, size_t n){
+    char *p = (char *)bytes;
+
+    while(n > 0){
+        ssize_t got = read(fd, p, n);
+        if(got <= 0)
+            return -1;
+        p += got;
+        n -= (size_t)got;
+    }
+    return 0;
+}
@@ -0,0 +1,532 @@
+//
+//  compile.c
+//
+//  Screw Interpreter
+//
+//  Turns tokenized screw code into the instruction stream run() executes.
+//
+//  -O0 : One instruction per token
+//  -O1 : Runs of '+'/'-' and '>'/'<' are folded, adjacent 'A's and 'S's are merged
+//  -O2 : Clear loops ("{-}"), multiply/copy loops ("{->+>++<<}") and scan loops ("{>}")
+//        are replaced, and straight-line code that shifts back and forth
+//        (">+>++<<-") becomes one block of cells addressed by offset
+//
+
+#include <stdlib.h>         // For malloc(), realloc() and free()
+#include <string.h>         // For memcpy()
+#include <limits.h>         // For INT_MAX
+#include <ctype.h>          // isdigit()
+#include "screw.h"
+
+#define FUSE_MAX 64         // Longest loop body (in instructions) considered for multiply loop replacement
+
+typedef struct {            // Instruction stream being built
+    Instr *code;            // Instructions emitted so far
+    size_t *origins;        // Token each instruction came from (NULL if not wanted)
+    size_t token;           // Token being compiled
+    int len;                // Number of instructions emitted
+    int cap;                // Number of instructions code has room for
+} Builder;
+
+static _Bool reserve(Builder *, int);           // Make room for more instructions
+static Instr *emit(Builder *, int);             // Append an instruction
+static void setError(Instr *, int, char);       // Turn an instruction into a deferred runtime error
+static int saturate(long);                      // Clamp a folded operand to +/-OPERAND_MAX
+static long decodeNumber(const char **);        // Decode the digits after a cursor, moving it to the last
+static _Bool fuseLoop(Builder *, int);          // Replace the loop starting at an index with cheaper instructions
+static _Bool addressBlocks(Builder *);          // Address the cells of straight-line code by offset
+static _Bool straight(int);                     // Whether an operation can be part of such code
+static Instr *copyInstr(Builder *, const Builder *, int);  // Append an instruction of another stream
+static void markProbes(Builder *);              // Flag the moves a guard page can check
+static _Bool countSteps(Builder *);             // Give every OP_END the steps of one pass over its loop
+
+Instr *compile(const char *code, size_t count, int level, size_t **origins){ // Turn count tokens of screw code (then '~') into an instruction stream
+    Builder b = { NULL, NULL, 0, 0, 0 };               // Instructions being built
+    const char *cursor = code;                         // Cursor for reading the tokenized code
+    int *open_braces = NULL;                           // Stack of unmatched '{' instruction indexes
+    int depth = 0;                                     // Number of unmatched '{' on the stack
+    int max_depth = 0;                                 // Number of indexes open_braces has room for
+    Instr *in = NULL;                                  // Instruction being compiled
+    Instr *prev = NULL;                                // Last instruction emitted, if it can absorb the current token
+
+    if(code[count] != '~')
+        return NULL;
+    if(origins != NULL && (b.origins = (size_t *)malloc(256 * sizeof(size_t))) == NULL)
+        return NULL;
+
+    while(*cursor != '~'){                             // Compile every token up to the terminating character
+        prev = (level >= 1 && b.len > 0) ? &b.code[b.len - 1] : NULL;
+        b.token = (size_t)(cursor - code);
+
+        switch(*cursor){
+            case '>':
+            case '<':
+                if(prev != NULL && prev->op == OP_MOVE && (prev->a > 0) == (*cursor == '>')){
+                    prev->a = saturate((long)prev->a + (*cursor == '>' ? 1 : -1)); // Only same-direction runs fold so the
+                    break;                                                           // cursor never takes a shortcut past an edge
+                }
+                if((in = emit(&b, OP_MOVE)) == NULL)
+                    goto fail;
+                in->a = (*cursor == '>') ? 1 : -1;
+                break;
+            case '+':
+            case '-':
+                if(prev != NULL && prev->op == OP_INC){
+                    prev->a = (int)((unsigned)prev->a + (*cursor == '+' ? 1u : -1u)); // Cells wrap, so the sum wraps too
+                    if(prev->a == 0)                   // "+-" does nothing
+                        --b.len;
+                    break;
+                }
+                if((in = emit(&b, OP_INC)) == NULL)
+                    goto fail;
+                in->a = (*cursor == '+') ? 1 : -1;
+                break;
+            case '.':
+                if(emit(&b, OP_OUT) == NULL)
+                    goto fail;
+                break;
+            case '?':
+                if(emit(&b, OP_IN) == NULL)
+                    goto fail;
+                break;
+            case '*':                                  // Decode "*a^b" bounds once, up front
+                if((in = emit(&b, OP_DUMP)) == NULL)
+                    goto fail;
+                if(!isdigit(cursor[1]))
+                    setError(in, ERR_DUMP_LOWER, 0);
+                else{
+                    const char *bound = cursor;        // Last digit read
+                    long lower = decodeNumber(&bound), upper = 0;
+                    if(bound[1] != '^')
+                        setError(in, ERR_DUMP_CARET, 0);
+                    else if(!isdigit(bound[2]))
+                        setError(in, ERR_DUMP_UPPER, 0);
+                    else{
+                        ++bound;                       // On the '^'
+                        if((upper = decodeNumber(&bound)) < lower)
+                            setError(in, ERR_DUMP_ORDER, 0);
+                        else{
+                            in->a = saturate(lower);   // Lower bound
+                            in->b = saturate(upper);   // Upper bound (past any tape if it was saturated)
+                            cursor = bound;            // Skip past "a^b"
+                        }
+                    }
+                }
+                break;
+            case 'A':                                  // Decode the operand of 'A' once, up front
+            case 'S':                                  // Decode the operand of 'S' once, up front
+                if(!isdigit(cursor[1])){
+                    if((in = emit(&b, OP_ERROR)) == NULL)
+                        goto fail;
+                    setError(in, *cursor == 'A' ? ERR_ADD_INT : ERR_SUB_INT, 0);
+                    break;
+                }
+                if(prev != NULL && prev->op == (*cursor == 'A' ? OP_ADD : OP_SUB))
+                    in = prev;                         // "A5A3" checks and adds the same as "A8"
+                else if((in = emit(&b, *cursor == 'A' ? OP_ADD : OP_SUB)) == NULL)
+                    goto fail;
+                {
+                    long value = 0;                    // Decoded operand
+                    while(isdigit(cursor[1])){         // Saturate instead of overflowing; anything this large overflows a cell anyway
+                        if(value <= OPERAND_MAX)
+                            value = value * 10 + (cursor[1] - '0');
+                        ++cursor;
+                    }
+                    in->a = saturate((long)in->a + value);
+                }
+                break;
+            case '{':
+                if((in = emit(&b, OP_LOOP)) == NULL)
+                    goto fail;
+                if(depth == max_depth){                // Loops nest deeper than ever before
+                    int *grown = (int *)realloc(open_braces, (max_depth ? max_depth * 2 : 64) * sizeof(int));
+                    if(grown == NULL)
+                        goto fail;
+                    open_braces = grown;
+                    max_depth = max_depth ? max_depth * 2 : 64;
+                }
+                open_braces[depth++] = b.len - 1;      // Remember where the loop starts
+                break;
+            case '}':
+                if(depth == 0)                         // '}' without a '{' before it
+                    goto fail;
+                --depth;
+                if(level >= 2 && fuseLoop(&b, open_braces[depth]))
+                    break;
+                if((in = emit(&b, OP_END)) == NULL)
+                    goto fail;
+                in->a = open_braces[depth] + 1;        // Jump back to the first instruction of the loop body
+                b.code[open_braces[depth]].a = b.len;  // Jump forward to the instruction after the loop
+                break;
+            default:                                   // Digits and '^' that are not part of a 'A', 'S' or '*' instruction
+                if((in = emit(&b, OP_ERROR)) == NULL)
+                    goto fail;
+                setError(in, ERR_UNKNOWN_SYMBOL, *cursor);
+                break;
+        }
+        ++cursor;
+    }
+    b.token = count;                                   // OP_HALT comes from the '~'
+    if(depth != 0 || emit(&b, OP_HALT) == NULL)        // '{' without a '}' after it
+        goto fail;
+    if(level >= 2 && !addressBlocks(&b))
+        goto fail;
+    markProbes(&b);
+    if(!countSteps(&b))
+        goto fail;
+
+    free(open_braces);
+    if(origins != NULL)
+        *origins = b.origins;
+    return b.code;
+
+fail:
+    free(open_braces);
+    free(b.code);
+    free(b.origins);
+    return NULL;
+}
+
+static _Bool reserve(Builder *b, int count){          // Make sure count more instructions fit without growing again
+    if(b->len + count > b->cap){
+        int cap = b->cap ? b->cap : 256;
+        if(b->len > INT_MAX / 2 - count)               // Instruction indexes are ints
+            return 0;
+        while(cap < b->len + count)
+            cap *= 2;
+        Instr *code = (Instr *)realloc(b->code, cap * sizeof(Instr));
+        if(code == NULL)
+            return 0;
+        b->code = code;
+        if(b->origins != NULL){
+            size_t *origins = (size_t *)realloc(b->origins, cap * sizeof(size_t));
+            if(origins == NULL)
+                return 0;
+            b->origins = origins;
+        }
+        b->cap = cap;
+    }
+    return 1;
+}
+
+static Instr *emit(Builder *b, int op){                // Append a zeroed instruction
+    if(!reserve(b, 1))
+        return NULL;
+    memset(&b->code[b->len], 0, sizeof(Instr));
+    b->code[b->len].op = op;
+    if(b->origins != NULL)
+        b->origins[b->len] = b->token;
+    return &b->code[b->len++];
+}
+
+static void setError(Instr *in, int error, char symbol){   // Turn an instruction into a deferred runtime error
+    in->op = OP_ERROR;
+    in->a = error;
+    in->b = symbol;
+    in->off = 0;
+}
+
+static long decodeNumber(const char **cursor){  // Saturate instead of overflowing; anything this large is past any tape anyway
+    long value = 0;
+
+    while(isdigit((*cursor)[1])){
+        if(value <= OPERAND_MAX)
+            value = value * 10 + ((*cursor)[1] - '0');
+        ++*cursor;
+    }
+    return value;
+}
+
+static int saturate(long value){                       // Keep folded operands in a range where run() can't overflow
+    if(value > OPERAND_MAX)
+        return OPERAND_MAX;
+    if(value < -OPERAND_MAX)
+        return -OPERAND_MAX;
+    return (int)value;
+}
+
+// A move can go unchecked on a guard tape if the very next instruction reads or writes
+// the cell it lands on: a move off the tape then faults before anything else happens, just
+// where the check would have failed. '?' is left out because it reads input first, and so
+// is anything working on a cell at an offset.
+static void markProbes(Builder *b){
+    for(int i = 0; i + 1 < b->len; ++i){
+        Instr *in = &b->code[i];
+        switch(b->code[i + 1].op){
+            case OP_INC: case OP_OUT: case OP_ADD: case OP_SUB: case OP_LOOP:
+            case OP_END: case OP_CLEAR: case OP_MUL_LOOP: case OP_SCAN:
+                if(in->op == OP_MOVE && in->a <= GUARD_CELLS && in->a >= -GUARD_CELLS
+                   && (b->code[i + 1].off == 0 || b->code[i + 1].op == OP_MUL_LOOP))
+                    in->flags |= F_PROBED;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// --max-steps counts steps at loop back-edges only, a whole pass at a time: the
+// instructions of the body that run once per pass (a nested loop's '{' included, its body
+// not) and the '}' itself. A pass runs every one of them, as nothing else in a body jumps
+// (but an OP_BLOCK to its original code, which only runs to raise an error).
+static _Bool countSteps(Builder *b){
+    int *open = (int *)malloc(2 * (b->len + 1) * sizeof(int));   // Stack of the loops around an instruction,
+    int *inner = open + b->len + 1;                    // and inner[i]: instructions inside loops nested in the one at i
+    int depth = 0;
+
+    if(open == NULL)
+        return 0;
+    for(int i = 0; i < b->len; ++i){
+        if(b->code[i].op == OP_LOOP){
+            open[depth++] = i;
+            inner[i] = 0;
+        }
+        else if(b->code[i].op == OP_END){
+            int start = open[--depth];
+            b->code[i].b = i - start - inner[start];
+            if(depth > 0)
+                inner[open[depth - 1]] += i - start;
+        }
+    }
+    free(open);
+    return 1;
+}
+
+// Called at a '}' (not yet emitted) whose '{' is at index start. If the loop body only
+// adds and shifts, ends where it started and takes 1 from its own cell per pass, it is
+// replaced by one OP_MUL per touched cell followed by OP_CLEAR. The original loop is kept
+// right behind them: OP_MUL_LOOP jumps to it when the cell is 0 (the zeroed cell skips it)
+// or when the body would leave the tape, so the shift error is raised exactly where it
+// used to be. A body that only shifts becomes a single OP_SCAN.
+static _Bool fuseLoop(Builder *b, int start){
+    int offsets[FUSE_MAX];                             // Cells touched by the body, relative to the loop cell
+    int deltas[FUSE_MAX];                              // What one pass adds to each touched cell
+    int touched = 0;                                   // Number of cells touched
+    int body = b->len - start - 1;                     // Number of instructions in the body
+    int pos = 0, lo = 0, hi = 0;                       // Cursor position during one pass, and how far it strays
+    int targets = 0;                                   // Cells other than the loop cell that change
+
+    if(body < 1 || body > FUSE_MAX)
+        return 0;
+    if(body == 1 && b->code[start + 1].op == OP_MOVE){ // "{>}", "{<<}": find the next 0 on the stride
+        int stride = b->code[start + 1].a;
+        b->len = start;
+        if(b->origins != NULL)
+            b->token = b->origins[start];
+        emit(b, OP_SCAN)->a = stride;
+        return 1;
+    }
+    for(int i = start + 1; i < b->len; ++i){
+        Instr *in = &b->code[i];
+        if(in->op == OP_MOVE){
+            pos += in->a;
+            lo = pos < lo ? pos : lo;
+            hi = pos > hi ? pos : hi;
+        }
+        else if(in->op == OP_INC){
+            int k = 0;
+            while(k < touched && offsets[k] != pos)
+                ++k;
+            if(k == touched){
+                offsets[touched] = pos;
+                deltas[touched++] = 0;
+            }
+            deltas[k] = (int)((unsigned)deltas[k] + (unsigned)in->a);
+        }
+        else
+            return 0;                                  // I/O, checked arithmetic or a nested loop
+    }
+    if(pos != 0 || touched == 0 || offsets[0] != 0)    // Every pass must start and end on the loop cell, which is changed first
+        return 0;
+    for(int k = 1; k < touched; ++k)
+        targets += (deltas[k] != 0);
+
+    if(lo == 0 && hi == 0){                            // "{-}", "{+}", "{---}": an odd step reaches 0 from any value
+        if(!(deltas[0] & 1))
+            return 0;
+        b->len = start;
+        if(b->origins != NULL)                         // Everything fused comes from the '{'
+            b->token = b->origins[start];
+        emit(b, OP_CLEAR);                             // Can't fail, the stream only shrank
+        return 1;
+    }
+    if(deltas[0] != -1)
+        return 0;
+
+    {
+        Instr loop[FUSE_MAX + 1];                      // The original loop, moved behind the fused instructions
+        size_t loop_origins[FUSE_MAX + 2];             // Where it came from, its '}' included
+        int fused = 1 + targets + 1;                   // OP_MUL_LOOP, one OP_MUL per target, OP_CLEAR
+        Instr *in = NULL;
+
+        if(!reserve(b, fused + 1))                     // Everything below fits once this succeeds
+            return 0;
+        memcpy(loop, &b->code[start], (body + 1) * sizeof(Instr));
+        if(b->origins != NULL){
+            memcpy(loop_origins, &b->origins[start], (body + 1) * sizeof(size_t));
+            loop_origins[body + 1] = b->token;
+            b->token = loop_origins[0];                // Everything fused comes from the '{'
+        }
+        b->len = start;
+        in = emit(b, OP_MUL_LOOP);
+        in->off = lo;
+        in->b = hi;
+        in->a = start + fused;                         // The original loop
+        for(int k = 1; k < touched; ++k){
+            if(deltas[k] == 0)
+                continue;
+            in = emit(b, OP_MUL);
+            in->off = offsets[k];
+            in->a = deltas[k];
+        }
+        emit(b, OP_CLEAR);
+        for(int i = 0; i <= body; ++i){
+            if(b->origins != NULL)
+                b->token = loop_origins[i];
+            *emit(b, loop[i].op) = loop[i];
+        }
+        if(b->origins != NULL)
+            b->token = loop_origins[body + 1];
+        in = emit(b, OP_END);
+        in->a = start + fused + 1;
+        b->code[start + fused].a = b->len;
+    }
+    return 1;
+}
+
+// A run of straight-line code that shifts more than once becomes an OP_BLOCK, which checks
+// once that every cell the run reaches is on the tape, then the run's other instructions,
+// each given the offset of its cell, and a single shift by the net amount. Where the cells
+// don't all fit, OP_BLOCK jumps to the original run instead, which raises the shift error
+// exactly where it used to and would jump back past the offset version. The original runs
+// are kept out of the way at the front, behind an OP_JUMP over them, so a block that fits
+// just falls through. Runs start right after a jump or at a jump target, so the loops'
+// jumps only need the new index of the instruction they point at.
+static _Bool addressBlocks(Builder *b){
+    Builder out = { NULL, NULL, 0, 0, 0 };             // The rewritten stream, from the first instruction after the OP_JUMP
+    Builder kept = { NULL, NULL, 0, 0, 0 };            // The original runs, from the first instruction after it
+    int *moved = (int *)malloc((b->len + 1) * sizeof(int));    // New index in out of every instruction a run starts at
+    int front = 0;                                     // Instructions before out: the OP_JUMP and the original runs
+
+    if(moved == NULL)
+        return 0;
+    if(b->origins != NULL && ((out.origins = (size_t *)malloc(256 * sizeof(size_t))) == NULL
+       || (kept.origins = (size_t *)malloc(256 * sizeof(size_t))) == NULL))
+        goto fail;
+
+    for(int i = 0; i < b->len; ){
+        int end = i, moves = 0, last_move = i;         // The run is i..end-1
+        long pos = 0, lo = 0, hi = 0;                  // Cursor position along the run, and how far it strays
+        Instr *in = NULL;
+
+        while(end < b->len && straight(b->code[end].op) && pos >= -GUARD_CELLS && pos <= GUARD_CELLS){
+            if(b->code[end].op == OP_MOVE){
+                pos += b->code[end].a;
+                lo = pos < lo ? pos : lo;
+                hi = pos > hi ? pos : hi;
+                last_move = end;
+                ++moves;
+            }
+            ++end;
+        }
+        if(moves < 2 + (pos != 0) || lo < -GUARD_CELLS || hi > GUARD_CELLS){   // Nothing saved, or too far apart
+            if(end == i)                               // A jump, or the end
+                ++end;
+            for(; i < end; ++i){
+                moved[i] = out.len;
+                if(copyInstr(&out, b, i) == NULL)
+                    goto fail;
+            }
+            continue;
+        }
+
+        moved[i] = out.len;
+        if(!reserve(&out, end - i + 1) || !reserve(&kept, end - i + 1))    // Everything below fits once these succeed
+            goto fail;
+        if(out.origins != NULL)
+            out.token = b->origins[i];
+        in = emit(&out, OP_BLOCK);
+        in->off = (int)lo;
+        in->b = (int)hi;
+        in->a = kept.len;                              // Made an index of the whole stream below
+        pos = 0;
+        for(int k = i; k < end; ++k){
+            copyInstr(&kept, b, k);
+            if(b->code[k].op == OP_MOVE)
+                pos += b->code[k].a;
+            else
+                copyInstr(&out, b, k)->off = (int)pos;
+        }
+        if(pos != 0){
+            in = copyInstr(&out, b, last_move);
+            in->a = (int)pos;
+            in->flags |= F_COVERED;
+        }
+        emit(&kept, OP_JUMP)->a = out.len;             // Back past the offset version (an index of out, for now)
+        i = end;
+    }
+    moved[b->len] = out.len;
+
+    if(kept.len > 0){
+        front = 1 + kept.len;
+        if(!reserve(&kept, out.len + 1))
+            goto fail;
+        memmove(&kept.code[1], kept.code, kept.len * sizeof(Instr));
+        if(kept.origins != NULL){
+            memmove(&kept.origins[1], kept.origins, kept.len * sizeof(size_t));
+            kept.origins[0] = b->origins[0];           // The OP_JUMP comes from the first token
+        }
+        memset(&kept.code[0], 0, sizeof(Instr));
+        kept.code[0].op = OP_JUMP;
+        kept.code[0].a = front;
+        for(int k = 1; k < front; ++k)
+            if(kept.code[k].op == OP_JUMP)
+                kept.code[k].a += front;
+        memcpy(&kept.code[front], out.code, out.len * sizeof(Instr));
+        if(kept.origins != NULL)
+            memcpy(&kept.origins[front], out.origins, out.len * sizeof(size_t));
+        kept.len = front + out.len;
+        free(out.code);
+        free(out.origins);
+        out = kept;
+        kept.code = NULL;
+        kept.origins = NULL;
+    }
+    for(int i = front; i < out.len; ++i)
+        if(out.code[i].op == OP_LOOP || out.code[i].op == OP_END || out.code[i].op == OP_MUL_LOOP)
+            out.code[i].a = front + moved[out.code[i].a];
+        else if(out.code[i].op == OP_BLOCK)
+            out.code[i].a += 1;
+    free(moved);
+    free(kept.code);
+    free(kept.origins);
+    free(b->code);
+    free(b->origins);
+    b->code = out.code;
+    b->origins = out.origins;
+    b->len = out.len;
+    b->cap = out.cap;
+    return 1;
+
+fail:
+    free(moved);
+    free(out.code);
+    free(out.origins);
+    free(kept.code);
+    free(kept.origins);
+    return 0;
+}
+
+static _Bool straight(int op){                         // Shifts, and what works on one cell without jumping
+    return op == OP_MOVE || op == OP_INC || op == OP_ADD || op == OP_SUB || op == OP_CLEAR || op == OP_OUT || op == OP_IN;
+}
+
+static Instr *copyInstr(Builder *to, const Builder *from, int i){   // Append instruction i of from, and where it came from
+    Instr *in = NULL;
+
+    if(from->origins != NULL)
+        to->token = from->origins[i];
+    if((in = emit(to, from->code[i].op)) != NULL)
+        *in = from->code[i];
+    return in;
+}
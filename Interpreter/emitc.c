@@ -0,0 +1,376 @@
+//
+//  emitc.c
+//
+//  Screw Interpreter
+//
+//  Ahead-of-time mode: translates a compiled screw program into a standalone
+//  C program and builds it with the system C compiler (gcc -O2, or $CC).
+//  The generated program behaves exactly like run(): same tape length and
+//  cell width, same shift limits, same 'A'/'S' overflow policy, same cell dump.
+//  Checks proveChecks() flagged F_SAFE are left out of the C as well.
+//  A program that got part of the way at compile time starts with its
+//  cells written, its output in one fwrite() and a goto to where it stopped.
+//  --max-steps and --timeout are built in, counted the way the engines count
+//  them; without them the C has no counting code. Under --profile-use, the
+//  loops a recorded run went round most are unrolled by the C compiler and
+//  those it never entered are marked unlikely.
+//
+
+#include <stdio.h>
+#include <stdlib.h>         // For getenv(), mkstemp()
+#include <string.h>         // For strlen()
+#include <unistd.h>         // For fork(), execvp(), unlink(), close()
+#include <sys/wait.h>       // For waitpid()
+#include "screw.h"
+
+static const char *const cell_types[] = { "", "char", "short", "", "int" };    // C type of a cell, by width
+
+static void indent(FILE *, int);                   // Indent a generated line
+static void putString(FILE *, const char *);       // Write a C string literal
+static void putBytes(FILE *, const unsigned char *, size_t);    // Write any bytes as a C string literal
+
+int emitC(const Instr *code, const Options *opts, FILE *out){          // Write the C translation of a compiled program
+    int depth = 1;                                     // Nesting of the generated blocks
+    int *closes = NULL;                                // closes[i]: blocks to close before instruction i
+    _Bool *labels = NULL;                              // labels[i]: instruction i is the target of a goto
+    int count = 0;                                     // Number of instructions
+    int flush = opts->flush;                           // When output is written
+    int width = opts->width;                           // Bytes in a cell
+    _Bool checked = opts->tape != TAPE_UNCHECKED;      // Whether moves are checked
+    _Bool reads = 0;                                   // Whether the program has a '?'
+    _Bool limited = opts->max_steps != 0 || opts->timeout_ms != 0;  // Whether steps are counted
+    const Snapshot *prefix = opts->start;              // How far the program got at compile time (NULL: nowhere yet)
+    static const char *const at_eof[] = { "-1", "0", "cell" };  // What '?' returns at the end of the input, by EOF_*
+
+    while(code[count].op != OP_HALT)
+        reads |= code[count++].op == OP_IN;
+    closes = (int *)calloc(count + 1, sizeof(int));
+    labels = (_Bool *)calloc(count + 1, sizeof(_Bool));
+    if(closes == NULL || labels == NULL){
+        free(closes);
+        free(labels);
+        return -1;
+    }
+    for(int i = 0; i < count; ++i)                     // Blocks that may not fit go to their original code, which jumps back
+        if(code[i].op == OP_JUMP || (code[i].op == OP_BLOCK && checked && !(code[i].flags & F_SAFE)))
+            labels[code[i].a] = 1;
+    if(prefix != NULL)                                 // Where the run at compile time stopped
+        labels[prefix->at] = 1;
+
+    fprintf(out, "/* Generated by scrint -c */\n");
+    fprintf(out, "#define _GNU_SOURCE\n#include <stdio.h>\n#include <string.h>\n\n");
+    fprintf(out, "#define CELLS %ld\n", opts->cells);
+    fprintf(out, "#define CELL_MAX %lld\n\n", (1LL << (8 * width - 1)) - 1);
+    fprintf(out, "typedef %s cell;\ntypedef unsigned %s ucell;\n\n", cell_types[width], cell_types[width]);
+    if(prefix != NULL && prefix->used > 0){            // The cells it wrote to
+        fprintf(out, "static cell memory[CELLS] = {");
+        for(long cell = 0; cell < prefix->used; ++cell){
+            long value = width == 1 ? ((const char *)prefix->tape)[cell] : width == 2 ? ((const short *)prefix->tape)[cell]
+                         : ((const int *)prefix->tape)[cell];
+            fprintf(out, "%s%ld%s", cell % 16 == 0 ? "\n    " : " ", value, cell + 1 < prefix->used ? "," : "\n};\n\n");
+        }
+    }
+    else
+        fprintf(out, "static cell memory[CELLS];\n\n");
+    fprintf(out, "static int fail(const char *message){\n");
+    fprintf(out, "    fflush(stdout);\n");
+    fprintf(out, "    fprintf(stderr, \"%%sError:%%s %%s\\n\", \"\\033[0;31m\", \"\\033[0m\", message);\n");
+    fprintf(out, "    return 0;\n}\n\n");
+    if(limited){                                       // The runtime's budget: fuel counted down, refilled by charge()
+        fprintf(out, "#include <time.h>\n\n");
+        fprintf(out, "#define MAX_STEPS %lluULL\n#define TIMEOUT_MS %ldL\n\n", opts->max_steps, opts->timeout_ms);
+        fprintf(out, "static long long fuel, granted;\nstatic unsigned long long steps;\nstatic struct timespec start;\n\n");
+        fprintf(out, "static long elapsed(void){\n");
+        fprintf(out, "    struct timespec t;\n");
+        fprintf(out, "    clock_gettime(CLOCK_MONOTONIC, &t);\n");
+        fprintf(out, "    return (long)((t.tv_sec - start.tv_sec) * 1000 + (t.tv_nsec - start.tv_nsec) / 1000000);\n}\n\n");
+        fprintf(out, "static void grant(void){\n");
+        fprintf(out, "    granted = 1LL << 62;\n");
+        fprintf(out, "    if(MAX_STEPS != 0 && MAX_STEPS - steps < (unsigned long long)granted) granted = (long long)(MAX_STEPS - steps);\n");
+        fprintf(out, "    if(TIMEOUT_MS != 0 && granted > %d) granted = %d;\n", STEP_BATCH, STEP_BATCH);
+        fprintf(out, "    fuel = granted;\n}\n\n");
+        fprintf(out, "static int charge(void){\n");
+        fprintf(out, "    const char *message = NULL;\n");
+        fprintf(out, "    steps += (unsigned long long)(granted - fuel);\n");
+        fprintf(out, "    if(MAX_STEPS != 0 && steps > MAX_STEPS) message = ");
+        putString(out, errorMessage(ERR_STEP_LIMIT));
+        fprintf(out, ";\n    else if(TIMEOUT_MS != 0 && elapsed() >= TIMEOUT_MS) message = ");
+        putString(out, errorMessage(ERR_TIMEOUT));
+        fprintf(out, ";\n    else{ grant(); return 0; }\n");
+        fprintf(out, "    fail(message);\n");
+        fprintf(out, "    fprintf(stderr, \"%%sStopped:%%s after %%llu steps and %%ld ms\\n\", \"\\033[0;33m\", \"\\033[0m\", steps, elapsed());\n");
+        fprintf(out, "    return %d;\n}\n\n", EXIT_LIMIT);
+    }
+    if(reads){                                         // The runtime's input buffer, refilled a read() at a time
+        fprintf(out, "#include <unistd.h>\n#include <errno.h>\n\n");
+        fprintf(out, "static unsigned char in_buf[%d];\nstatic size_t in_len, in_pos;\nstatic int in_done;\n\n", INPUT_BUFFER);
+        fprintf(out, "static int input(int cell){\n");
+        fprintf(out, "    ssize_t got = 0;\n");
+        fprintf(out, "    if(in_pos < in_len) return in_buf[in_pos++];\n");
+        fprintf(out, "    if(in_done) return %s;\n", at_eof[opts->eof]);
+        if(flush != FLUSH_FULL)
+            fprintf(out, "    fflush(stdout);\n");
+        fprintf(out, "    while((got = read(0, in_buf, sizeof(in_buf))) < 0 && errno == EINTR);\n");
+        fprintf(out, "    if(got <= 0){ in_done = 1; return %s; }\n", at_eof[opts->eof]);
+        fprintf(out, "    in_len = (size_t)got; in_pos = 1;\n");
+        fprintf(out, "    return in_buf[0];\n}\n\n");
+    }
+    fprintf(out, "int main(void){\n");
+    fprintf(out, "    cell *p = memory;\n");
+    fprintf(out, "    setvbuf(stdout, NULL, %s, %d);\n", flush == FLUSH_LINE ? "_IOLBF" : "_IOFBF", OUTPUT_BUFFER);
+    if(limited)
+        fprintf(out, "    clock_gettime(CLOCK_MONOTONIC, &start); steps = %lluULL; grant();\n", prefix != NULL ? prefix->steps : 0);
+    if(prefix != NULL){                                // Its output in one write, then on from there
+        if(prefix->output_len > 0){
+            fprintf(out, "    fwrite(");
+            putBytes(out, prefix->output, prefix->output_len);
+            fprintf(out, ", 1, %zu, stdout);\n", prefix->output_len);
+        }
+        fprintf(out, "    p = memory + %ld;\n    goto i%d;\n", prefix->cursor, prefix->at);
+    }
+
+    for(int i = 0; i <= count; ++i){
+        const Instr *in = &code[i];
+        char cell[24];                                 // The cell it works on
+        snprintf(cell, sizeof(cell), in->off != 0 ? "p[%d]" : "*p", in->off);
+        for(; closes[i] > 0; --closes[i]){             // End of a fused multiply loop
+            indent(out, --depth);
+            fprintf(out, "}\n");
+        }
+        if(labels[i]){
+            indent(out, depth);
+            fprintf(out, "i%d: ;\n", i);
+        }
+        if(in->op == OP_END){
+            if(limited){                               // Count the pass if the loop goes round again
+                indent(out, depth);
+                fprintf(out, "if(*p && (fuel -= %d) < 0 && charge()) return %d;\n", in->b, EXIT_LIMIT);
+            }
+            indent(out, --depth);
+            fprintf(out, "}\n");
+            continue;
+        }
+        if(in->op == OP_BLOCK && (!checked || (in->flags & F_SAFE)))   // Nothing to check
+            continue;
+        indent(out, depth);
+        switch(in->op){
+            case OP_MOVE:
+                if(!checked || (in->flags & (F_SAFE | F_COVERED))){
+                    fprintf(out, "p += %d;\n", in->a);
+                    break;
+                }
+                if(in->a > 0)
+                    fprintf(out, "if(p - memory > CELLS - 1 - %d) return fail(", in->a);
+                else
+                    fprintf(out, "if(p - memory < %d) return fail(", -in->a);
+                putString(out, errorMessage(in->a > 0 ? ERR_SHIFT_RIGHT : ERR_SHIFT_LEFT));
+                fprintf(out, "); p += %d;\n", in->a);
+                break;
+            case OP_INC:
+                fprintf(out, "%s = (cell)((ucell)%s + %uu);\n", cell, cell, (unsigned)in->a);
+                break;
+            case OP_OUT:
+                fprintf(out, "putchar(%s);\n", cell);
+                break;
+            case OP_IN:
+                fprintf(out, "%s = (cell)input(%s);\n", cell, cell);
+                break;
+            case OP_DUMP:                              // Wide cells are dumped by their low byte
+                if(in->b > opts->cells - 1){           // Past the end of the tape
+                    fprintf(out, "return fail(");
+                    putString(out, errorMessage(ERR_DUMP_RANGE));
+                    fprintf(out, ");\n");
+                }
+                else if(width == 1)
+                    fprintf(out, "p = memory + %d; fwrite(p, 1, %d, stdout); memset(p, 0, %d);\n",
+                            in->a, in->b - in->a + 1, in->b - in->a + 1);
+                else
+                    fprintf(out, "p = memory + %d; for(int i = 0; i < %d; ++i) putchar(p[i]); memset(p, 0, %d * sizeof(cell));\n",
+                            in->a, in->b - in->a + 1, in->b - in->a + 1);
+                break;
+            case OP_ADD:
+                if(opts->overflow == OVERFLOW_WRAP || (opts->overflow == OVERFLOW_ERROR && (in->flags & F_SAFE)))
+                    fprintf(out, "%s = (cell)((ucell)%s + %uu);\n", cell, cell, (unsigned)in->a);
+                else if(opts->overflow == OVERFLOW_SATURATE)
+                    fprintf(out, "%s = %s + %dLL > CELL_MAX ? CELL_MAX : (cell)(%s + %d);\n", cell, cell, in->a, cell, in->a);
+                else{
+                    fprintf(out, "if(%s + %dLL > CELL_MAX) return fail(", cell, in->a);
+                    putString(out, errorMessage(ERR_ADD_OVERFLOW));
+                    fprintf(out, "); %s = (cell)(%s + %d);\n", cell, cell, in->a);
+                }
+                break;
+            case OP_SUB:
+                if(opts->overflow == OVERFLOW_WRAP || (opts->overflow == OVERFLOW_ERROR && (in->flags & F_SAFE)))
+                    fprintf(out, "%s = (cell)((ucell)%s - %uu);\n", cell, cell, (unsigned)in->a);
+                else if(opts->overflow == OVERFLOW_SATURATE)
+                    fprintf(out, "%s = %s - %dLL < 0 ? 0 : (cell)(%s - %d);\n", cell, cell, in->a, cell, in->a);
+                else{
+                    fprintf(out, "if(%s - %dLL < 0) return fail(", cell, in->a);
+                    putString(out, errorMessage(ERR_SUB_OVERFLOW));
+                    fprintf(out, "); %s = (cell)(%s - %d);\n", cell, cell, in->a);
+                }
+                break;
+            case OP_LOOP:                              // Shaped by the plan of a recorded run, if there is one
+                if(opts->plan != NULL && (opts->plan[i] & PLAN_COLD))
+                    fprintf(out, "while(__builtin_expect(*p != 0, 0)){\n");
+                else if(opts->plan != NULL && (opts->plan[i] & PLAN_UNROLL) > 1){
+                    fprintf(out, "#pragma GCC unroll %d\n", opts->plan[i] & PLAN_UNROLL);
+                    indent(out, depth);
+                    fprintf(out, "while(*p){\n");
+                }
+                else
+                    fprintf(out, "while(*p){\n");
+                ++depth;
+                break;
+            case OP_CLEAR:
+                fprintf(out, "%s = 0;\n", cell);
+                break;
+            case OP_MUL_LOOP:                          // Guards the fused instructions up to the original loop at a
+                if(checked && !(in->flags & F_SAFE))
+                    fprintf(out, "if(*p && p - memory >= %d && p - memory <= CELLS - 1 - %d){\n", -in->off, in->b);
+                else
+                    fprintf(out, "if(*p){\n");
+                ++closes[in->a];
+                ++depth;
+                break;
+            case OP_MUL:
+                fprintf(out, "p[%d] = (cell)((ucell)p[%d] + (ucell)*p * %uu);\n", in->off, in->off, (unsigned)in->a);
+                break;
+            case OP_SCAN:                              // memchr()/memrchr() for byte cells on a stride of 1, the original loop otherwise
+                if(width == 1 && (in->a == 1 || in->a == -1)){
+                    fprintf(out, "if(*p){ char *z = %s; if(!z) return fail(",
+                            in->a > 0 ? "memchr(p, 0, memory + CELLS - p)" : "memrchr(memory, 0, p - memory + 1)");
+                    putString(out, errorMessage(in->a > 0 ? ERR_SHIFT_RIGHT : ERR_SHIFT_LEFT));
+                    if(limited)                        // Every cell passed is a step
+                        fprintf(out, "); fuel -= %s; p = z; if(fuel < 0 && charge()) return %d; }\n",
+                                in->a > 0 ? "z - p" : "p - z", EXIT_LIMIT);
+                    else
+                        fprintf(out, "); p = z; }\n");
+                    break;
+                }
+                if(limited)
+                    fprintf(out, "{ cell *s = p; ");
+                if(in->a > 0)
+                    fprintf(out, "while(*p){ if(p - memory > CELLS - 1 - %d) return fail(", in->a);
+                else
+                    fprintf(out, "while(*p){ if(p - memory < %d) return fail(", -in->a);
+                putString(out, errorMessage(in->a > 0 ? ERR_SHIFT_RIGHT : ERR_SHIFT_LEFT));
+                fprintf(out, "); p += %d; }", in->a);
+                if(limited)
+                    fprintf(out, " if((fuel -= %s) < 0 && charge()) return %d; }", in->a > 0 ? "p - s" : "s - p", EXIT_LIMIT);
+                fprintf(out, "\n");
+                break;
+            case OP_BLOCK:                             // The original code at a where the block doesn't fit
+                fprintf(out, "if(p - memory < %d || p - memory > CELLS - 1 - %d) goto i%d;\n", -in->off, in->b, in->a);
+                break;
+            case OP_JUMP:
+                fprintf(out, "goto i%d;\n", in->a);
+                break;
+            case OP_ERROR:{
+                char message[128];
+                snprintf(message, sizeof(message), errorMessage(in->a), (char)in->b);
+                fprintf(out, "return fail(");
+                putString(out, message);
+                fprintf(out, ");\n");
+                break;
+            }
+            default:                                   // OP_HALT
+                fprintf(out, "return 0;\n");
+                break;
+        }
+    }
+    fprintf(out, "}\n");
+
+    free(closes);
+    free(labels);
+    return ferror(out) ? -1 : 0;
+}
+
+int buildNative(const Instr *code, const Options *opts, const char *output){ // Build a standalone executable (or just the C if output ends in ".c")
+    char source[] = "/tmp/scrintXXXXXX";               // Temporary C file handed to the compiler
+    const char *cc = getenv("CC");                     // Compiler to use, gcc unless overridden
+    size_t output_len = strlen(output);
+    FILE *out = NULL;
+    int fd = -1;
+    int status = 0;
+    pid_t pid = 0;
+
+    if(output_len > 2 && strcmp(output + output_len - 2, ".c") == 0){
+        if((out = fopen(output, "w")) == NULL){
+            fprintf(stderr, "%sError:%s Cannot write %s!\n", RED, RESET, output);
+            return -1;
+        }
+        status = emitC(code, opts, out);
+        if(fclose(out) != 0 || status != 0){
+            fprintf(stderr, "%sError:%s Failed to write %s!\n", RED, RESET, output);
+            return -1;
+        }
+        return 0;
+    }
+
+    if((fd = mkstemp(source)) == -1 || (out = fdopen(fd, "w")) == NULL){
+        fprintf(stderr, "%sError:%s Cannot create a temporary file for the generated C code!\n", RED, RESET);
+        if(fd != -1){
+            close(fd);
+            unlink(source);
+        }
+        return -1;
+    }
+    status = emitC(code, opts, out);
+    if(fclose(out) != 0 || status != 0){
+        fprintf(stderr, "%sError:%s Failed to write the generated C code!\n", RED, RESET);
+        unlink(source);
+        return -1;
+    }
+
+    if(cc == NULL || *cc == '\0')
+        cc = "gcc";
+    pid = fork();
+    if(pid == 0){                                      // Child: gcc -O2 -x c -o output source
+        execlp(cc, cc, "-O2", "-x", "c", "-o", output, source, (char *)NULL);
+        fprintf(stderr, "%sError:%s Cannot run %s!\n", RED, RESET, cc);
+        _exit(127);
+    }
+    if(pid == -1 || waitpid(pid, &status, 0) == -1){
+        fprintf(stderr, "%sError:%s Cannot run %s!\n", RED, RESET, cc);
+        unlink(source);
+        return -1;
+    }
+    unlink(source);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 127)
+            fprintf(stderr, "%sError:%s %s failed to build %s!\n", RED, RESET, cc, output);
+        return -1;
+    }
+    return 0;
+}
+
+static void indent(FILE *out, int depth){
+    for(int i = 0; i < depth; ++i)
+        fputs("    ", out);
+}
+
+static void putBytes(FILE *out, const unsigned char *bytes, size_t n){    // Quote n bytes as a C string literal, 64 to a line
+    fputc('"', out);
+    for(size_t i = 0; i < n; ++i){
+        if(i > 0 && i % 64 == 0)
+            fprintf(out, "\"\n        \"");
+        if(bytes[i] == '"' || bytes[i] == '\\')
+            fprintf(out, "\\%c", bytes[i]);
+        else if(bytes[i] >= ' ' && bytes[i] <= '~' && bytes[i] != '?')    // '?' could start a trigraph
+            fputc(bytes[i], out);
+        else
+            fprintf(out, "\\%03o", bytes[i]);
+    }
+    fputc('"', out);
+}
+
+static void putString(FILE *out, const char *text){    // Quote text as a C string literal
+    fputc('"', out);
+    for(; *text != '\0'; ++text){
+        if(*text == '"' || *text == '\\')
+            fputc('\\', out);
+        fputc(*text, out);
+    }
+    fputc('"', out);
+}
@@ -0,0 +1,320 @@
+//
+//  engine.h
+//
+//  Screw Interpreter
+//
+//  Body of an interpreter engine. run.c includes this file once per engine,
+//  defining first:
+//
+//  ENGINE_NAME : Name of the engine function
+//  THREADED    : 1 for direct-threaded dispatch (GCC labels as values), where
+//                every instruction is pre-decoded into the address of its
+//                handler and each handler jumps straight to the next one;
+//                0 for a portable switch
+//  PROFILE     : 1 to count what the program does into the Profile passed in
+//                (--profile); with 0 the hooks compile to nothing
+//  ON_OVERFLOW : What 'A' and 'S' do past 0 or CELL_MAX: 0 raises the error,
+//                1 wraps, 2 saturates (OVERFLOW_* in that order)
+//  CHECK_MOVES : 1 to check that every move stays on the tape, 0 for trusted
+//                code (--tape=unchecked)
+//  COUNT_STEPS : 1 to count steps for --max-steps and --timeout, 0 for runs
+//                without limits
+//  SAMPLE      : 1 to keep budget->sampler->ip on the instruction about to
+//                run, for the SIGPROF handler of --sample to read
+//
+//  and, for every engine over one kind of cell, CELL (the cell type), UCELL
+//  (the same without a sign), CELL_MAX (largest value 'A' may reach) and
+//  CELL_BYTE (1 if a cell is a byte, so the tape can be copied out as is).
+//
+//  The threaded engine runs the moves compile() flagged F_PROBED without a
+//  check when the tape has a guard on that side; run() catches the fault.
+//  It also drops the checks proveChecks() flagged F_SAFE, and those of the
+//  moves flagged F_COVERED, whose OP_BLOCK checked where they land. The
+//  switch engine runs every check, as the plain reference the others are
+//  measured against.
+//
+//  The run starts at instruction budget->at with the cursor on cell
+//  tape->cursor, which are 0 unless it goes on from a Snapshot.
+//
+//  Steps are counted down from the fuel the Budget grants, only where a loop
+//  goes round: b steps at a taken OP_END and a step for every cell an
+//  OP_SCAN passes. Once the fuel is spent, chargeBudget() decides whether the
+//  run goes on, and takes a checkpoint if one is due; the cursor it is given
+//  is where the loop goes round from, or where the scan stopped.
+//
+//  The engine returns 0, a runtime error with the offending symbol in
+//  bits 8-15 (the same way jitRun()'s generated code does), or -1 if it
+//  could not start.
+//
+
+#if PROFILE
+#define PROFILED(statement) do { statement; } while(0)
+#else
+#define PROFILED(statement) do { } while(0)
+#endif
+#if SAMPLE
+#define SAMPLED(statement) do { statement; } while(0)
+#else
+#define SAMPLED(statement) do { } while(0)
+#endif
+
+#if THREADED
+#define IP_T Thread
+#define OP(name) L_##name                              // Label of the handler for OP_name
+#define DISPATCH() do { PROFILED(++prof->counts[ip - code]); SAMPLED(sampler->ip = ip); goto *ip->handler; } while(0)
+#else
+#define IP_T const Instr
+#define OP(name) case OP_##name
+#define DISPATCH() goto dispatch
+#endif
+
+#define NEXT() do { ++ip; DISPATCH(); } while(0)       // Run the next instruction
+#define JUMP(i) do { ip = code + (i); DISPATCH(); } while(0) // Run instruction i next
+#define FAIL(error) do { result = (error); goto done; } while(0)
+#define HERE data_ptr[ip->off]                         // Cell the instruction works on: the current one, or one in a block
+#if COUNT_STEPS
+#define CHARGE(steps) do { if((fuel -= (steps)) < 0 && (result = chargeBudget(budget, &fuel, (int)(ip - code), data_ptr - memory)) != 0) goto done; } while(0)
+#else
+#define CHARGE(steps) do { (void)(steps); } while(0)
+#endif
+
+static int ENGINE_NAME(const Instr *program, Tape *tape, Output *out, Profile *prof, Budget *budget){
+    CELL *memory = (CELL *)tape->cells;                // First cell
+    CELL *last = memory + tape->size - 1;              // Last cell
+    CELL *data_ptr = memory + tape->cursor;            // Cursor for modifying the memory cells
+    int result = 0;                                    // What the program ended with
+#if COUNT_STEPS
+    long long fuel = budget->granted;                  // Steps left before the budget is charged
+#else
+    (void)budget;                                      // No limits to count steps against
+#endif
+#if !PROFILE
+    (void)prof;                                        // Only the profiling engine counts
+#endif
+#if SAMPLE
+    Sampler *sampler = budget->sampler;                // Where the instruction about to run is kept
+#endif
+#if THREADED
+    static const void *const handlers[] = {            // Handler of every operation, indexed by OP_*
+        [OP_HALT] = &&L_HALT, [OP_MOVE] = &&L_MOVE, [OP_INC] = &&L_INC, [OP_OUT] = &&L_OUT,
+        [OP_IN] = &&L_IN, [OP_DUMP] = &&L_DUMP, [OP_ADD] = &&L_ADD, [OP_SUB] = &&L_SUB,
+        [OP_LOOP] = &&L_LOOP, [OP_END] = &&L_END, [OP_CLEAR] = &&L_CLEAR,
+        [OP_MUL_LOOP] = &&L_MUL_LOOP, [OP_MUL] = &&L_MUL, [OP_SCAN] = &&L_SCAN, [OP_BLOCK] = &&L_BLOCK,
+        [OP_JUMP] = &&L_JUMP, [OP_ERROR] = &&L_ERROR
+    };
+    Thread *code = NULL;                               // The pre-decoded program
+    int count = 1;                                     // Number of instructions, OP_HALT included
+
+    while(program[count - 1].op != OP_HALT)
+        ++count;
+    if((code = (Thread *)malloc(count * sizeof(Thread))) == NULL)
+        return -1;
+    decoded = code;                                    // For run() to free if a fault skips the end
+    for(int i = 0; i < count; ++i){
+        code[i].handler = handlers[program[i].op];
+        if(program[i].op == OP_MOVE && CHECK_MOVES && ((program[i].flags & (F_SAFE | F_COVERED)) || ((program[i].flags & F_PROBED)
+           && (program[i].a > 0 ? tape->exact_right : tape->exact_left))))
+            code[i].handler = &&L_MOVE_UNCHECKED;      // Proven or checked to stay on the tape, or the guard page checks it
+#if ON_OVERFLOW == 0
+        if(program[i].op == OP_ADD && (program[i].flags & F_SAFE))
+            code[i].handler = &&L_ADD_SAFE;
+        if(program[i].op == OP_SUB && (program[i].flags & F_SAFE))
+            code[i].handler = &&L_SUB_SAFE;
+#endif
+#if CHECK_MOVES
+        if(program[i].op == OP_MUL_LOOP && (program[i].flags & F_SAFE))
+            code[i].handler = &&L_MUL_LOOP_SAFE;
+        if(program[i].op == OP_BLOCK && (program[i].flags & F_SAFE))
+            code[i].handler = &&L_BLOCK_SAFE;
+#endif
+        code[i].off = program[i].off;
+        code[i].a = program[i].a;
+        code[i].b = program[i].b;
+    }
+    for(int i = 0; i < count; ++i)                     // Loops go round straight into the code of a block with nothing to check
+        if((program[i].op == OP_END || program[i].op == OP_LOOP) && program[code[i].a].op == OP_BLOCK
+           && (!CHECK_MOVES || (program[code[i].a].flags & F_SAFE)))
+            ++code[i].a;
+#else
+    const Instr *code = program;
+#endif
+    IP_T *ip = code + budget->at;                      // Cursor to read the instructions
+#if SAMPLE
+    sampler->code = code;                              // What the handler measures ip against
+    sampler->stride = sizeof(*code);
+#endif
+
+#if THREADED
+    DISPATCH();
+#else
+dispatch:
+    PROFILED(++prof->counts[ip - code]);
+    SAMPLED(sampler->ip = ip);
+    switch(ip->op){
+#endif
+    OP(MOVE):                                          // Shift cursor a cells, stopping at either end of the tape
+#if CHECK_MOVES
+        if(ip->a > last - data_ptr)
+            FAIL(ERR_SHIFT_RIGHT);
+        if(ip->a < memory - data_ptr)
+            FAIL(ERR_SHIFT_LEFT);
+#endif
+        data_ptr += ip->a;
+        PROFILED(if(data_ptr - memory > prof->high) prof->high = data_ptr - memory);
+        NEXT();
+#if THREADED
+    L_MOVE_UNCHECKED:                                  // Shift cursor a cells; it stays on the tape, or the next instruction faults
+        data_ptr += ip->a;
+        NEXT();
+#endif
+    OP(INC):                                           // Add to value in cell
+        HERE = (CELL)((UCELL)HERE + (UCELL)ip->a);
+        NEXT();
+    OP(OUT):                                           // Output cell contents
+        putOutput(out, HERE);
+        PROFILED(++prof->out_bytes);
+        NEXT();
+    OP(IN):                                            // Input char
+        HERE = (CELL)readInput(out, HERE);
+        PROFILED(++prof->in_bytes);
+        NEXT();
+    OP(DUMP):                                          // Dump cells a through b, wipe them and leave the cursor on cell a
+        if(ip->b > last - memory)                      // Past the end of the tape
+            FAIL(ERR_DUMP_RANGE);
+        data_ptr = memory + ip->a;
+#if CELL_BYTE
+        writeOutput(out, data_ptr, ip->b - ip->a + 1);  // One copy out of the tape,
+#else
+        for(int i = 0; i <= ip->b - ip->a; ++i)        // The low byte of every cell
+            putOutput(out, (char)data_ptr[i]);
+#endif
+        memset(data_ptr, 0, (ip->b - ip->a + 1) * sizeof(CELL));    // one clear
+        PROFILED(prof->dump_bytes += ip->b - ip->a + 1; if(ip->b > prof->high) prof->high = ip->b);
+        NEXT();
+    OP(ADD):                                           // Add value to current cell
+#if ON_OVERFLOW == 0
+        if(HERE + (long long)ip->a > CELL_MAX)         // Check to make sure the result stays within the ASCII table (or cell)
+            FAIL(ERR_ADD_OVERFLOW);
+        HERE = (CELL)(HERE + ip->a);
+#elif ON_OVERFLOW == 1
+        HERE = (CELL)((UCELL)HERE + (UCELL)ip->a);
+#else
+        HERE = HERE + (long long)ip->a > CELL_MAX ? CELL_MAX : (CELL)(HERE + ip->a);
+#endif
+        NEXT();
+#if THREADED && ON_OVERFLOW == 0
+    L_ADD_SAFE:                                        // Add value to current cell, which can't overflow
+        HERE = (CELL)(HERE + ip->a);
+        NEXT();
+    L_SUB_SAFE:                                        // Sub value from the current cell, which can't go below 0
+        HERE = (CELL)(HERE - ip->a);
+        NEXT();
+#endif
+    OP(SUB):                                           // Sub value from the current cell
+#if ON_OVERFLOW == 0
+        if(HERE - (long long)ip->a < 0)                // Check to make sure the result stays within the ASCII table (or cell)
+            FAIL(ERR_SUB_OVERFLOW);
+        HERE = (CELL)(HERE - ip->a);
+#elif ON_OVERFLOW == 1
+        HERE = (CELL)((UCELL)HERE - (UCELL)ip->a);
+#else
+        HERE = HERE - (long long)ip->a < 0 ? 0 : (CELL)(HERE - ip->a);
+#endif
+        NEXT();
+    OP(LOOP):                                          // Skip past the loop if the current cell is 0
+        if(!*data_ptr){
+            PROFILED(++prof->skipped[ip - code]);
+            JUMP(ip->a);
+        }
+        NEXT();
+    OP(END):                                           // Go back to the start of the loop if the current cell is not 0
+        if(*data_ptr){
+            CHARGE(ip->b);
+            JUMP(ip->a);
+        }
+        NEXT();
+
+    OP(CLEAR):                                         // Zero the current cell
+        HERE = 0;
+        NEXT();
+    OP(MUL_LOOP):                                      // Run the original loop instead if there is nothing to do, or
+        if(!*data_ptr || (CHECK_MOVES && (ip->off < memory - data_ptr || ip->b > last - data_ptr))) // it would shift off the tape
+            JUMP(ip->a);
+        PROFILED(prof->passes[ip - code] += (UCELL)*data_ptr;
+                 if(data_ptr - memory + ip->b > prof->high) prof->high = data_ptr - memory + ip->b);
+        NEXT();
+#if THREADED && CHECK_MOVES
+    L_MUL_LOOP_SAFE:                                   // The same where the body is known to stay on the tape
+        if(!*data_ptr)
+            JUMP(ip->a);
+        NEXT();
+#endif
+    OP(MUL):                                           // Add the current cell times a to another cell, in unsigned int as a short would become int
+        data_ptr[ip->off] = (CELL)(UCELL)((UCELL)data_ptr[ip->off] + (UCELL)*data_ptr * (unsigned)ip->a);
+        NEXT();
+    OP(SCAN):                                          // Shift cursor a cells at a time until it is on a 0, stopping at either end of the tape
+        if(*data_ptr){
+#if CELL_BYTE
+            CELL *zero = ip->a > 0 ? scanRight(data_ptr, last, ip->a) : scanLeft(data_ptr, memory, -ip->a);
+#else
+            CELL *zero = data_ptr;
+            while(zero != NULL && *zero)               // One cell at a time, staying on the tape
+                zero = (ip->a > 0 ? ip->a <= last - zero : ip->a >= memory - zero) ? zero + ip->a : NULL;
+#endif
+            if(zero == NULL){                          // The shift after the last cell on the stride fails
+                PROFILED(if(ip->a > 0 && last - memory - (last - data_ptr) % ip->a > prof->high)
+                             prof->high = last - memory - (last - data_ptr) % ip->a);
+                FAIL(ip->a > 0 ? ERR_SHIFT_RIGHT : ERR_SHIFT_LEFT);
+            }
+            long passed = ip->a > 0 ? zero - data_ptr : data_ptr - zero;
+            data_ptr = zero;
+            CHARGE(passed);                            // Every cell passed is a step, charged from where the scan stopped
+            PROFILED(if(data_ptr - memory > prof->high) prof->high = data_ptr - memory);
+        }
+        NEXT();
+    OP(BLOCK):                                         // Run the offset-addressed code next if cells off through b are on
+#if CHECK_MOVES                                        // the tape, otherwise the original code at a, which shifts off it
+        if(ip->off < memory - data_ptr || ip->b > last - data_ptr)
+            JUMP(ip->a);
+#endif
+        PROFILED(if(data_ptr - memory + ip->b > prof->high) prof->high = data_ptr - memory + ip->b);
+        NEXT();
+#if THREADED && CHECK_MOVES
+    L_BLOCK_SAFE:                                      // The same where the cells are known to be on the tape
+        NEXT();
+#endif
+    OP(JUMP):                                          // Go on at instruction a
+        JUMP(ip->a);
+    OP(ERROR):                                         // Malformed instruction found during compilation
+        FAIL(ip->a | (ip->b & 0xff) << 8);
+    OP(HALT):                                          // Terminating character reached
+        goto done;
+#if !THREADED
+    }
+#endif
+
+done:
+#if THREADED
+    free(code);
+    decoded = NULL;
+#endif
+    return result;
+}
+
+#undef PROFILED
+#undef SAMPLED
+#undef IP_T
+#undef OP
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef FAIL
+#undef HERE
+#undef CHARGE
+#undef ENGINE_NAME
+#undef THREADED
+#undef PROFILE
+#undef ON_OVERFLOW
+#undef CHECK_MOVES
+#undef COUNT_STEPS
+#undef SAMPLE
@@ -0,0 +1,241 @@
+//
+//  engines.h
+//
+//  Screw Interpreter
+//
+//  Every engine over one kind of cell: run.c includes this file once per cell
+//  width, with CELL, UCELL, CELL_MAX, CELL_BYTE and CELL_BITS defined, and
+//  gets a switch and a threaded engine for every overflow policy with and
+//  without move checks, a threaded one that also counts steps (runLimited,
+//  for --max-steps and --timeout), and a profiling engine and a sampled one
+//  (runSampled, for --sample, threaded where it can be) that are always
+//  checked, for every overflow policy. The switch, profiling and sampled
+//  engines always count.
+//  ENGINE_ID() names them, e.g. runThreaded8_01 is the threaded engine over
+//  bytes that raises overflow errors and checks moves.
+//
+
+#define ENGINE_NAME ENGINE_ID(runSwitch, 0, 1)
+#define THREADED 0
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 0
+#define CHECK_MOVES 1
+#define COUNT_STEPS 1
+#include "engine.h"
+#if defined(__GNUC__)
+#define ENGINE_NAME ENGINE_ID(runThreaded, 0, 1)
+#define THREADED 1
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 0
+#define CHECK_MOVES 1
+#define COUNT_STEPS 0
+#include "engine.h"
+#define ENGINE_NAME ENGINE_ID(runLimited, 0, 1)
+#define THREADED 1
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 0
+#define CHECK_MOVES 1
+#define COUNT_STEPS 1
+#include "engine.h"
+#endif
+
+#define ENGINE_NAME ENGINE_ID(runSwitch, 0, 0)
+#define THREADED 0
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 0
+#define CHECK_MOVES 0
+#define COUNT_STEPS 1
+#include "engine.h"
+#if defined(__GNUC__)
+#define ENGINE_NAME ENGINE_ID(runThreaded, 0, 0)
+#define THREADED 1
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 0
+#define CHECK_MOVES 0
+#define COUNT_STEPS 0
+#include "engine.h"
+#define ENGINE_NAME ENGINE_ID(runLimited, 0, 0)
+#define THREADED 1
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 0
+#define CHECK_MOVES 0
+#define COUNT_STEPS 1
+#include "engine.h"
+#endif
+
+#define ENGINE_NAME ENGINE_ID(runProfiled, 0, 1)
+#define THREADED 0
+#define PROFILE 1
+#define SAMPLE 0
+#define ON_OVERFLOW 0
+#define CHECK_MOVES 1
+#define COUNT_STEPS 1
+#include "engine.h"
+#define ENGINE_NAME ENGINE_ID(runSampled, 0, 1)
+#if defined(__GNUC__)
+#define THREADED 1
+#else
+#define THREADED 0
+#endif
+#define PROFILE 0
+#define SAMPLE 1
+#define ON_OVERFLOW 0
+#define CHECK_MOVES 1
+#define COUNT_STEPS 1
+#include "engine.h"
+
+#define ENGINE_NAME ENGINE_ID(runSwitch, 1, 1)
+#define THREADED 0
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 1
+#define CHECK_MOVES 1
+#define COUNT_STEPS 1
+#include "engine.h"
+#if defined(__GNUC__)
+#define ENGINE_NAME ENGINE_ID(runThreaded, 1, 1)
+#define THREADED 1
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 1
+#define CHECK_MOVES 1
+#define COUNT_STEPS 0
+#include "engine.h"
+#define ENGINE_NAME ENGINE_ID(runLimited, 1, 1)
+#define THREADED 1
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 1
+#define CHECK_MOVES 1
+#define COUNT_STEPS 1
+#include "engine.h"
+#endif
+
+#define ENGINE_NAME ENGINE_ID(runSwitch, 1, 0)
+#define THREADED 0
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 1
+#define CHECK_MOVES 0
+#define COUNT_STEPS 1
+#include "engine.h"
+#if defined(__GNUC__)
+#define ENGINE_NAME ENGINE_ID(runThreaded, 1, 0)
+#define THREADED 1
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 1
+#define CHECK_MOVES 0
+#define COUNT_STEPS 0
+#include "engine.h"
+#define ENGINE_NAME ENGINE_ID(runLimited, 1, 0)
+#define THREADED 1
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 1
+#define CHECK_MOVES 0
+#define COUNT_STEPS 1
+#include "engine.h"
+#endif
+
+#define ENGINE_NAME ENGINE_ID(runProfiled, 1, 1)
+#define THREADED 0
+#define PROFILE 1
+#define SAMPLE 0
+#define ON_OVERFLOW 1
+#define CHECK_MOVES 1
+#define COUNT_STEPS 1
+#include "engine.h"
+#define ENGINE_NAME ENGINE_ID(runSampled, 1, 1)
+#if defined(__GNUC__)
+#define THREADED 1
+#else
+#define THREADED 0
+#endif
+#define PROFILE 0
+#define SAMPLE 1
+#define ON_OVERFLOW 1
+#define CHECK_MOVES 1
+#define COUNT_STEPS 1
+#include "engine.h"
+
+#define ENGINE_NAME ENGINE_ID(runSwitch, 2, 1)
+#define THREADED 0
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 2
+#define CHECK_MOVES 1
+#define COUNT_STEPS 1
+#include "engine.h"
+#if defined(__GNUC__)
+#define ENGINE_NAME ENGINE_ID(runThreaded, 2, 1)
+#define THREADED 1
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 2
+#define CHECK_MOVES 1
+#define COUNT_STEPS 0
+#include "engine.h"
+#define ENGINE_NAME ENGINE_ID(runLimited, 2, 1)
+#define THREADED 1
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 2
+#define CHECK_MOVES 1
+#define COUNT_STEPS 1
+#include "engine.h"
+#endif
+
+#define ENGINE_NAME ENGINE_ID(runSwitch, 2, 0)
+#define THREADED 0
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 2
+#define CHECK_MOVES 0
+#define COUNT_STEPS 1
+#include "engine.h"
+#if defined(__GNUC__)
+#define ENGINE_NAME ENGINE_ID(runThreaded, 2, 0)
+#define THREADED 1
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 2
+#define CHECK_MOVES 0
+#define COUNT_STEPS 0
+#include "engine.h"
+#define ENGINE_NAME ENGINE_ID(runLimited, 2, 0)
+#define THREADED 1
+#define PROFILE 0
+#define SAMPLE 0
+#define ON_OVERFLOW 2
+#define CHECK_MOVES 0
+#define COUNT_STEPS 1
+#include "engine.h"
+#endif
+
+#define ENGINE_NAME ENGINE_ID(runProfiled, 2, 1)
+#define THREADED 0
+#define PROFILE 1
+#define SAMPLE 0
+#define ON_OVERFLOW 2
+#define CHECK_MOVES 1
+#define COUNT_STEPS 1
+#include "engine.h"
+#define ENGINE_NAME ENGINE_ID(runSampled, 2, 1)
+#if defined(__GNUC__)
+#define THREADED 1
+#else
+#define THREADED 0
+#endif
+#define PROFILE 0
+#define SAMPLE 1
+#define ON_OVERFLOW 2
+#define CHECK_MOVES 1
+#define COUNT_STEPS 1
+#include "engine.h"
@@ -0,0 +1,157 @@
+//
+//  io.c
+//
+//  Screw Interpreter
+//
+//  Program output is collected in a buffer owned by the runtime and written
+//  with as few write() calls as the flush mode allows. Input is read the
+//  same way, a buffer at a time, or straight out of memory given whole
+//  (--input maps a file). Batch jobs capture their output in memory instead
+//  and read their input from memory, and libscrint hands both to the
+//  caller's callbacks.
+//
+
+#include <stdio.h>
+#include <stdlib.h>         // For realloc()
+#include <string.h>         // For memcpy(), memchr()
+#include <unistd.h>         // For read(), write()
+#include <errno.h>          // For errno, EINTR
+#include "screw.h"
+
+static void writeAll(int, const unsigned char *, size_t);  // write() until everything is out
+static void sink(Output *, const unsigned char *, size_t); // Send bytes to the fd or the capture
+
+void initOutput(Output *out, int fd, int mode){        // Start buffering output for fd
+    out->len = 0;
+    out->fd = fd;
+    out->mode = mode;
+    out->capture = NULL;
+    out->captured = out->capture_cap = 0;
+    out->input = NULL;
+    out->input_len = out->input_pos = 0;
+    out->input_base = 0;
+    out->in_fd = STDIN_FILENO;
+    out->eof = EOF_MINUS1;
+    out->put = NULL;
+    out->get = NULL;
+    out->user = NULL;
+    out->written = 0;
+}
+
+void captureOutput(Output *out, const void *input, size_t input_len){ // Keep output in memory and read input from memory
+    out->fd = -1;
+    out->mode = FLUSH_FULL;                            // Nobody is watching
+    feedInput(out, input, input_len);
+}
+
+void feedInput(Output *out, const void *input, size_t input_len){  // Read input from memory, ending where it does
+    out->input = (const unsigned char *)input;
+    out->input_len = input_len;
+    out->input_pos = 0;
+    out->input_base = 0;
+    out->in_fd = -1;
+}
+
+// Sends output to put (in blocks of up to OUTPUT_BUFFER bytes) and takes input from get,
+// both called with user.
+void hookOutput(Output *out, void (*put)(void *, const void *, size_t), int (*get)(void *), void *user){
+    out->put = put;
+    out->get = get;
+    out->user = user;
+    out->in_fd = -1;
+}
+
+void flushOutput(Output *out){                         // Write everything buffered so far
+    sink(out, out->buf, out->len);
+    out->len = 0;
+}
+
+void writeOutput(Output *out, const void *bytes, size_t n){ // Output a block of bytes
+    if(out->len + n > OUTPUT_BUFFER){                  // Too big to buffer, write it straight from where it is
+        flushOutput(out);
+        sink(out, (const unsigned char *)bytes, n);
+        return;
+    }
+    memcpy(out->buf + out->len, bytes, n);
+    out->len += n;
+    if(out->len == OUTPUT_BUFFER || (out->mode == FLUSH_LINE && memchr(bytes, '\n', n) != NULL))
+        flushOutput(out);
+}
+
+// Called by readInput() when everything buffered has been read: takes the next byte from the
+// callback, or refills the buffer with one read(). Output is flushed first unless the mode says
+// not to, since this is where the program may wait for its user. At the end of the input the
+// cell is set according to out->eof.
+int refillInput(Output *out, int cell){
+    int c = EOF;
+
+    if((out->get != NULL || out->in_fd >= 0) && out->mode != FLUSH_FULL && out->len > 0)
+        flushOutput(out);
+    if(out->get != NULL)
+        c = out->get(out->user);
+    else if(out->in_fd >= 0){
+        ssize_t got = 0;
+        while((got = read(out->in_fd, out->in_buf, INPUT_BUFFER)) < 0 && errno == EINTR)
+            ;
+        if(got > 0){
+            out->input_base += out->input_len;
+            out->input = out->in_buf;
+            out->input_len = (size_t)got;
+            out->input_pos = 1;
+            c = out->in_buf[0];
+        }
+        else
+            out->in_fd = -1;                           // Ended (or failed): don't wait on it again
+    }
+    if(c != EOF)
+        return c;
+    return out->eof == EOF_ZERO ? 0 : out->eof == EOF_KEEP ? cell : -1;
+}
+
+// Reads past the first n bytes of the input, which a run resumed from a checkpoint read
+// before it was stopped. Stops early if the input ends first.
+void skipInput(Output *out, unsigned long long n){
+    for(; n > 0; --n){
+        if(out->input_pos == out->input_len && out->in_fd < 0)
+            return;                                    // Ended (and callbacks only come from libscrint, which never resumes)
+        readInput(out, 0);
+    }
+}
+
+static void sink(Output *out, const unsigned char *b, size_t n){
+    out->written += n;
+    if(out->put != NULL){
+        if(n > 0)
+            out->put(out->user, b, n);
+        return;
+    }
+    if(out->fd >= 0){
+        writeAll(out->fd, b, n);
+        return;
+    }
+    if(out->captured + n > out->capture_cap){
+        size_t cap = out->capture_cap ? out->capture_cap : OUTPUT_BUFFER;
+        unsigned char *grown = NULL;
+        while(cap < out->captured + n)
+            cap *= 2;
+        if((grown = (unsigned char *)realloc(out->capture, cap)) == NULL)
+            return;                                    // Lost, like a failed write()
+        out->capture = grown;
+        out->capture_cap = cap;
+    }
+    memcpy(out->capture + out->captured, b, n);
+    out->captured += n;
+}
+
+static void writeAll(int fd, const unsigned char *b, size_t n){
+    while(n > 0){
+        ssize_t written = write(fd, b, n);
+        if(written < 0){
+            if(errno == EINTR)
+                continue;
+            return;                                    // Nowhere to report it; the output is lost like putchar() would lose it
+        }
+        b += written;
+        n -= (size_t)written;
+    }
+}
@@ -0,0 +1,639 @@
+//
+//  jit.c
+//
+//  Screw Interpreter
+//
+//  Translates a compiled screw program into x86-64 machine code and runs it.
+//  The cursor lives in rbx, the first cell in r12, the last cell in r13 and
+//  the runtime's output buffer in r14. Loops become real conditional jumps;
+//  I/O and cell dumps call back into C.
+//  The generated function returns 0, or a runtime error with the offending
+//  symbol in bits 8-15. On a guard tape, moves flagged F_PROBED skip their
+//  compare just like in the threaded interpreter, and on an unchecked tape
+//  every move does. Checks proveChecks() flagged F_SAFE are left out, and so
+//  are those of the moves flagged F_COVERED and of blocks on such a tape.
+//  Cells at an offset are addressed as [rbx + off]. A run that went part
+//  of the way at compile time (or was restored from a checkpoint) jumps
+//  straight to where it stopped. Under --max-steps, --timeout,
+//  --checkpoint-every or --stats-file, r15 holds the fuel the Budget granted: taken
+//  back-edges and scans count it down as the interpreter does and call
+//  chargeBudget() once it runs out; without them there is no counting code
+//  at all. Only byte cells are compiled; wider ones are left to the
+//  interpreter.
+//
+//  Under --profile-use, a loop the recorded run went round many times a
+//  visit gets copies of its body, run one after another with the cursor's
+//  moves folded into their offsets and a single check that every cell they
+//  reach is on the tape; near an end it goes one pass at a time as usual.
+//  Only bodies of moves and single-cell instructions are copied, and only
+//  when steps aren't counted. Loops the recorded run never entered have
+//  their bodies moved after the rest, so the code that does run sits
+//  together.
+//
+
+#include <stdio.h>
+#include <stdlib.h>         // For malloc(), realloc(), calloc() and free()
+#include <string.h>         // For memcpy(), memset()
+#include <unistd.h>         // For STDOUT_FILENO
+#include "screw.h"
+
+#if defined(__x86_64__) && !defined(_WIN32)
+
+#include <sys/mman.h>       // For mmap(), mprotect(), munmap()
+
+enum {                      // Jump targets that are not instructions
+    TO_RIGHT = -1,          // Raise ERR_SHIFT_RIGHT
+    TO_LEFT = -2,           // Raise ERR_SHIFT_LEFT
+    TO_ADD = -3,            // Raise ERR_ADD_OVERFLOW
+    TO_SUB = -4,            // Raise ERR_SUB_OVERFLOW
+    TO_EXIT = -5,           // Return with the error already in eax
+    TO_LIMIT = -6           // Return with the limit error negated in eax
+};
+
+typedef struct {            // A rel32 waiting for its target's address
+    size_t at;              // Where the rel32 is in the code
+    int target;             // Instruction index, TO_*, or count + 1 plus that of a loop with copies
+} Fixup;
+
+typedef struct {            // Machine code being generated
+    unsigned char *buf;     // Code emitted so far
+    size_t len;             // Bytes emitted
+    size_t cap;             // Bytes buf has room for
+    Fixup *fixups;          // Jumps to patch once every target is known
+    int nfixups;            // Number of fixups
+    int capfixups;          // Number of fixups there is room for
+    _Bool failed;           // True if memory ran out
+} Asm;
+
+static void put(Asm *, const void *, size_t);   // Append bytes
+static void put1(Asm *, int);                   // Append one byte
+static void put4(Asm *, int);                   // Append a 32-bit little endian value
+static void put8(Asm *, const void *);          // Append a 64-bit pointer
+static void jump(Asm *, int, int);              // Append a jump (opcode 0 is jmp) to an instruction or TO_* target
+static void callC(Asm *, void *);               // Append a call to a C function
+static void cellOp(Asm *, const char *, size_t, int);  // Append an instruction on the cell off away from the cursor
+static void cellInstr(Asm *, const Instr *, int, int); // Append an instruction on one cell, off away from the cursor
+static int layOut(const Instr *, int, const unsigned char *, int *);   // Order to emit the instructions in
+static _Bool unrollable(const Instr *, int, int, int *, int *, int *); // Whether a loop's body can be copied, and the cells the copies reach
+static void jitPut(Output *, int);              // '.' from generated code
+static int jitGet(Output *, int);               // '?' from generated code
+static void jitDump(Output *, char *, int, int);    // '*' from generated code
+static long long jitCharge(Budget *, long long, int, long);    // Spent fuel from generated code: the next grant, or the limit error negated
+static void charge(Asm *, Budget *, int);       // Append the call to jitCharge() once the fuel in r15 runs out at an instruction
+
+#define JE 0x84             // Second opcode byte of the conditional jumps used below
+#define JNE 0x85
+#define JB 0x82
+#define JA 0x87
+#define JL 0x8c
+#define JG 0x8f
+#define JS 0x88
+#define JGE 0x8d
+
+// Compiles to machine code and runs it, printing its runtime error. Returns 0 or that error,
+// with budget telling how far a stopped run got, or -1 if it can't be run this way.
+int jitRun(const Instr *code, const Options *opts, Budget *budget){
+    Asm as = { NULL, 0, 0, NULL, 0, 0, 0 };
+    size_t *where = NULL;                              // Address (offset) of every instruction
+    size_t *tops = NULL;                               // Address of the unrolled copies of every loop (0: none)
+    int *order = NULL;                                 // Instructions in the order they are emitted
+    int norder = 0;                                    // Entries in order
+    size_t stubs[6];                                   // Address of every TO_* target
+    _Bool limited = opts->max_steps != 0 || opts->timeout_ms != 0 || opts->checkpoint != NULL || opts->stats != NULL;  // Whether steps are counted
+    int count = 0;                                     // Number of instructions
+    unsigned char *exec = NULL;                        // Executable copy of the code
+    Tape tape;                                         // The memory cells
+    sigjmp_buf fault;                                  // Where a move off a guarded tape lands
+    Output *out = NULL;                                // Program output, written according to the flush mode
+    int result = 0;
+
+    if(opts->width != 1)
+        return -1;
+    while(code[count].op != OP_HALT)
+        ++count;
+    if(newTape(&tape, opts->cells, 1, opts->tape) != 0)
+        return -1;
+    where = (size_t *)malloc((count + 1) * sizeof(size_t));
+    tops = (size_t *)calloc(count + 1, sizeof(size_t));
+    order = (int *)malloc(2 * (count + 1) * sizeof(int));
+    if(where == NULL || tops == NULL || order == NULL){
+        free(where);
+        free(tops);
+        free(order);
+        freeTape(&tape);
+        return -1;
+    }
+    norder = layOut(code, count, opts->plan, order);
+
+    put(&as, "\x53\x41\x54\x41\x55\x41\x56\x41\x57", 9); // push rbx; push r12; push r13; push r14; push r15 (keeps calls 16-byte aligned)
+    put(&as, "\x48\x89\xfb\x49\x89\xfc", 6);          // mov rbx, rdi; mov r12, rdi
+    put(&as, "\x49\x89\xf6", 3);                      // mov r14, rsi
+    put(&as, "\x4c\x8d\xaf", 3);                      // lea r13, [rdi + cells - 1]
+    put4(&as, (int)(opts->cells - 1));
+    startBudget(budget, opts);
+    if(limited){
+        put(&as, "\x49\xbf", 2);                      // mov r15, granted
+        put8(&as, (void *)(size_t)budget->granted);
+    }
+    if(opts->start != NULL){                           // Go on from where the snapshot stopped
+        put(&as, "\x48\x81\xc3", 3);                  // add rbx, cursor
+        put4(&as, (int)opts->start->cursor);
+        jump(&as, 0, opts->start->at);
+    }
+
+    for(int n = 0; n < norder; ++n){
+        int i = order[n];
+        const Instr *in = &code[i < 0 ? 0 : i];
+        if(i < 0){                                     // The end of a body laid out of the way: back to after its loop
+            jump(&as, 0, -1 - i);
+            continue;
+        }
+        where[i] = as.len;
+        switch(in->op){
+            case OP_MOVE:
+                if(opts->tape == TAPE_UNCHECKED || (in->flags & (F_SAFE | F_COVERED))
+                   || ((in->flags & F_PROBED) && (in->a > 0 ? tape.exact_right : tape.exact_left))){
+                    put(&as, "\x48\x81\xc3", 3);      // add rbx, a (proven, or the guard page checks it)
+                    put4(&as, in->a);
+                    break;
+                }
+                put(&as, "\x48\x8d\x83", 3);          // lea rax, [rbx + a]
+                put4(&as, in->a);
+                if(in->a > 0){
+                    put(&as, "\x4c\x39\xe8", 3);      // cmp rax, r13
+                    jump(&as, JA, TO_RIGHT);
+                }
+                else{
+                    put(&as, "\x4c\x39\xe0", 3);      // cmp rax, r12
+                    jump(&as, JB, TO_LEFT);
+                }
+                put(&as, "\x48\x89\xc3", 3);          // mov rbx, rax
+                break;
+            case OP_INC: case OP_OUT: case OP_IN: case OP_ADD: case OP_SUB: case OP_CLEAR:
+                cellInstr(&as, in, in->off, opts->overflow);
+                break;
+            case OP_DUMP:
+                if(in->b > opts->cells - 1){           // Past the end of the tape, which is known by now
+                    put1(&as, 0xb8);                   // mov eax, ERR_DUMP_RANGE
+                    put4(&as, ERR_DUMP_RANGE);
+                    jump(&as, 0, TO_EXIT);
+                    break;
+                }
+                put(&as, "\x4c\x89\xf7\x4c\x89\xe6\xba", 7); // mov rdi, r14; mov rsi, r12; mov edx, a
+                put4(&as, in->a);
+                put1(&as, 0xb9);                       // mov ecx, b
+                put4(&as, in->b);
+                callC(&as, (void *)jitDump);
+                put(&as, "\x4c\x89\xe3\x48\x81\xc3", 6); // mov rbx, r12; add rbx, a
+                put4(&as, in->a);
+                break;
+            case OP_LOOP:{
+                int copies = opts->plan != NULL ? opts->plan[i] & PLAN_UNROLL : 0;
+                int step = 0, low = 0, high = 0;       // Cursor's move per pass, and the cells the copies reach
+                size_t exits[PLAN_UNROLL + 1];         // Where the rel32 leaving after each copy is
+                put(&as, "\x80\x3b\x00", 3);          // cmp byte [rbx], 0
+                if(n + 1 < norder && order[n + 1] != i + 1){   // Its body is out of the way
+                    jump(&as, JNE, i + 1);
+                    break;
+                }
+                jump(&as, JE, in->a);
+                if(copies < 2 || limited || !unrollable(code, i, copies, &step, &low, &high))
+                    break;
+                tops[i] = as.len;                      // Copies of the body, run while every cell they reach is on the tape
+                if(opts->tape != TAPE_UNCHECKED){
+                    put(&as, "\x48\x8d\x83", 3);      // lea rax, [rbx + low]
+                    put4(&as, low);
+                    put(&as, "\x4c\x39\xe0", 3);      // cmp rax, r12
+                    jump(&as, JB, i + 1);              // Near an end: one pass at a time, as it is
+                    put(&as, "\x48\x8d\x83", 3);      // lea rax, [rbx + high]
+                    put4(&as, high);
+                    put(&as, "\x4c\x39\xe8", 3);      // cmp rax, r13
+                    jump(&as, JA, i + 1);
+                }
+                for(int k = 0, pos = 0; k < copies; ++k, pos = 0){
+                    if(k > 0){
+                        cellOp(&as, "\x80\x3b", 2, k * step); // cmp byte [rbx + k * step], 0
+                        put1(&as, 0);
+                        put(&as, "\x0f\x84", 2);        // je rel32, to the exit after this many copies
+                        exits[k] = as.len;
+                        put4(&as, 0);
+                    }
+                    for(int j = i + 1; code[j].op != OP_END || code[j].a != i + 1; ++j){
+                        if(code[j].op == OP_MOVE)
+                            pos += code[j].a;
+                        else if(code[j].op != OP_BLOCK)    // The check above covers every block
+                            cellInstr(&as, &code[j], k * step + pos + code[j].off, opts->overflow);
+                    }
+                }
+                if(copies * step != 0){
+                    put(&as, "\x48\x81\xc3", 3);      // add rbx, copies * step
+                    put4(&as, copies * step);
+                }
+                put(&as, "\x80\x3b\x00", 3);          // cmp byte [rbx], 0
+                jump(&as, JNE, count + 1 + i);         // The copies again
+                jump(&as, 0, in->a);
+                for(int k = 1; k < copies; ++k){       // Stopped after k copies
+                    int rel = (int)(as.len - (exits[k] + 4));
+                    if(!as.failed)
+                        memcpy(as.buf + exits[k], &rel, 4);
+                    put(&as, "\x48\x81\xc3", 3);      // add rbx, k * step
+                    put4(&as, k * step);
+                    jump(&as, 0, in->a);
+                }
+                break;
+            }
+            case OP_END:
+                put(&as, "\x80\x3b\x00", 3);          // cmp byte [rbx], 0
+                if(!limited){
+                    jump(&as, JNE, tops[in->a - 1] != 0 ? count + 1 + in->a - 1 : in->a);  // Back into the copies if it has them
+                    break;
+                }
+                jump(&as, JE, i + 1);
+                put(&as, "\x49\x81\xef", 3);          // sub r15, b
+                put4(&as, in->b);
+                jump(&as, JGE, in->a);
+                charge(&as, budget, i);
+                jump(&as, 0, in->a);
+                break;
+            case OP_MUL_LOOP:
+                put(&as, "\x80\x3b\x00", 3);          // cmp byte [rbx], 0
+                jump(&as, JE, in->a);
+                if(opts->tape == TAPE_UNCHECKED || (in->flags & F_SAFE))
+                    break;
+                put(&as, "\x48\x8d\x83", 3);          // lea rax, [rbx + off]
+                put4(&as, in->off);
+                put(&as, "\x4c\x39\xe0", 3);          // cmp rax, r12
+                jump(&as, JB, in->a);
+                put(&as, "\x48\x8d\x83", 3);          // lea rax, [rbx + b]
+                put4(&as, in->b);
+                put(&as, "\x4c\x39\xe8", 3);          // cmp rax, r13
+                jump(&as, JA, in->a);
+                break;
+            case OP_MUL:
+                put(&as, "\x0f\xb6\x03\x69\xc0", 5);  // movzx eax, byte [rbx]; imul eax, eax, a
+                put4(&as, in->a);
+                put(&as, "\x00\x83", 2);              // add byte [rbx + off], al
+                put4(&as, in->off);
+                break;
+            case OP_SCAN:
+                put(&as, "\x80\x3b\x00", 3);          // cmp byte [rbx], 0
+                jump(&as, JE, i + 1);
+                put(&as, in->a > 0 ? "\x48\x89\xdf\x4c\x89\xee" : "\x48\x89\xdf\x4c\x89\xe6", 6); // mov rdi, rbx; mov rsi, r13 (r12 going left)
+                put1(&as, 0xba);                       // mov edx, stride
+                put4(&as, in->a > 0 ? in->a : -in->a);
+                callC(&as, in->a > 0 ? (void *)scanRight : (void *)scanLeft);
+                put(&as, "\x48\x85\xc0", 3);          // test rax, rax
+                jump(&as, JE, in->a > 0 ? TO_RIGHT : TO_LEFT);
+                if(limited){                           // Cells passed, each a step
+                    put(&as, in->a > 0 ? "\x48\x89\xc1\x48\x29\xd9" : "\x48\x89\xd9\x48\x29\xc1", 6); // mov rcx, rax; sub rcx, rbx (the other way going left)
+                    put(&as, "\x48\x89\xc3\x49\x29\xcf", 6); // mov rbx, rax; sub r15, rcx
+                    jump(&as, JGE, i + 1);
+                    charge(&as, budget, i);
+                    break;
+                }
+                put(&as, "\x48\x89\xc3", 3);          // mov rbx, rax
+                break;
+            case OP_BLOCK:
+                if(opts->tape == TAPE_UNCHECKED || (in->flags & F_SAFE))   // Nothing to check: straight on
+                    break;
+                put(&as, "\x48\x8d\x83", 3);          // lea rax, [rbx + off]
+                put4(&as, in->off);
+                put(&as, "\x4c\x39\xe0", 3);          // cmp rax, r12
+                jump(&as, JB, in->a);                  // Off the tape: the original code raises the error
+                put(&as, "\x48\x8d\x83", 3);          // lea rax, [rbx + b]
+                put4(&as, in->b);
+                put(&as, "\x4c\x39\xe8", 3);          // cmp rax, r13
+                jump(&as, JA, in->a);
+                break;
+            case OP_JUMP:
+                jump(&as, 0, in->a);
+                break;
+            case OP_ERROR:
+                put1(&as, 0xb8);                       // mov eax, error | symbol << 8
+                put4(&as, in->a | (in->b & 0xff) << 8);
+                jump(&as, 0, TO_EXIT);
+                break;
+            default:                                   // OP_HALT
+                put(&as, "\x31\xc0", 2);              // xor eax, eax
+                jump(&as, 0, TO_EXIT);
+                break;
+        }
+    }
+
+    for(int stub = 0; stub < 4; ++stub){               // TO_RIGHT, TO_LEFT, TO_ADD, TO_SUB
+        static const int errors[] = { ERR_SHIFT_RIGHT, ERR_SHIFT_LEFT, ERR_ADD_OVERFLOW, ERR_SUB_OVERFLOW };
+        stubs[stub] = as.len;
+        put1(&as, 0xb8);                               // mov eax, error
+        put4(&as, errors[stub]);
+        jump(&as, 0, TO_EXIT);
+    }
+    stubs[5] = as.len;                                 // TO_LIMIT
+    put(&as, "\xf7\xd8", 2);                          // neg eax
+    stubs[4] = as.len;                                 // TO_EXIT
+    put(&as, "\x41\x5f\x41\x5e\x41\x5d\x41\x5c\x5b\xc3", 10);  // pop r15; pop r14; pop r13; pop r12; pop rbx; ret
+
+    if(!as.failed){
+        for(int f = 0; f < as.nfixups; ++f){           // Point every jump at its target
+            int target = as.fixups[f].target;
+            size_t to = target > count ? tops[target - count - 1] : target >= 0 ? where[target] : stubs[-target - 1];
+            int rel = (int)(to - (as.fixups[f].at + 4));
+            memcpy(as.buf + as.fixups[f].at, &rel, 4);
+        }
+        exec = mmap(NULL, as.len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(exec == MAP_FAILED)
+            exec = NULL;
+        else{
+            memcpy(exec, as.buf, as.len);
+            if(mprotect(exec, as.len, PROT_READ | PROT_EXEC) != 0){ // Never writable and executable at once
+                munmap(exec, as.len);
+                exec = NULL;
+            }
+        }
+    }
+    free(as.buf);
+    free(as.fixups);
+    free(where);
+    free(tops);
+    free(order);
+    if(exec == NULL || (out = (Output *)malloc(sizeof(Output))) == NULL){
+        if(exec != NULL)
+            munmap(exec, as.len);
+        freeTape(&tape);
+        return -1;                                     // Let the interpreter run it instead
+    }
+
+    initOutput(out, STDOUT_FILENO, opts->flush);
+    if(opts->input != NULL)
+        feedInput(out, opts->input, opts->input_len);
+    out->eof = opts->eof;
+    if(opts->start != NULL)
+        resumeRun(opts->start, &tape, out);
+    if(opts->checkpoint != NULL){                      // What its checkpoints are taken of
+        opts->checkpoint->tape = &tape;
+        opts->checkpoint->out = out;
+    }
+    if(opts->stats != NULL){                           // What its reports are about
+        opts->stats->tape = &tape;
+        opts->stats->out = out;
+    }
+    if(tape.map == NULL)
+        result = ((int (*)(char *, Output *))exec)(tape.cells, out); // Run it
+    else if(sigsetjmp(fault, 1) != 0)                  // Stepped off the tape into a guard
+        result = tapeFault();
+    else{
+        armTape(&tape, &fault);
+        result = ((int (*)(char *, Output *))exec)(tape.cells, out); // Run it, catching faults in the guards
+        disarmTape();
+    }
+    flushOutput(out);                                  // Everything the program printed comes before its error
+    if(opts->stats != NULL)
+        writeStats(opts->stats, budget, 0);            // The last report says the run is over
+    if(result != 0)
+        runtimeError(result & 0xff, (char)(result >> 8));
+
+    munmap(exec, as.len);
+    freeTape(&tape);
+    free(out);
+    return result;
+}
+
+static void put(Asm *as, const void *bytes, size_t n){ // Append bytes, growing the buffer as needed
+    if(as->len + n > as->cap){
+        size_t cap = as->cap ? as->cap * 2 : 4096;
+        unsigned char *buf = NULL;
+        while(cap < as->len + n)
+            cap *= 2;
+        if((buf = (unsigned char *)realloc(as->buf, cap)) == NULL){
+            as->failed = 1;
+            return;
+        }
+        as->buf = buf;
+        as->cap = cap;
+    }
+    if(!as->failed){
+        memcpy(as->buf + as->len, bytes, n);
+        as->len += n;
+    }
+}
+
+static void put1(Asm *as, int byte){
+    unsigned char b = (unsigned char)byte;
+    put(as, &b, 1);
+}
+
+static void put4(Asm *as, int value){
+    unsigned char b[4] = { value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, (value >> 24) & 0xff };
+    put(as, b, 4);
+}
+
+static void put8(Asm *as, const void *pointer){
+    unsigned long long value = (unsigned long long)(size_t)pointer;
+    for(int i = 0; i < 8; ++i)
+        put1(as, (int)(value >> (8 * i)));
+}
+
+static void jump(Asm *as, int cc, int target){         // jmp/jcc rel32 to be patched later
+    if(as->nfixups == as->capfixups){
+        int cap = as->capfixups ? as->capfixups * 2 : 256;
+        Fixup *fixups = (Fixup *)realloc(as->fixups, cap * sizeof(Fixup));
+        if(fixups == NULL){
+            as->failed = 1;
+            return;
+        }
+        as->fixups = fixups;
+        as->capfixups = cap;
+    }
+    if(cc == 0)
+        put1(as, 0xe9);                                // jmp rel32
+    else{
+        put1(as, 0x0f);                                // jcc rel32
+        put1(as, cc);
+    }
+    as->fixups[as->nfixups].at = as->len;
+    as->fixups[as->nfixups++].target = target;
+    put4(as, 0);
+}
+
+static void callC(Asm *as, void *function){            // mov rax, function; call rax
+    put(as, "\x48\xb8", 2);
+    put8(as, function);
+    put(as, "\xff\xd0", 2);
+}
+
+// Lays out the instructions in the order they are emitted: as they are, except that the bodies
+// of the loops plan marks PLAN_COLD go after the rest, each followed by -1 minus the instruction
+// after its loop, which it jumps back to. Returns the number of entries in order.
+static int layOut(const Instr *code, int count, const unsigned char *plan, int *order){
+    int n = 0;
+
+    for(int i = 0; i <= count; ++i){
+        order[n++] = i;
+        if(plan != NULL && code[i].op == OP_LOOP && (plan[i] & PLAN_COLD))
+            i = code[i].a - 1;                         // Its body comes later
+    }
+    for(int i = 0; i <= count; ++i)
+        if(plan != NULL && code[i].op == OP_LOOP && (plan[i] & PLAN_COLD)){
+            for(int j = i + 1; j < code[i].a; ++j)
+                order[n++] = j;
+            order[n++] = -1 - code[i].a;
+            i = code[i].a - 1;
+        }
+    return n;
+}
+
+// Whether the body of the loop at code[loop] is only moves and instructions on single cells
+// (and blocks), so copies of it can run one after another. If so, step is how far a pass moves
+// the cursor, and low and high the offsets of the first and last cells that copies passes reach,
+// counting every cell a block's original code would pass over: where one of those is off the
+// tape, the pass has to run as it is to fail the way it would.
+static _Bool unrollable(const Instr *code, int loop, int copies, int *step, int *low, int *high){
+    int end = code[loop].a - 1, pos = 0, lo = 0, hi = 0;
+
+    if(code[end].op != OP_END || code[end].a != loop + 1)
+        return 0;
+    for(int j = loop + 1; j < end; ++j){
+        int cell = 0;
+        switch(code[j].op){
+            case OP_BLOCK:
+                if(pos + code[j].off < -GUARD_CELLS || pos + code[j].b > GUARD_CELLS)
+                    return 0;
+                lo = pos + code[j].off < lo ? pos + code[j].off : lo;
+                hi = pos + code[j].b > hi ? pos + code[j].b : hi;
+                continue;
+            case OP_MOVE:
+                cell = pos += code[j].a;
+                break;
+            case OP_INC: case OP_OUT: case OP_IN: case OP_ADD: case OP_SUB: case OP_CLEAR:
+                cell = pos + code[j].off;
+                break;
+            default:
+                return 0;
+        }
+        if(cell < -GUARD_CELLS || cell > GUARD_CELLS || pos < -GUARD_CELLS || pos > GUARD_CELLS)
+            return 0;                                  // Too far to be worth it (and to keep offsets small)
+        lo = cell < lo ? cell : lo;
+        hi = cell > hi ? cell : hi;
+    }
+    *step = pos;
+    *low = lo + (pos < 0 ? (copies - 1) * pos : 0);
+    *high = hi + (pos > 0 ? (copies - 1) * pos : 0);
+    return 1;
+}
+
+// Appends an instruction that only works on one cell (OP_INC, OP_OUT, OP_IN, OP_ADD, OP_SUB or
+// OP_CLEAR), on the cell off away from the cursor, with the overflow policy given.
+static void cellInstr(Asm *as, const Instr *in, int off, int overflow){
+    switch(in->op){
+        case OP_INC:
+            cellOp(as, "\x80\x03", 2, off); // add byte [rbx + off], a
+            put1(as, in->a);
+            break;
+        case OP_OUT:
+            put(as, "\x4c\x89\xf7", 3);               // mov rdi, r14
+            cellOp(as, "\x0f\xb6\x33", 3, off); // movzx esi, byte [rbx + off]
+            callC(as, (void *)jitPut);
+            break;
+        case OP_IN:
+            put(as, "\x4c\x89\xf7", 3);               // mov rdi, r14
+            cellOp(as, "\x0f\xbe\x33", 3, off); // movsx esi, byte [rbx + off]
+            callC(as, (void *)jitGet);
+            cellOp(as, "\x88\x03", 2, off); // mov byte [rbx + off], al
+            break;
+        case OP_ADD:
+            if(overflow == OVERFLOW_SATURATE){
+                cellOp(as, "\x0f\xbe\x03", 3, off); // movsx eax, byte [rbx + off]
+                put1(as, 0x05);                       // add eax, a
+                put4(as, in->a);
+                put(as, "\xb9\x7f\x00\x00\x00", 5); // mov ecx, 127
+                put(as, "\x39\xc8\x0f\x4f\xc1", 5); // cmp eax, ecx; cmovg eax, ecx
+                cellOp(as, "\x88\x03", 2, off); // mov byte [rbx + off], al
+                break;
+            }
+            if(overflow == OVERFLOW_ERROR && !(in->flags & F_SAFE)){
+                cellOp(as, "\x0f\xbe\x03", 3, off); // movsx eax, byte [rbx + off]
+                put1(as, 0x3d);                       // cmp eax, 127 - a
+                put4(as, 127 - in->a);
+                jump(as, JG, TO_ADD);
+            }
+            cellOp(as, "\x80\x03", 2, off); // add byte [rbx + off], a
+            put1(as, in->a);
+            break;
+        case OP_SUB:
+            if(overflow == OVERFLOW_SATURATE){
+                cellOp(as, "\x0f\xbe\x03", 3, off); // movsx eax, byte [rbx + off]
+                put1(as, 0x2d);                       // sub eax, a
+                put4(as, in->a);
+                put(as, "\x31\xc9\x39\xc8\x0f\x4c\xc1", 7); // xor ecx, ecx; cmp eax, ecx; cmovl eax, ecx
+                cellOp(as, "\x88\x03", 2, off); // mov byte [rbx + off], al
+                break;
+            }
+            if(overflow == OVERFLOW_ERROR && !(in->flags & F_SAFE)){
+                cellOp(as, "\x0f\xbe\x03", 3, off); // movsx eax, byte [rbx + off]
+                put1(as, 0x3d);                       // cmp eax, a
+                put4(as, in->a);
+                jump(as, JL, TO_SUB);
+            }
+            cellOp(as, "\x80\x2b", 2, off); // sub byte [rbx + off], a
+            put1(as, in->a);
+            break;
+        case OP_CLEAR:
+            cellOp(as, "\xc6\x03", 2, off); // mov byte [rbx + off], 0
+            put1(as, 0);
+            break;
+    }
+}
+
+// Appends an instruction whose last byte is the ModRM of [rbx], turning it into [rbx + off]
+// (with a 32-bit displacement) for a cell at an offset.
+static void cellOp(Asm *as, const char *bytes, size_t n, int off){
+    put(as, bytes, n - 1);
+    if(off == 0){
+        put1(as, bytes[n - 1]);
+        return;
+    }
+    put1(as, bytes[n - 1] | 0x80);                     // mod 10: [rbx + disp32]
+    put4(as, off);
+}
+
+// Calls jitCharge() with the fuel left in r15 and the cursor, then either stops with the limit
+// error it returned or carries on with the next grant in r15.
+static void charge(Asm *as, Budget *budget, int at){
+    put(as, "\x48\xbf", 2);                           // mov rdi, budget
+    put8(as, budget);
+    put(as, "\x48\x89\xd9\x4c\x29\xe1", 6);          // mov rcx, rbx; sub rcx, r12
+    put(as, "\x4c\x89\xfe\xba", 4);                  // mov rsi, r15; mov edx, at
+    put4(as, at);
+    callC(as, (void *)jitCharge);
+    put(as, "\x48\x85\xc0", 3);                      // test rax, rax
+    jump(as, JS, TO_LIMIT);
+    put(as, "\x49\x89\xc7", 3);                      // mov r15, rax
+}
+
+static void jitPut(Output *out, int c){                 // Output cell contents
+    putOutput(out, (char)c);
+}
+
+static int jitGet(Output *out, int cell){              // Input char (what the cell becomes)
+    return readInput(out, cell);
+}
+
+static void jitDump(Output *out, char *memory, int lower, int upper){  // Dump cells lower through upper, then wipe them
+    writeOutput(out, memory + lower, upper - lower + 1);
+    memset(memory + lower, 0, upper - lower + 1);
+}
+
+static long long jitCharge(Budget *budget, long long fuel, int at, long cursor){   // The fuel to go on with, or the limit error negated
+    int error = chargeBudget(budget, &fuel, at, cursor);
+    return error != 0 ? -error : fuel;
+}
+
+#else
+
+int jitRun(const Instr *code, const Options *opts, Budget *budget){ // No JIT for this platform, let the interpreter run it
+    (void)code;
+    (void)opts;
+    (void)budget;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,200 @@
+//
+//  libscrint.c
+//
+//  Screw Interpreter
+//
+//  The library behind scrint.h: the loader, compiler and interpreter
+//  engines wrapped in calls that return errors instead of printing them.
+//  A context keeps its tape and output buffer between runs.
+//
+
+#include <stdio.h>
+#include <stdlib.h>         // For malloc(), calloc() and free()
+#include <string.h>         // For memset()
+#include "screw.h"
+#include "scrint.h"
+
+struct ScrintProgram {
+    Instr *code;            // Compiled instructions, ending with OP_HALT
+};
+
+struct ScrintContext {
+    const ScrintProgram *program;
+    Options opts;           // How it runs
+    Tape tape;              // The memory cells, kept between runs
+    _Bool dirty;            // True if a run has used the tape since it was zeroed
+    Output *out;            // Output buffer and I/O hooks
+    ScrintIO io;            // The caller's callbacks
+};
+
+_Static_assert((int)SCRINT_ERR_SHIFT_RIGHT == (int)ERR_SHIFT_RIGHT && (int)SCRINT_ERR_TIMEOUT == (int)ERR_TIMEOUT,
+               "runtime errors are passed through as they are");
+_Static_assert((int)SCRINT_OVERFLOW_WRAP == (int)OVERFLOW_WRAP && (int)SCRINT_OVERFLOW_SATURATE == (int)OVERFLOW_SATURATE,
+               "overflow policies are passed through as they are");
+_Static_assert((int)SCRINT_EOF_ZERO == (int)EOF_ZERO && (int)SCRINT_EOF_KEEP == (int)EOF_KEEP,
+               "end of input policies are passed through as they are");
+
+static void setError(ScrintError *, int);              // Fill in an error without a place
+static void discard(void *, const void *, size_t);     // Output nowhere
+static int noInput(void *);                             // Input that has already ended
+
+int scrintCompile(const char *source, size_t size, int level, ScrintProgram **program, ScrintError *error){
+    Source src = { "<source>", source, size, NULL, 0, 0 };
+    ScrintProgram *compiled = NULL;
+    int status = 0;
+
+    setError(error, SCRINT_OK);
+    if(program == NULL || (source == NULL && size > 0) || level < 0 || level > 2){
+        setError(error, SCRINT_ERR_ARGUMENT);
+        return SCRINT_ERR_ARGUMENT;
+    }
+    *program = NULL;
+    if((status = checkSource(&src)) != SRC_OK){        // Nothing is allocated after an error
+        static const int statuses[] = {
+            [SRC_NO_END] = SCRINT_ERR_NO_END, [SRC_UNMATCHED_OPEN] = SCRINT_ERR_UNMATCHED_OPEN,
+            [SRC_UNMATCHED_CLOSE] = SCRINT_ERR_UNMATCHED_CLOSE, [SRC_NO_MEMORY] = SCRINT_ERR_NO_MEMORY
+        };
+        setError(error, statuses[status]);
+        if(error != NULL && status != SRC_NO_MEMORY){
+            Position at;
+            sourcePosition(&src, src.error_at, &at);
+            error->line = at.line;
+            error->column = at.col;
+        }
+        return statuses[status];
+    }
+
+    if((compiled = (ScrintProgram *)malloc(sizeof(ScrintProgram))) == NULL
+       || (compiled->code = compile(src.tokens, src.count, level, NULL)) == NULL){
+        free(compiled);
+        free(src.tokens);
+        setError(error, SCRINT_ERR_NO_MEMORY);
+        return SCRINT_ERR_NO_MEMORY;
+    }
+    free(src.tokens);                                  // The source stays the caller's
+    *program = compiled;
+    return SCRINT_OK;
+}
+
+void scrintFreeProgram(ScrintProgram *program){
+    if(program == NULL)
+        return;
+    free(program->code);
+    free(program);
+}
+
+int scrintNewContext(const ScrintProgram *program, const ScrintOptions *options, const ScrintIO *io, ScrintContext **context){
+    ScrintContext *ctx = NULL;
+    long cells = options != NULL && options->cells != 0 ? options->cells : CELLS;
+    int bits = options != NULL && options->cell_bits != 0 ? options->cell_bits : 8;
+    int overflow = options != NULL ? options->overflow : SCRINT_OVERFLOW_ERROR;
+    int eof = options != NULL ? options->eof : SCRINT_EOF_MINUS1;
+
+    if(context == NULL)
+        return SCRINT_ERR_ARGUMENT;
+    *context = NULL;
+    if(program == NULL || cells < CELLS_MIN || cells > OPERAND_MAX || (bits != 8 && bits != 16 && bits != 32)
+       || overflow < SCRINT_OVERFLOW_ERROR || overflow > SCRINT_OVERFLOW_SATURATE
+       || eof < SCRINT_EOF_MINUS1 || eof > SCRINT_EOF_KEEP || (options != NULL && options->timeout_ms < 0))
+        return SCRINT_ERR_ARGUMENT;
+    if((ctx = (ScrintContext *)calloc(1, sizeof(ScrintContext))) == NULL)
+        return SCRINT_ERR_NO_MEMORY;
+    ctx->program = program;
+    ctx->opts.engine = options != NULL && options->engine == SCRINT_ENGINE_SWITCH ? ENGINE_SWITCH : ENGINE_THREADED;
+    ctx->opts.flush = FLUSH_INPUT;                     // Prompts reach write before '?' calls read
+    ctx->opts.cells = cells;
+    ctx->opts.tape = options != NULL && options->guard_pages ? TAPE_GUARD : TAPE_CHECKED;
+    ctx->opts.width = bits / 8;
+    ctx->opts.overflow = overflow;                     // SCRINT_OVERFLOW_* are OVERFLOW_*
+    ctx->opts.eof = eof;                               // SCRINT_EOF_* are EOF_*
+    ctx->opts.max_steps = options != NULL ? options->max_steps : 0;
+    ctx->opts.timeout_ms = options != NULL ? options->timeout_ms : 0;
+    if((ctx->out = (Output *)malloc(sizeof(Output))) == NULL){
+        free(ctx);
+        return SCRINT_ERR_NO_MEMORY;
+    }
+    if(newTape(&ctx->tape, cells, ctx->opts.width, ctx->opts.tape) != 0){
+        free(ctx->out);
+        free(ctx);
+        return SCRINT_ERR_NO_MEMORY;
+    }
+    initOutput(ctx->out, -1, ctx->opts.flush);
+    scrintSetIO(ctx, io);
+    *context = ctx;
+    return SCRINT_OK;
+}
+
+void scrintSetIO(ScrintContext *ctx, const ScrintIO *io){
+    ctx->io.write = io != NULL && io->write != NULL ? io->write : discard;
+    ctx->io.read = io != NULL && io->read != NULL ? io->read : noInput;
+    ctx->io.user = io != NULL ? io->user : NULL;
+    hookOutput(ctx->out, ctx->io.write, ctx->io.read, ctx->io.user);
+}
+
+void scrintFreeContext(ScrintContext *ctx){
+    if(ctx == NULL)
+        return;
+    freeTape(&ctx->tape);
+    free(ctx->out);
+    free(ctx);
+}
+
+int scrintRun(ScrintContext *ctx, ScrintError *error){
+    int result = 0;
+
+    setError(error, SCRINT_OK);
+    if(ctx == NULL){
+        setError(error, SCRINT_ERR_ARGUMENT);
+        return SCRINT_ERR_ARGUMENT;
+    }
+    if(ctx->dirty)
+        scrintReset(ctx);
+    ctx->dirty = 1;
+    ctx->out->len = 0;
+    result = executeOn(ctx->program->code, &ctx->opts, &ctx->tape, ctx->out, NULL, NULL);
+    if(result == -1)
+        result = SCRINT_ERR_NO_MEMORY;
+    setError(error, result & 0xff);
+    if(error != NULL)
+        error->symbol = (char)(result >> 8);
+    return result & 0xff;
+}
+
+void scrintReset(ScrintContext *ctx){
+    memset(ctx->tape.cells, 0, (size_t)ctx->tape.size * ctx->tape.width);
+    ctx->dirty = 0;
+}
+
+int scrintFormatError(const ScrintError *error, char *buf, size_t size){
+    int status = error != NULL ? error->status : SCRINT_ERR_ARGUMENT;
+
+    if(status >= SCRINT_ERR_SHIFT_RIGHT && status <= SCRINT_ERR_TIMEOUT)
+        return snprintf(buf, size, errorMessage(status), error->symbol);
+    switch(status){
+        case SCRINT_OK: return snprintf(buf, size, "No error");
+        case SCRINT_ERR_NO_END: return snprintf(buf, size, "%s (%zu:%zu)", sourceMessage(SRC_NO_END), error->line, error->column);
+        case SCRINT_ERR_UNMATCHED_OPEN: return snprintf(buf, size, "%s (%zu:%zu)", sourceMessage(SRC_UNMATCHED_OPEN), error->line, error->column);
+        case SCRINT_ERR_UNMATCHED_CLOSE: return snprintf(buf, size, "%s (%zu:%zu)", sourceMessage(SRC_UNMATCHED_CLOSE), error->line, error->column);
+        case SCRINT_ERR_NO_MEMORY: return snprintf(buf, size, "%s", sourceMessage(SRC_NO_MEMORY));
+        default: return snprintf(buf, size, "Invalid argument");
+    }
+}
+
+static void setError(ScrintError *error, int status){
+    if(error == NULL)
+        return;
+    error->status = status;
+    error->symbol = 0;
+    error->line = error->column = 0;
+}
+
+static void discard(void *user, const void *bytes, size_t n){
+    (void)user;
+    (void)bytes;
+    (void)n;
+}
+
+static int noInput(void *user){
+    (void)user;
+    return EOF;
+}
@@ -0,0 +1,267 @@
+//
+//  loader.c
+//
+//  Screw Interpreter
+//
+//  Loads a screw file: the source is memory-mapped and, in one pass, checked
+//  for '~' and matching braces, stripped of comments and whitespace, and
+//  reduced to the tokens compile() reads. Errors give the line and column.
+//
+
+#include <stdio.h>
+#include <stdlib.h>         // For malloc(), realloc() and free()
+#include <string.h>         // For memchr()
+#include <fcntl.h>          // For open()
+#include <unistd.h>         // For close()
+#include <sys/mman.h>       // For mmap(), munmap(), madvise()
+#include <sys/stat.h>       // For fstat()
+#include "screw.h"
+
+enum {                      // What a source byte is to the tokenizer
+    K_SKIP,                 // Whitespace and anything else that isn't code
+    K_TOKEN,                // Kept as a token
+    K_OPEN,                 // '{'
+    K_CLOSE,                // '}'
+    K_COMMENT,              // ';' : Ignore the rest of the line
+    K_END                   // '~' : End of program
+};
+
+static const unsigned char kinds[256] = {
+    ['+'] = K_TOKEN, ['-'] = K_TOKEN, ['?'] = K_TOKEN, ['>'] = K_TOKEN, ['<'] = K_TOKEN,
+    ['.'] = K_TOKEN, ['*'] = K_TOKEN, ['^'] = K_TOKEN, ['A'] = K_TOKEN, ['S'] = K_TOKEN,
+    ['0'] = K_TOKEN, ['1'] = K_TOKEN, ['2'] = K_TOKEN, ['3'] = K_TOKEN, ['4'] = K_TOKEN,
+    ['5'] = K_TOKEN, ['6'] = K_TOKEN, ['7'] = K_TOKEN, ['8'] = K_TOKEN, ['9'] = K_TOKEN,
+    ['{'] = K_OPEN, ['}'] = K_CLOSE, [';'] = K_COMMENT, ['~'] = K_END
+};
+
+typedef struct {            // A token to find, and where its position goes
+    size_t token;
+    size_t slot;
+} Lookup;
+
+static int tokenize(Source *);                          // Check and tokenize the mapped source
+static int compareLookups(const void *, const void *);
+
+int loadSource(const char *file_name, Source *src){    // Map and tokenize a screw file (0 on success, -1 after printing an error)
+    if(mapSource(file_name, src) != 0)
+        return -1;
+    return tokenizeSource(src);
+}
+
+int mapSource(const char *file_name, Source *src){     // Map a screw file without tokenizing it yet (0 on success, -1 after printing an error)
+    struct stat info;
+    int fd = -1;
+
+    src->name = file_name;
+    src->text = NULL;
+    src->size = 0;
+    src->tokens = NULL;
+    src->count = 0;
+
+    if((fd = open(file_name, O_RDONLY)) == -1){
+        fprintf(stderr, "%sError:%s %s doesn't exist!\n", RED, RESET, file_name);
+        return -1;
+    }
+    if(fstat(fd, &info) == -1 || !S_ISREG(info.st_mode)){
+        fprintf(stderr, "%sError:%s Cannot read %s!\n", RED, RESET, file_name);
+        close(fd);
+        return -1;
+    }
+    src->size = (size_t)info.st_size;
+    if(src->size > 0){
+        void *text = mmap(NULL, src->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(text == MAP_FAILED){
+            fprintf(stderr, "%sError:%s Cannot map %s into memory!\n", RED, RESET, file_name);
+            close(fd);
+            return -1;
+        }
+        madvise(text, src->size, MADV_SEQUENTIAL);     // Read once, front to back
+        src->text = (const char *)text;
+    }
+    close(fd);                                         // The mapping stays valid without the descriptor
+    return 0;
+}
+
+int tokenizeSource(Source *src){                       // Check and tokenize a mapped screw file, releasing it after printing an error
+    int error = checkSource(src);
+    Position at;
+
+    if(error == SRC_OK)
+        return 0;
+    if(error == SRC_NO_MEMORY)
+        fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+    else{
+        sourcePosition(src, src->error_at, &at);
+        fprintf(stderr, "%sError:%s %s (%s:%zu:%zu)\n", RED, RESET, sourceMessage(error), src->name, at.line, at.col);
+    }
+    freeSource(src);
+    return -1;
+}
+
+int checkSource(Source *src){                          // Check and tokenize a mapped screw file without printing (SRC_*)
+    int error = tokenize(src);
+
+    if(error != SRC_OK){
+        free(src->tokens);
+        src->tokens = NULL;
+        src->count = 0;
+    }
+    return error;
+}
+
+const char *sourceMessage(int error){                  // Message for a SRC_* error
+    switch(error){
+        case SRC_NO_END: return "Program does not have terminating character!";
+        case SRC_UNMATCHED_OPEN: return "Program has mismatched braces! Unmatched '{'";
+        case SRC_UNMATCHED_CLOSE: return "Program has mismatched braces! Unmatched '}'";
+        case SRC_NO_MEMORY: return "Malloc() failed to allocate memory!";
+        default: return "No error";
+    }
+}
+
+void sourcePosition(const Source *src, size_t offset, Position *at){ // Line and column of a byte of the source
+    const unsigned char *p = (const unsigned char *)src->text;
+    const unsigned char *end = p + offset;
+    const unsigned char *line_start = p;
+
+    at->line = 1;
+    while(p != NULL && p < end){                       // Only errors pay for counting lines
+        p = memchr(p, '\n', end - p);
+        if(p != NULL){
+            ++at->line;
+            line_start = ++p;
+        }
+    }
+    at->col = (size_t)(end - line_start) + 1;
+}
+
+void freeSource(Source *src){                          // Unmap the source and free its tokens
+    if(src->text != NULL)
+        munmap((void *)src->text, src->size);
+    free(src->tokens);
+    src->text = NULL;
+    src->tokens = NULL;
+    src->size = src->count = 0;
+}
+
+// Positions are not kept while tokenizing, so they cost nothing unless asked for: this
+// walks the source once more, the same way tokenize() does, and fills in the position of
+// every token index in tokens (count being the '~'). Returns -1 if out of memory.
+int locateTokens(const Source *src, const size_t *tokens, size_t n, Position *positions){
+    const unsigned char *start = (const unsigned char *)src->text;
+    const unsigned char *p = start, *end = start + src->size, *line_start = start;
+    Lookup *lookups = NULL;                            // tokens sorted by index
+    size_t line = 1, token = 0, next = 0;
+
+    if(n == 0)
+        return 0;
+    if((lookups = (Lookup *)malloc(n * sizeof(Lookup))) == NULL)
+        return -1;
+    for(size_t i = 0; i < n; ++i){
+        lookups[i].token = tokens[i];
+        lookups[i].slot = i;
+    }
+    qsort(lookups, n, sizeof(Lookup), compareLookups);
+
+    for(; p < end && next < n; ++p){
+        int kind = kinds[*p];
+        if(*p == '\n'){
+            ++line;
+            line_start = p + 1;
+        }
+        else if(kind == K_COMMENT){                    // Up to the newline, unless a '~' ends the program first
+            const unsigned char *newline = memchr(p, '\n', end - p);
+            const unsigned char *stop = newline != NULL ? newline : end;
+            const unsigned char *tilde = memchr(p, '~', stop - p);
+            p = (tilde != NULL ? tilde : stop) - 1;
+        }
+        else if(kind != K_SKIP){
+            for(; next < n && lookups[next].token == token; ++next){
+                positions[lookups[next].slot].line = line;
+                positions[lookups[next].slot].col = (size_t)(p - line_start) + 1;
+            }
+            if(kind == K_END)
+                break;
+            ++token;
+        }
+    }
+    for(; next < n; ++next)                            // Past the '~'
+        positions[lookups[next].slot].line = positions[lookups[next].slot].col = 0;
+    free(lookups);
+    return 0;
+}
+
+static int compareLookups(const void *a, const void *b){
+    size_t x = ((const Lookup *)a)->token, y = ((const Lookup *)b)->token;
+    return (x > y) - (x < y);
+}
+
+static int tokenize(Source *src){                      // SRC_OK, or an SRC_* error about the byte at src->error_at
+    const unsigned char *p = (const unsigned char *)src->text;
+    const unsigned char *end = p + src->size;
+    const unsigned char **open_braces = NULL;          // Stack of unmatched '{', grown as loops nest deeper
+    size_t depth = 0, max_depth = 0;
+    char *t = NULL;                                    // Where the next token goes
+
+    src->error_at = 0;
+    if((src->tokens = (char *)malloc(src->size + 1)) == NULL) // Never more tokens than bytes, plus the '~'
+        return SRC_NO_MEMORY;
+    t = src->tokens;
+
+    while(p < end){
+        switch(kinds[*p]){
+            case K_TOKEN:
+                *t++ = (char)*p;
+                break;
+            case K_OPEN:
+                if(depth == max_depth){
+                    size_t cap = max_depth ? max_depth * 2 : 64;
+                    const unsigned char **grown = (const unsigned char **)realloc(open_braces, cap * sizeof(*open_braces));
+                    if(grown == NULL){
+                        free(open_braces);
+                        return SRC_NO_MEMORY;
+                    }
+                    open_braces = grown;
+                    max_depth = cap;
+                }
+                open_braces[depth++] = p;
+                *t++ = '{';
+                break;
+            case K_CLOSE:
+                if(depth == 0){
+                    src->error_at = (size_t)(p - (const unsigned char *)src->text);
+                    free(open_braces);
+                    return SRC_UNMATCHED_CLOSE;
+                }
+                --depth;
+                *t++ = '}';
+                break;
+            case K_COMMENT:{                           // Skip to the newline, unless a '~' ends the program first
+                const unsigned char *newline = memchr(p, '\n', end - p);
+                const unsigned char *stop = newline != NULL ? newline : end;
+                const unsigned char *tilde = memchr(p, '~', stop - p);
+                p = tilde != NULL ? tilde : stop;
+                continue;
+            }
+            case K_END:
+                goto terminated;
+            default:                                   // K_SKIP
+                break;
+        }
+        ++p;
+    }
+    src->error_at = src->size;
+    free(open_braces);
+    return SRC_NO_END;
+
+terminated:
+    if(depth != 0){
+        src->error_at = (size_t)(open_braces[depth - 1] - (const unsigned char *)src->text);
+        free(open_braces);
+        return SRC_UNMATCHED_OPEN;
+    }
+    free(open_braces);
+    *t = '~';
+    src->count = (size_t)(t - src->tokens);
+    return SRC_OK;
+}
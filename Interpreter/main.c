@@ -9,35 +9,206 @@
 //
 
 #include <stdio.h>
-#include <fcntl.h>          // For open()
-#include <unistd.h>         // For lseek(), close()
-#include <string.h>         // For memset(), strlen(), strcmp()
-#include <stdlib.h>         // For malloc() and free()
-#include <ctype.h>          // isdigit()
+#include <unistd.h>         // For isatty()
+#include <string.h>         // For strlen(), strcmp(), strdup(), memcpy(), memset()
+#include <stdlib.h>         // For malloc(), free()
 
-#define CELLS 60000         // How many memory cells there will be
-#define RESET "\033[0m"     // Default color
-#define RED "\033[0;31m"    // Red
-#define YELLOW "\033[0;33m" // Yellow
-
-_Bool termChar(char *);         // Check to make sure the program has a terminating character
-_Bool matchingBraces(char *);   // Check to make sure the program has matching braces
-void run(char *);               // Interpret tokenized screw code
+#include "screw.h"
 
 int main(int argc, const char * argv[]) {
     int file_name_len = 0;                  // Holds the length of the file name
     const char *file_extension = NULL;      // Holds the extension of the given file
-    char *file_buffer = NULL;               // Holds unfiltered contents of file
-    int file_length = 0;                    // Holds the unfiltered file length
-    char *token = NULL;                     // Holds the filtered contents of the file
-    int token_length = 0;                   // Holds the filtered file length
-    char *c = NULL;                         // Cursor for filtering the file contents
-    _Bool comment = 0;                      // True if reading a comment
-    int rd = 0;                             // File descriptor for reading the file
+    Source source;                          // The mapped file and its tokens
+    Instr *compiled = NULL;                 // Holds the compiled instructions
+    Instr *program = NULL;                  // Instructions to run: compiled, or mapped from the cache
+    _Bool use_cache = 0;                    // True if compiled programs are kept on disk (--cache)
+    Image image = { 0 };                    // The program's entry in the cache
+    const char *file_name = NULL;           // Screw file given on the command line
+    int opt_level = 2;                      // Optimization level given with -O0, -O1 or -O2
+    _Bool use_jit = 0;                      // True if the program should run as machine code (--jit)
+    Options opts = {                        // How the program is run
+        ENGINE_THREADED,                    // Interpreter engine given with --engine=threaded|switch
+        isatty(STDOUT_FILENO) ? FLUSH_LINE : FLUSH_INPUT,  // When output is written, given with --flush=full|line|input
+        CELLS,                              // Tape length given with --cells N
+        TAPE_GUARD,                         // Kind of tape given with --tape=guard|checked|unchecked
+        1,                                  // Bytes in a cell given with --cell-bits=8|16|32
+        OVERFLOW_ERROR,                     // What 'A' and 'S' do past the cell range, given with --overflow=error|wrap|saturate
+        EOF_MINUS1,                         // What '?' does at the end of the input, given with --eof=minus1|zero|keep
+        NULL, 0,                            // Input file, mapped, given with --input FILE (NULL: stdin)
+        0,                                  // Steps the run may take, given with --max-steps N (0: no limit)
+        0,                                  // Milliseconds the run may take, given with --timeout MS (0: no limit)
+        NULL,                               // Where the run starts: set once the program has run up to its first '?', or by --restore FILE
+        NULL,                               // Where checkpoints go: set by --checkpoint-every N
+        NULL,                               // Where the run is sampled: set by --sample FILE
+        NULL,                               // Where the run reports how far it got: set by --stats-file FILE
+        NULL                                // How machine code is laid out: set by --profile-use FILE
+    };
+    unsigned long long prefix_steps = PREFIX_STEPS; // Steps the program may run at compile time, given with --prefix-steps N (0: none)
+    Snapshot *prefix = NULL;                // How far it got
+    unsigned long long checkpoint_every = 0;    // Steps between checkpoints, given with --checkpoint-every N (0: none)
+    const char *restore_name = NULL;        // Checkpoint to go on from, given with --restore FILE
+    Checkpoint checkpoint;                  // Where checkpoints go, and the program they are of
+    char *checkpoint_name = NULL;           // File name with ".ckpt" for ".scw", where they go
+    Snapshot *restored = NULL;              // The checkpoint gone on from
+    const char *sample_name = NULL;         // File the samples are written to as collapsed stacks, given with --sample FILE
+    Sampler *sampler = NULL;                // Samples taken while the run goes
+    Stats stats = { NULL, 0, 0, 0, NULL, NULL };    // Where the run reports how far it got, given with --stats-file FILE
+    Budget budget = { 0, 0, 0, 0, 0, 0, NULL, NULL, NULL }; // How far the run got against those limits
+    int result = 0;                         // What the run ended with
+    int exit_status = 0;                    // EXIT_LIMIT if a limit stopped it
+    const char *input_name = NULL;          // File given with --input
+    Source input;                           // The input file, mapped
+    char *end = NULL;                       // Where a number in the arguments stopped
+    _Bool build = 0;                        // True if the program should be built into an executable instead of run (-c)
+    const char *output = NULL;              // Executable (or .c file) to build, given with -o
+    char *default_output = NULL;            // File name without ".scw", used when there is no -o
+    _Bool profiling = 0;                    // True if the run should be profiled (--profile, --profile=FILE or --profile-out FILE)
+    _Bool show_profile = 0;                 // True if the profile should be printed (--profile or --profile=FILE)
+    _Bool explain = 0;                      // True if the checks proven away should be listed instead of running (--explain-checks)
+    const char *profile_json = NULL;        // File the profile is also written to as JSON, given with --profile=FILE
+    const char *profile_out = NULL;         // File the loop counts are recorded to for a later build, given with --profile-out FILE
+    const char *profile_use = NULL;         // Recorded loop counts to lay out machine code by, given with --profile-use FILE
+    unsigned char *plan = NULL;             // What they say to do with every loop
+    size_t *origins = NULL;                 // Token each instruction came from, for the profile and sample reports
+    Profile *prof = NULL;                   // Counts collected while profiling
+    const char *manifest = NULL;            // Jobs to run in parallel, given with --batch FILE
+    int workers = 0;                        // Worker threads for --batch given with -j N (0: one per CPU)
+    _Bool version = 0;                      // True if the user is asking for version info
+    _Bool bad_args = 0;                     // True if an argument was not understood
+    
+    for(int arg = 1; arg < argc; ++arg){    // Sort the arguments into options and the file name
+        if(strcmp(argv[arg], "-v") == 0)
+            version = 1;
+        else if(strcmp(argv[arg], "-O0") == 0 || strcmp(argv[arg], "-O1") == 0 || strcmp(argv[arg], "-O2") == 0)
+            opt_level = argv[arg][2] - '0';
+        else if(strcmp(argv[arg], "--jit") == 0)
+            use_jit = 1;
+        else if(strcmp(argv[arg], "--engine=threaded") == 0)
+            opts.engine = ENGINE_THREADED;
+        else if(strcmp(argv[arg], "--engine=switch") == 0)
+            opts.engine = ENGINE_SWITCH;
+        else if(strcmp(argv[arg], "--flush=full") == 0)
+            opts.flush = FLUSH_FULL;
+        else if(strcmp(argv[arg], "--flush=line") == 0)
+            opts.flush = FLUSH_LINE;
+        else if(strcmp(argv[arg], "--flush=input") == 0)
+            opts.flush = FLUSH_INPUT;
+        else if(strcmp(argv[arg], "--cells") == 0 && arg + 1 < argc){
+            opts.cells = strtol(argv[++arg], &end, 10);
+            if(*argv[arg] == '\0' || *end != '\0' || opts.cells < CELLS_MIN || opts.cells > OPERAND_MAX)
+                bad_args = 1;
+        }
+        else if(strcmp(argv[arg], "--tape=guard") == 0)
+            opts.tape = TAPE_GUARD;
+        else if(strcmp(argv[arg], "--tape=checked") == 0)
+            opts.tape = TAPE_CHECKED;
+        else if(strcmp(argv[arg], "--tape=unchecked") == 0)
+            opts.tape = TAPE_UNCHECKED;
+        else if(strcmp(argv[arg], "--cell-bits=8") == 0 || strcmp(argv[arg], "--cell-bits=16") == 0
+                || strcmp(argv[arg], "--cell-bits=32") == 0)
+            opts.width = atoi(argv[arg] + 12) / 8;
+        else if(strcmp(argv[arg], "--overflow=error") == 0)
+            opts.overflow = OVERFLOW_ERROR;
+        else if(strcmp(argv[arg], "--overflow=wrap") == 0)
+            opts.overflow = OVERFLOW_WRAP;
+        else if(strcmp(argv[arg], "--overflow=saturate") == 0)
+            opts.overflow = OVERFLOW_SATURATE;
+        else if(strcmp(argv[arg], "--eof=minus1") == 0)
+            opts.eof = EOF_MINUS1;
+        else if(strcmp(argv[arg], "--eof=zero") == 0)
+            opts.eof = EOF_ZERO;
+        else if(strcmp(argv[arg], "--eof=keep") == 0)
+            opts.eof = EOF_KEEP;
+        else if(strcmp(argv[arg], "--max-steps") == 0 && arg + 1 < argc){
+            opts.max_steps = strtoull(argv[++arg], &end, 10);
+            if(*argv[arg] < '0' || *argv[arg] > '9' || *end != '\0' || opts.max_steps == 0 || opts.max_steps > 1ULL << 62)
+                bad_args = 1;
+        }
+        else if(strcmp(argv[arg], "--timeout") == 0 && arg + 1 < argc){
+            opts.timeout_ms = strtol(argv[++arg], &end, 10);
+            if(*argv[arg] == '\0' || *end != '\0' || opts.timeout_ms < 1)
+                bad_args = 1;
+        }
+        else if(strcmp(argv[arg], "--prefix-steps") == 0 && arg + 1 < argc){
+            prefix_steps = strtoull(argv[++arg], &end, 10);
+            if(*argv[arg] < '0' || *argv[arg] > '9' || *end != '\0' || prefix_steps > 1ULL << 62)
+                bad_args = 1;
+        }
+        else if(strcmp(argv[arg], "--checkpoint-every") == 0 && arg + 1 < argc){
+            checkpoint_every = strtoull(argv[++arg], &end, 10);
+            if(*argv[arg] < '0' || *argv[arg] > '9' || *end != '\0' || checkpoint_every == 0 || checkpoint_every > 1ULL << 62)
+                bad_args = 1;
+        }
+        else if(strcmp(argv[arg], "--restore") == 0 && arg + 1 < argc)
+            restore_name = argv[++arg];
+        else if(strcmp(argv[arg], "--input") == 0 && arg + 1 < argc)
+            input_name = argv[++arg];
+        else if(strcmp(argv[arg], "--cache") == 0)
+            use_cache = 1;
+        else if(strcmp(argv[arg], "--profile") == 0)
+            profiling = show_profile = 1;
+        else if(strncmp(argv[arg], "--profile=", 10) == 0 && argv[arg][10] != '\0'){
+            profiling = show_profile = 1;
+            profile_json = argv[arg] + 10;
+        }
+        else if(strcmp(argv[arg], "--profile-out") == 0 && arg + 1 < argc){
+            profiling = 1;
+            profile_out = argv[++arg];
+        }
+        else if(strcmp(argv[arg], "--profile-use") == 0 && arg + 1 < argc)
+            profile_use = argv[++arg];
+        else if(strcmp(argv[arg], "--sample") == 0 && arg + 1 < argc)
+            sample_name = argv[++arg];
+        else if(strcmp(argv[arg], "--stats-file") == 0 && arg + 1 < argc){
+            stats.path = argv[++arg];
+            opts.stats = &stats;
+        }
+        else if(strcmp(argv[arg], "--explain-checks") == 0)
+            explain = 1;
+        else if(strcmp(argv[arg], "--batch") == 0 && arg + 1 < argc)
+            manifest = argv[++arg];
+        else if(strcmp(argv[arg], "-j") == 0 && arg + 1 < argc){
+            workers = (int)strtol(argv[++arg], &end, 10);
+            if(*argv[arg] == '\0' || *end != '\0' || workers < 1 || workers > 4096)
+                bad_args = 1;
+        }
+        else if(strcmp(argv[arg], "-c") == 0)
+            build = 1;
+        else if(strcmp(argv[arg], "-o") == 0 && arg + 1 < argc)
+            output = argv[++arg];
+        else if(argv[arg][0] != '-' && file_name == NULL)
+            file_name = argv[arg];
+        else
+            bad_args = 1;
+    }
    
-    if(argc == 2 && strcmp(argv[1], "-v") != 0){    // Check to make sure there are two arguments and that using is not asking for version info
-        file_name_len = (int)strlen(argv[1]);       // Get length of the file name
-        file_extension = &argv[1][file_name_len-4]; // Pointer to the file extension
+    if(output != NULL && !build)            // -o only makes sense when building
+        bad_args = 1;
+    if(profiling && build)                  // Only a run can be profiled
+        bad_args = 1;
+    if(manifest != NULL && (file_name != NULL || build || profiling || use_jit))
+        bad_args = 1;                       // A batch runs its own files, interpreted
+    if(workers != 0 && manifest == NULL)    // -j only makes sense for a batch
+        bad_args = 1;
+    if(explain && (manifest != NULL || build || profiling || use_jit))
+        bad_args = 1;                       // It only reports, for one file
+    if(input_name != NULL && (manifest != NULL || build))
+        bad_args = 1;                       // Batch jobs name their own input, and executables read stdin
+    if((checkpoint_every != 0 || restore_name != NULL) && (manifest != NULL || build || profiling || explain))
+        bad_args = 1;                       // Only a plain run is checkpointed and restored
+    if(sample_name != NULL && (manifest != NULL || build || profiling || explain || use_jit || checkpoint_every != 0 || restore_name != NULL))
+        bad_args = 1;                       // Samples are of one interpreted run, from the top
+    if(opts.stats != NULL && (manifest != NULL || build || explain))
+        bad_args = 1;                       // Only a run reports how far it got
+    if(profile_use != NULL && ((!build && !use_jit) || profiling || explain || sample_name != NULL))
+        bad_args = 1;                       // Only machine code is laid out by a profile
+    
+    if(manifest != NULL && !version && !bad_args)
+        return runBatch(manifest, opt_level, &opts, workers);
+    
+    if(file_name != NULL && !version && !bad_args){ // Check to make sure there is a file to run and that user is not asking for version info
+        file_name_len = (int)strlen(file_name);     // Get length of the file name
+        file_extension = &file_name[file_name_len-4]; // Pointer to the file extension
         
         if(file_name_len < 5){                      // Minimum name for a screw file
             fprintf(stderr, "%sError:%s Invalid filename\n", RED, RESET);
@@ -48,323 +219,146 @@ int main(int argc, const char * argv[]) {
             exit(EXIT_FAILURE);
         }
         
-        // GET THE CONTENTS OF THE FILE INTO A STRING
+        // MAP THE FILE, THEN TAKE ITS COMPILED PROGRAM FROM THE CACHE OR TOKENIZE IT IN ONE PASS
         //===================================================================================================
-        rd = open(argv[1], O_RDONLY);                   // Open .scw file
+        if(mapSource(file_name, &source) != 0)
+            exit(EXIT_FAILURE);
+        if(use_cache && !profiling && !explain && sample_name == NULL && profile_use == NULL && openImage(&source, opt_level, &image) == 0)
+            program = image.code;                      // Already checked, tokenized and compiled by an earlier run
+        else if(tokenizeSource(&source) != 0)          // Missing '~' and mismatched braces are reported here
+            exit(EXIT_FAILURE);
         
-        if(rd != -1){                                   // Check to make sure file exists
-            file_length = (int)lseek(rd, 0, SEEK_END);  // Get the length of the file
-            
-            if(file_length == -1){                      // Check for lseek() error
-                fprintf(stderr, "%sError:%s Lseek() returned error from reading %s!\n", RED, RESET, argv[1]);
-                exit(EXIT_FAILURE);                     // Exit if lseek() failed
-            }
-            else{                                       // Read file contents
-                lseek(rd, 0, SEEK_SET);                 // Reset the file offset
-                file_buffer = (char *)malloc((file_length * sizeof(char)) + 1); // Set file_buffer to the length of the file
-                if(file_buffer == NULL){
-                    fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
-                    exit(EXIT_FAILURE);                 // Exit if malloc() failed
-                }
-                memset(file_buffer, '\0', file_length + 1); // Initialize all of file_buffer with '\0'
-                read(rd, file_buffer, file_length);         // Read all the contents of the file into file_buffer
-                close(rd);                                  // Close the file
-            }
-        }else{                                          // If here, then the file doesn't exist -- Exit
-            fprintf(stderr, "%sError:%s %s doesn't exist!\n", RED, RESET, argv[1]);
-            exit(EXIT_FAILURE);                        // Exit if the file does not exist
+        if(input_name != NULL){                        // Read straight out of the mapped file instead of stdin
+            if(mapSource(input_name, &input) != 0)
+                exit(EXIT_FAILURE);
+            opts.input = input.text != NULL ? input.text : "";
+            opts.input_len = input.size;
         }
         
-        if(termChar(file_buffer) == 0){                 // Check to see if the terminating character exists in the program
-            fprintf(stderr, "%sError:%s Program does not have terminating character!\n", RED, RESET);
-            free(file_buffer);                          // Free dynamically allocated memory
-            exit(EXIT_FAILURE);                         // Exit if the terminating character is not in the program
-        }
-        if(matchingBraces(file_buffer) == 0){           // Check to see if there are matching braces
-            fprintf(stderr, "%sError:%s Program has mismatched braces!\n", RED, RESET);
-            free(file_buffer);                          // Free dynamically allocated memory
-            exit(EXIT_FAILURE);                         // Exit if braces are mismatched
+        // COMPILE AND RUN FILE
+        //===================================================================================================
+        //printf("%s\n", source.tokens);                // For debugging - Viewing final token to be run
+        if(program == NULL){
+            compiled = compile(source.tokens, source.count, opt_level, profiling || explain || sample_name != NULL || profile_use != NULL ? &origins : NULL); // Decode operands, resolve loop jumps and optimize once, up front
+            if(compiled == NULL){                      // Only fails if memory runs out
+                fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+                freeSource(&source);
+                exit(EXIT_FAILURE);
+            }
+            program = compiled;
         }
-        
-        // TOKENIZE AND REDUCE THE FILE CONTENTS INTO SINGLE TOKEN
+        // GO ON FROM A CHECKPOINT, AND WRITE CHECKPOINTS AS IT RUNS
         //===================================================================================================
-        c = file_buffer;                                // Set cursor to beginning of the file_buffer (holds the original contents of file)
-        while(*c != '~'){                               // While the cursor is not the terminating character
-            switch(*c){                                 // Switch case to count all operators to put into token
-                case '+':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '-':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '{':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '}':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '?':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '>':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '<':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '.':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '*':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '^':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '0':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '1':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '2':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '3':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '4':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '5':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '6':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '7':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '8':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case '9':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case 'A':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case 'S':
-                    if(!comment)
-                        ++token_length;
-                    break;
-                case ';':                               // If semi-colon is found, set comment to true
-                    if(!comment)
-                        comment = 1;
-                    break;
-                case '\n':                              // If newline is found, set comment to false
-                    if(comment)
-                        comment = 0;
-                    break;
-                default:
-                    break;
+        if(checkpoint_every != 0 || restore_name != NULL){
+            memset(&checkpoint, 0, sizeof(checkpoint));
+            checkpoint.every = checkpoint_every;
+            checkpoint.code = program;
+            checkpoint.key = hashSource(&source);
+            checkpoint.source_size = source.size;
+            checkpoint.level = opt_level;
+            checkpoint.overflow = opts.overflow;
+            checkpoint.eof = opts.eof;
+        }
+        if(restore_name != NULL){
+            if((restored = loadCheckpoint(restore_name, &checkpoint, &opts)) == NULL)
+                exit(EXIT_FAILURE);
+            opts.start = restored;
+        }
+        if(checkpoint_every != 0){
+            if((checkpoint_name = (char *)malloc(file_name_len + 2)) == NULL){
+                fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+                exit(EXIT_FAILURE);
             }
-            ++c;                                        // Move cursor to the next character
+            memcpy(checkpoint_name, file_name, file_name_len - 4);
+            strcpy(checkpoint_name + file_name_len - 4, ".ckpt");
+            checkpoint.path = checkpoint_name;
+            opts.checkpoint = &checkpoint;
         }
-        
-        if(comment)
-            comment = 0;
-        
-        
-        token = (char*)malloc((token_length * sizeof(char)) + 1); // Set the token length to the length of all the operators found
-        if(token == NULL){                              // Check to make sure malloc() did not return NULL
+        // RUN UP TO THE FIRST '?' ONCE, WHERE WHAT IT DID IS KEPT: IN THE CACHE (UNLESS A CACHED RUN DID) OR THE EXECUTABLE
+        //===================================================================================================
+        if(opt_level >= 2 && prefix_steps != 0 && restored == NULL && (build || (use_cache && !profiling && !explain && sample_name == NULL && profile_use == NULL))){
+            if(image.prefixed && prefixFits(&image.prefix, &opts))
+                opts.start = &image.prefix;
+            else if((prefix = runPrefix(program, &opts, prefix_steps)) != NULL)
+                opts.start = prefix;                   // Out of memory just means starting from the top
+        }
+        if(use_cache && !profiling && !explain && sample_name == NULL && profile_use == NULL && (compiled != NULL || prefix != NULL))
+            saveImage(&image, program, prefix);        // Profiles and samples need token positions, which images don't keep
+        if((explain || build || use_jit || (!profiling && opts.engine != ENGINE_SWITCH))   // The others run every check anyway
+           && proveChecks(program, &opts, explain ? &source : NULL, origins) == -1 && explain){ // Drop the checks that can't fail for these options
             fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
-            free(file_buffer);                         // Free dynamically allocated memory
-            exit(EXIT_FAILURE);                        // Exit if malloc() failed
+            exit(EXIT_FAILURE);
         }
-        memset(token, '\0', token_length + 1);         // Initialize the tokenized file to NULL terminator
-        
-        int i = 0;                                     // Index of instruction in token
-        c = file_buffer;                               // Set cursor to beginning of the file_buffer (holds the original contents of file)
-        while(*c != '~'){                              // While the cursor is not the terminating character
-            switch(*c){                                // Switch case adds operations to the token
-                case '+':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '-':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '{':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '}':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '?':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '>':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '<':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '.':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '*':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '^':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '0':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '1':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '2':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '3':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '4':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '5':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '6':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '7':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '8':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case '9':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case 'A':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case 'S':
-                    if(!comment){
-                        token[i] = *c;
-                        ++i;
-                    }
-                    break;
-                case ';':                              // If semi-colon is found, set comment to true
-                    if(!comment)
-                        comment = 1;
-                    break;
-                case '\n':                             // If newline is found, set comment to false
-                    if(comment)
-                        comment = 0;
-                    break;
-                default:
-                    break;
+        if(profile_use != NULL && (opts.plan = plan = planProfile(profile_use, program, origins, &source)) == NULL)
+            exit(EXIT_FAILURE);                        // Which loops to unroll, and which to move out of the way
+        if(build){                                     // Translate to C and build a native executable instead of running
+            if(output == NULL){
+                default_output = strdup(file_name);
+                if(default_output == NULL){
+                    fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+                    exit(EXIT_FAILURE);
+                }
+                default_output[file_name_len - 4] = '\0';
+                output = default_output;
             }
-            ++c;                                       // Move cursor to the next character
+            if(buildNative(program, &opts, output) != 0)
+                exit(EXIT_FAILURE);
+            free(default_output);
+        }
+        else if(profiling){                            // Run with the profiling engine, then report where the time went
+            if((prof = newProfile(program)) == NULL){
+                fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+                exit(EXIT_FAILURE);
+            }
+            result = run(program, &opts, prof, &budget);
+            if(show_profile && reportProfile(prof, program, origins, &source, profile_json) != 0)
+                exit(EXIT_FAILURE);
+            if(profile_out != NULL && recordProfile(prof, program, origins, &source, profile_out) != 0)
+                exit(EXIT_FAILURE);
+            freeProfile(prof);
+        }
+        else if(sample_name != NULL){                  // Run with the sampled engine, then write where the samples fell
+            if((opts.sampler = sampler = startSampler(program)) == NULL){
+                fprintf(stderr, "%sError:%s Could not start sampling! Exiting...\n", RED, RESET);
+                exit(EXIT_FAILURE);
+            }
+            result = run(program, &opts, NULL, &budget);
+            stopSampler(sampler);
+            if(reportSamples(sampler, program, origins, &source, sample_name) != 0)
+                exit(EXIT_FAILURE);
+            freeSampler(sampler);
+        }
+        else if(explain)                               // The report was all that was asked for
+            ;
+        else if(!use_jit || (result = jitRun(program, &opts, &budget)) == -1) // Run the compiled, ready-to-go screw code (interpreted if there is no JIT)
+            result = run(program, &opts, NULL, &budget);
+        if(opts.checkpoint != NULL)
+            finishCheckpoints(&checkpoint);            // The last one is whole before the run is over
+        if(result == ERR_STEP_LIMIT || result == ERR_TIMEOUT){ // Say how far the program got, and where
+            Position at = { 0, 0 };
+            long ms = elapsedMs(&budget);
+            if(origins == NULL && (source.tokens != NULL || tokenizeSource(&source) == 0))
+                free(compile(source.tokens, source.count, opt_level, &origins)); // Cached programs keep no positions
+            if(origins == NULL || locateTokens(&source, &origins[budget.at], 1, &at) != 0)
+                fprintf(stderr, "%sStopped:%s after %llu steps and %ld ms\n", YELLOW, RESET, budget.steps, ms);
+            else
+                fprintf(stderr, "%sStopped:%s after %llu steps and %ld ms, at line %zu, column %zu\n",
+                        YELLOW, RESET, budget.steps, ms, at.line, at.col);
+            exit_status = EXIT_LIMIT;
         }
-        token[i] = '~';                                // Finish token by adding terminator at the end
-        
-        // RUN FILE
-        //===================================================================================================
-        run(token);                                    // Run the tokenized, ready-to-go screw code
-        //printf("%s\n", token);                       // For debugging - Viewing final token to be run
         
-        free(file_buffer);                             // Free dynamically allocated memory
-        free(token);                                   // Free dynamically allocated memory
+        freeSource(&source);                           // Unmap the file and free its tokens
+        closeImage(&image);                            // Unmap the cached program, if it was used
+        if(input_name != NULL)
+            freeSource(&input);                        // Unmap the input file
+        free(compiled);                                // Free dynamically allocated memory
+        free(origins);
+        free(plan);
+        freeSnapshot(prefix);
+        freeSnapshot(restored);
+        free(checkpoint_name);
     }
-    else if(argc == 2 && strcmp(argv[1], "-v") == 0){
+    else if(version && file_name == NULL && !bad_args){
         printf("\n");
         printf("                  Screw Interpreter\n");
         printf("========================================================\n");
@@ -375,253 +369,31 @@ int main(int argc, const char * argv[]) {
     }
     else{
         printf("%sTo run a screw file:%s ./scrint <file>.scw\n", YELLOW, RESET);  // Usage string to show user how to run screw files
+        printf("%sTo pick how much the program is optimized (default -O2):%s ./scrint -O0|-O1|-O2 <file>.scw\n", YELLOW, RESET);
+        printf("%sTo run a screw file as native machine code:%s ./scrint --jit <file>.scw\n", YELLOW, RESET);
+        printf("%sTo pick the interpreter engine (default threaded):%s ./scrint --engine=threaded|switch <file>.scw\n", YELLOW, RESET);
+        printf("%sTo pick when output is written:%s ./scrint --flush=full|line|input <file>.scw\n", YELLOW, RESET);
+        printf("%sTo pick the number of memory cells (default 60000, at least 10):%s ./scrint --cells <n> <file>.scw\n", YELLOW, RESET);
+        printf("%sTo check every shift instead of using guard pages:%s ./scrint --tape=checked <file>.scw\n", YELLOW, RESET);
+        printf("%sTo check no shifts at all (trusted programs only):%s ./scrint --tape=unchecked <file>.scw\n", YELLOW, RESET);
+        printf("%sTo pick the size of a memory cell (default 8):%s ./scrint --cell-bits=8|16|32 <file>.scw\n", YELLOW, RESET);
+        printf("%sTo pick what 'A' and 'S' do past the cell range (default error):%s ./scrint --overflow=error|wrap|saturate <file>.scw\n", YELLOW, RESET);
+        printf("%sTo read input from a file instead of stdin:%s ./scrint --input <file> <file>.scw\n", YELLOW, RESET);
+        printf("%sTo pick what '?' does at the end of the input (default minus1):%s ./scrint --eof=minus1|zero|keep <file>.scw\n", YELLOW, RESET);
+        printf("%sTo stop a program after a number of steps or milliseconds:%s ./scrint --max-steps <n> --timeout <ms> <file>.scw\n", YELLOW, RESET);
+        printf("%sTo pick how far a program runs at compile time before it needs input (default 1000000 steps, 0 for none):%s ./scrint --prefix-steps <n> <file>.scw\n", YELLOW, RESET);
+        printf("%sTo write where a program is to <file>.ckpt every so many steps:%s ./scrint --checkpoint-every <n> <file>.scw\n", YELLOW, RESET);
+        printf("%sTo go on from a checkpoint:%s ./scrint --restore <file>.ckpt <file>.scw\n", YELLOW, RESET);
+        printf("%sTo reuse compiled programs across runs:%s ./scrint --cache <file>.scw\n", YELLOW, RESET);
+        printf("%sTo see which loops the time goes to:%s ./scrint --profile[=<report>.json] <file>.scw\n", YELLOW, RESET);
+        printf("%sTo record how often every loop runs, then build faster machine code from it:%s ./scrint --profile-out <file>.prof <file>.scw, then ./scrint --jit|-c --profile-use <file>.prof <file>.scw\n", YELLOW, RESET);
+        printf("%sTo sample where the time goes into collapsed stacks for a flame graph:%s ./scrint --sample <stacks>.txt <file>.scw\n", YELLOW, RESET);
+        printf("%sTo rewrite a file every second with the steps, steps/sec, output bytes and tape used:%s ./scrint --stats-file <file>.prom <file>.scw\n", YELLOW, RESET);
+        printf("%sTo see which shift and overflow checks are proven away:%s ./scrint --explain-checks <file>.scw\n", YELLOW, RESET);
+        printf("%sTo run many screw files across all cores:%s ./scrint --batch <manifest> [-j <threads>]\n", YELLOW, RESET);
+        printf("%sTo build a screw file into a native executable:%s ./scrint -c <file>.scw [-o <executable>]\n", YELLOW, RESET);
         printf("%sFor version information:%s ./scrint -v\n", YELLOW, RESET);      // Usage string to show user version information
     }
     
-    return 0;
-}
-
-_Bool termChar(char *text){                            // Used to see if the screw file has the terminating character '~' in it
-    char *cursor = text;
-    
-    while(*cursor != '\0'){                            // Go through all file contents looking for '~'
-        if(*cursor == '~')
-            return 1;                                  // Return 1 if '~' is found
-        
-        ++cursor;
-    }
-    
-    return 0;                                          // Return 0 if '~' is NOT found
-}
-
-_Bool matchingBraces(char *text){                      // Used to check for matching braces within screw file
-    char *cursor = text;
-    int brace_num = 0;
-    
-    while(*cursor != '~'){                             // Search through whole file for braces
-        if(*cursor == '{')
-            ++brace_num;                               // Increment for every '{' found
-        else if(*cursor == '}')
-            --brace_num;                               // Decrement for every '}' found
-        
-        ++cursor;
-    }
-    
-    if(brace_num == 0) {                               // Return 1 if all braces are matched
-        return 1;
-    }else
-        return 0;                                      // Return 0 if braces are mismatched
-}
-
-void run(char *code){                                  // Interpret tokenized screw file
-    char memory[CELLS];                                // 60,000 memory cells initialized to 0
-    memset(memory, 0, CELLS);
-    char *data_ptr = memory;                           // Cursor for modifying the memory cells
-    char *code_ptr = code;                             // Cursor to read the screw code
-    int braces = 0;                                    // Keep track of braces
-    int left_offset = 0;                               // Keep track of how far away the cell cursor is from the left-most cell
-    
-    while(*code_ptr != '~'){                           // Run code while the terminating character '~' has not been found
-        if(*code_ptr == '>'){                          // Shift cursor to right cell
-            if(left_offset == CELLS){
-                fprintf(stderr, "%sError:%s Invalid instruction, cannot shift right anymore! Exiting...\n", RED, RESET);
-                return;
-            }
-            ++data_ptr;
-            ++left_offset;                             // Update offset from left
-        }
-        else if(*code_ptr == '<'){                     // Shift cursor to left cell
-            if(left_offset == 0){
-                fprintf(stderr, "%sError:%s Invalid instruction, cannot shift left anymore! Exiting...\n", RED, RESET);
-                return;
-            }
-            --data_ptr;
-            --left_offset;                             // Update offset from left
-        }
-        else if(*code_ptr == '+')                      // Increment value in cell
-            ++*data_ptr;
-        else if(*code_ptr == '-')                      // Decrement value in cell
-            --*data_ptr;
-        else if(*code_ptr == '.')                      // Output cell contents
-            putchar(*data_ptr);
-        else if (*code_ptr == '*'){                    // Dump multiple cell's contents
-            int lower_bound = 0;                       // First cell user wants dumped
-            int upper_bound = 0;                       // Last cell user wants dumped
-            
-            ++code_ptr;                                // Increment instruction pointer
-            if(!isdigit(*code_ptr)){                   // Check to make sure the instruction is a digit
-                fprintf(stderr, "%sError:%s Cell Dumping - Expected integer for lower bound!\n", RED, RESET);
-                return;
-            }
-            lower_bound = *code_ptr - '0';             // Set lower bound
-            
-            ++code_ptr;                                // Increment instruction pointer
-            if(*code_ptr != '^'){                      // Make sure instruction is '^'
-                if(isdigit(*code_ptr)){                // If not '^' and is digit
-                    fprintf(stderr, "%sError:%s Cell Dumping may only be applied to cells 0-9\n", RED, RESET);
-                }
-                else                                   // If not '^' and is anything else
-                    fprintf(stderr, "%sError:%s Cell Dumping - Expected '^'\n", RED, RESET);
-                return;
-            }
-            ++code_ptr;                                // Increment instruction pointer
-            
-            if(!isdigit(*code_ptr)){                   // Check to make sure next instruction is digit
-                fprintf(stderr, "%sError:%s Cell Dumping - Expected integer for upper bound!\n", RED, RESET);
-                return;
-            }
-            upper_bound = *code_ptr - '0';             // Set upper bound
-            
-            ++code_ptr;                                // Temporarily increment instruction pointer
-            if(isdigit(*code_ptr)){                    // Check to see is the next instruction is a digit
-                fprintf(stderr, "%sError:%s Cell Dumping may only be applied to cells 0-9\n", RED, RESET);
-                return;
-            }
-            --code_ptr;                                // Decrement instruction pointer if not a digit
-            
-            if(lower_bound > upper_bound) {            // Check to make sure the lower bound is less than the upper bound
-                fprintf(stderr, "%sError:%s Cell Dumping - Lower bound is greater than upper bound!\n", RED, RESET);
-                return;
-            }
-            
-            if(left_offset < lower_bound){             // If the data pointer is below the lower bound, then move it to the lower bound
-                while(left_offset != lower_bound){
-                    ++data_ptr;
-                    ++left_offset;
-                }
-            }
-            else if(left_offset > lower_bound){        // If the data pointer is above the lower bound, then move it to the lower bound
-                while(left_offset != lower_bound){
-                    --data_ptr;
-                    --left_offset;
-                }
-            }
-            if(left_offset == lower_bound){           // If the data pointer is at the lower bound, then output data until upper bound, inclusive
-                while(left_offset != upper_bound + 1){
-                    putchar(*data_ptr);
-                    if(left_offset != upper_bound){
-                        ++data_ptr;
-                        ++left_offset;
-                    }
-                    else
-                        break;
-                }
-            }
-            
-            while(left_offset != lower_bound -1){    // Reset all dumped cells to default value (0)
-                *data_ptr = 0;
-                if(left_offset != lower_bound){
-                    --data_ptr;
-                    --left_offset;
-                }
-                else
-                    break;
-            }
-        }
-        else if(*code_ptr == 'A'){                  // Add value to current cell
-            int current_value = *data_ptr;          // Get current cell's value
-            char num_to_add_str[127];               // String to hold number being added
-            int num_to_add = 0;                     // To hold converted string as an integer
-            
-            memset(num_to_add_str, '\0', 127);      // Initialize string with 0
-            
-            ++code_ptr;                             // Increment instruction
-            if(!isdigit(*code_ptr)){                // Check to make sure the current instruction is an integer
-                fprintf(stderr, "%sError:%s Add - Expected integer!\n", RED, RESET);
-                return;
-            }
-            
-            int i = 0;                              // Index for num_to_add_str
-            while(isdigit(*code_ptr)){              // Loop as long as there are integers found in instructions
-                num_to_add_str[i] = *code_ptr;      // Add each integer found to the string
-                ++i;
-                ++code_ptr;
-            }
-            
-            --code_ptr;                             // Decrement instruction
-            
-            num_to_add = atoi(num_to_add_str);      // Convert string to actual integer
-            
-            if(current_value + num_to_add > 127){   // Check to make sure the result stays within the ASCII table
-                fprintf(stderr, "%sError:%s Add - Cell Overflow!\n", RED, RESET);
-                return;
-            }
-            
-            num_to_add += current_value;            // Create a stopping place for the loop
-            while(current_value != num_to_add){     // Loop and increment cell until x is added
-                ++*data_ptr;
-                ++current_value;
-            }
-        }
-        else if(*code_ptr == 'S'){                  // Sub value from the current cell
-            int current_value = *data_ptr;          // Get current cell's value
-            char num_to_sub_str[127];               // String to hold number being subtracted
-            int num_to_sub = 0;                     // To hold converted string as an integer
-            int num_to_stop_at = 0;                 // Stopping place for the loop below
-            
-            memset(num_to_sub_str, '\0', 127);      // Initialize string with 0
-            
-            ++code_ptr;                             // Increment instruction
-            if(!isdigit(*code_ptr)){                // Check to make sure the current instruction is an integer
-                fprintf(stderr, "%sError:%s Sub - Expected integer!\n", RED, RESET);
-                return;
-            }
-            
-            int i = 0;                              // Index for num_to_add_str
-            while(isdigit(*code_ptr)){              // Loop as long as there are integers found in instructions
-                num_to_sub_str[i] = *code_ptr;      // Add each integer found to the string
-                ++i;
-                ++code_ptr;
-            }
-            
-            --code_ptr;                             // Decrement instruction
-            
-            num_to_sub = atoi(num_to_sub_str);      // Convert string to actual integer
-            
-            if(current_value - num_to_sub < 0){     // Check to make sure the result stays within the ASCII table
-                fprintf(stderr, "%sError:%s Sub - Cell Overflow!\n", RED, RESET);
-                return;
-            }
-            
-            num_to_stop_at = current_value - num_to_sub; // Create a stopping place for the loop
-            while(current_value != num_to_stop_at){ // Loop and decrement cell until x is subtracted
-                --*data_ptr;
-                --current_value;
-            }
-        }
-        else if(*code_ptr == '?')                      // Input char
-            *data_ptr = getchar();
-        else if(*code_ptr == '{'){                     // Loop instructions between braces until the start cell reaches 0
-            if(!(*data_ptr))                             //===============================================================
-            {                                                                       //
-                braces++;                                                           //
-                while(braces)                                                       //
-                {                                                                   //
-                    ++code_ptr;                                                     //
-                    if(*code_ptr == '}')                                            //
-                        braces--;                                                   //
-                    else if(*code_ptr == '{')                                       //
-                        braces++;                                                   //
-                }                                                                   //
-            }                                                                       //
-        }                                                                           //
-        else if(*code_ptr == '}'){                                                  //
-            if(*data_ptr){                                                          //
-                braces++;                                                           //
-                while(braces)                                                       //
-                {                                                                   //
-                    code_ptr--;                                                     //
-                    if(*code_ptr == '{')                                            //
-                        braces--;                                                   //
-                    else if(*code_ptr == '}')                                       //
-                        braces++;                                                   //
-                }                                                                   //
-            }                                                                       //
-        }                                              //================================================================
-        else{
-            fprintf(stderr, "%sError:%s Unknown symbol '%c' found!\n", RED, RESET, *code_ptr); // Error if an unknown symbol has been found
-            return;
-        }
-        ++code_ptr;                                   // Increment to next screw instruction
-    }
+    return exit_status;
 }
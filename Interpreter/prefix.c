@@ -0,0 +1,227 @@
+//
+//  prefix.c
+//
+//  Screw Interpreter
+//
+//  Partial evaluation: before a program runs, the part of it that can't
+//  depend on input is run here, at compile time, up to the first '?' or
+//  until a step budget (--prefix-steps) runs out. What it did is kept as a
+//  Snapshot: the cells it wrote, where the cursor and the next instruction
+//  are, the steps it took and the output it wrote. The run then starts from
+//  there, writing that output in one go. A program that never reads input
+//  and stays within the budget is done before it starts.
+//
+//  An instruction that would fail (a shift off the tape, an overflow, a
+//  malformed symbol) is where the snapshot stops, so the run raises the
+//  error itself, the same way it would have. The snapshot only holds for
+//  the tape length, cell width and overflow policy it was taken with.
+//
+
+#include <stdio.h>
+#include <stdlib.h>         // For malloc(), calloc(), realloc() and free()
+#include <string.h>         // For memcpy()
+#include "screw.h"
+
+#define PREFIX_OUTPUT (16 * OUTPUT_BUFFER)  // Most output a snapshot holds; a program printing more stops there
+
+typedef struct {            // The tape of a run at compile time
+    char *cells;            // First cell
+    int width;              // Bytes in a cell
+    long used;              // Cells from the first that were written to
+} Cells;
+
+static long long getCell(const Cells *, long);         // Value of a cell
+static void setCell(Cells *, long, long long);         // Store a value in a cell, wrapping it the way a cast does
+
+// Runs code the way the engines do, with opts, until it would read input, fail or halt,
+// or take more than steps steps (or write more than PREFIX_OUTPUT bytes). Returns where
+// it stopped, or NULL if there was no memory to run it.
+Snapshot *runPrefix(const Instr *code, const Options *opts, unsigned long long steps){
+    Snapshot *snap = (Snapshot *)calloc(1, sizeof(Snapshot));
+    Cells tape = { NULL, opts->width, 0 };
+    unsigned char *output = NULL;                      // Output written so far
+    size_t len = 0, cap = 0;                           // Bytes in output, and bytes it has room for
+    long cursor = 0, last = opts->cells - 1;           // Cell the cursor is on, and the last cell
+    long long max = opts->width == 1 ? 127 : opts->width == 2 ? 32767 : 2147483647;    // Largest value 'A' may reach
+    unsigned long long taken = 0;                      // Steps taken
+    int i = 0;                                         // Instruction to run next
+
+    if(snap == NULL || (tape.cells = (char *)calloc(opts->cells, opts->width)) == NULL){
+        free(snap);
+        return NULL;
+    }
+    if(opts->max_steps != 0 && opts->max_steps < steps)
+        steps = opts->max_steps;                       // Never past the point the run itself would stop at
+
+    for(;;){
+        const Instr *in = &code[i];
+        long here = cursor + (in->op == OP_INC || in->op == OP_OUT || in->op == OP_ADD || in->op == OP_SUB
+                              || in->op == OP_CLEAR ? in->off : 0);   // The cell it works on (loops test the cursor's)
+        long long value = getCell(&tape, here);
+        if(in->op == OP_OUT || in->op == OP_DUMP){     // Room for what it writes
+            size_t n = in->op == OP_OUT ? 1 : (size_t)(in->b - in->a + 1);
+            if(len + n > PREFIX_OUTPUT)
+                goto stop;
+            if(len + n > cap){
+                size_t grown_cap = cap ? cap * 2 : 4096;
+                unsigned char *grown = NULL;
+                while(grown_cap < len + n)
+                    grown_cap *= 2;
+                if((grown = (unsigned char *)realloc(output, grown_cap)) == NULL)
+                    goto stop;
+                output = grown;
+                cap = grown_cap;
+            }
+        }
+        switch(in->op){
+            case OP_MOVE:
+                if(in->a > last - cursor || in->a < -cursor)
+                    goto stop;
+                cursor += in->a;
+                break;
+            case OP_INC:
+                setCell(&tape, here, value + in->a);
+                break;
+            case OP_OUT:
+                output[len++] = (unsigned char)value;
+                break;
+            case OP_DUMP:
+                if(in->b > last)
+                    goto stop;
+                cursor = in->a;
+                for(long cell = in->a; cell <= in->b; ++cell){
+                    output[len++] = (unsigned char)getCell(&tape, cell);
+                    setCell(&tape, cell, 0);
+                }
+                break;
+            case OP_ADD:
+                if(value + in->a > max && opts->overflow == OVERFLOW_ERROR)
+                    goto stop;
+                setCell(&tape, here, value + in->a > max && opts->overflow == OVERFLOW_SATURATE ? max : value + in->a);
+                break;
+            case OP_SUB:
+                if(value - in->a < 0 && opts->overflow == OVERFLOW_ERROR)
+                    goto stop;
+                setCell(&tape, here, value - in->a < 0 && opts->overflow == OVERFLOW_SATURATE ? 0 : value - in->a);
+                break;
+            case OP_LOOP:
+                if(!value){
+                    i = in->a;
+                    continue;
+                }
+                break;
+            case OP_END:
+                if(value){
+                    if(taken + in->b > steps)
+                        goto stop;
+                    taken += in->b;
+                    i = in->a;
+                    continue;
+                }
+                break;
+            case OP_CLEAR:
+                setCell(&tape, here, 0);
+                break;
+            case OP_MUL_LOOP:
+                if(!value || in->off < -cursor || in->b > last - cursor){
+                    i = in->a;
+                    continue;
+                }
+                break;
+            case OP_MUL:
+                setCell(&tape, cursor + in->off, getCell(&tape, cursor + in->off) + value * in->a);
+                break;
+            case OP_SCAN:{
+                long zero = cursor;
+                while(getCell(&tape, zero) != 0){
+                    if(in->a > 0 ? in->a > last - zero : in->a < -zero)
+                        goto stop;                     // The run fails here
+                    zero += in->a;
+                }
+                if(taken + (unsigned long long)labs(zero - cursor) > steps)
+                    goto stop;
+                taken += (unsigned long long)labs(zero - cursor);
+                cursor = zero;
+                break;
+            }
+            case OP_BLOCK:
+                if(in->off < -cursor || in->b > last - cursor){
+                    i = in->a;
+                    continue;
+                }
+                break;
+            case OP_JUMP:
+                i = in->a;
+                continue;
+            default:                                   // OP_IN, OP_ERROR and OP_HALT
+                goto stop;
+        }
+        ++i;
+    }
+
+stop:
+    snap->cells = opts->cells;
+    snap->width = opts->width;
+    snap->overflow = opts->overflow;
+    snap->at = i;
+    snap->cursor = cursor;
+    snap->used = tape.used;
+    snap->output_len = len;
+    snap->steps = taken;
+    if((snap->own = malloc(tape.used * tape.width + len + 1)) == NULL){
+        free(tape.cells);
+        free(output);
+        free(snap);
+        return NULL;
+    }
+    memcpy(snap->own, tape.cells, tape.used * tape.width);  // Only the cells written to; the rest stay 0
+    if(len > 0)
+        memcpy((char *)snap->own + tape.used * tape.width, output, len);
+    snap->tape = (const char *)snap->own;
+    snap->output = (const unsigned char *)snap->own + tape.used * tape.width;
+    free(tape.cells);
+    free(output);
+    return snap;
+}
+
+// Whether a run with opts can start from snap: it was taken on the same tape, and the run's
+// --max-steps would not have stopped it before.
+_Bool prefixFits(const Snapshot *snap, const Options *opts){
+    return snap->cells == opts->cells && snap->width == opts->width && snap->overflow == opts->overflow
+           && (opts->max_steps == 0 || snap->steps <= opts->max_steps);
+}
+
+// Puts a run where snap left off: the cells it wrote on tape (zeroed, and as wide as snap's),
+// the cursor where it was, the input it read skipped and its output written to out.
+void resumeRun(const Snapshot *snap, Tape *tape, Output *out){
+    memcpy(tape->cells, snap->tape, snap->used * snap->width);
+    tape->cursor = snap->cursor;
+    out->written = snap->written;
+    skipInput(out, snap->input_read);
+    if(snap->output_len > 0)
+        writeOutput(out, snap->output, snap->output_len);
+}
+
+void freeSnapshot(Snapshot *snap){
+    if(snap != NULL)
+        free(snap->own);
+    free(snap);
+}
+
+static long long getCell(const Cells *tape, long cell){    // The same types as the engines, so values match
+    switch(tape->width){
+        case 1: return ((const char *)tape->cells)[cell];
+        case 2: return ((const short *)tape->cells)[cell];
+        default: return ((const int *)tape->cells)[cell];
+    }
+}
+
+static void setCell(Cells *tape, long cell, long long value){
+    switch(tape->width){
+        case 1: ((char *)tape->cells)[cell] = (char)value; break;
+        case 2: ((short *)tape->cells)[cell] = (short)value; break;
+        default: ((int *)tape->cells)[cell] = (int)value; break;
+    }
+    if(cell >= tape->used)
+        tape->used = cell + 1;
+}
@@ -0,0 +1,519 @@
+//
+//  profile.c
+//
+//  Screw Interpreter
+//
+//  --profile: the counts collected by the profiling engine are turned into
+//  a report of the hottest loops, keyed by the line and column of their '{',
+//  and optionally a JSON dump of every loop and instruction to diff between
+//  runs.
+//
+//  --profile-out FILE: the same counts, per loop, kept for a later run. A
+//  loop is keyed by the token of its '{', so a profile recorded at one -O
+//  level serves the others, and it records how often the loop was reached,
+//  how often its '{' skipped it and how many passes its body made: the bias
+//  of its '{' and '}' and its mean trip count. --profile-use FILE turns that
+//  back into a plan of the compiled code, for --jit and -c to follow: the
+//  loops that made enough passes are unrolled by their mean trip count, up to
+//  UNROLL_MAX copies, and the loops that were never entered are laid out of
+//  the way of the code around them.
+//
+//  --sample FILE: a cheaper look at the same thing. The sampled engine keeps
+//  a pointer to the instruction it is on where a SIGPROF handler can read
+//  it, and an ITIMER_PROF timer fires the handler every SAMPLE_US of CPU
+//  time the process spends (or every tick of the kernel's clock, if that is
+//  longer). The samples are written as collapsed stacks,
+//  one line per instruction that was hit, for flamegraph.pl and the tools
+//  that read its input: the program, the loops around the instruction from
+//  the outermost in (each by the line and column of its '{'), then the
+//  instruction and where it came from, and the samples that found it.
+//
+
+#include <stdio.h>
+#include <stdlib.h>         // For calloc(), qsort(), bsearch() and free()
+#include <string.h>         // For memset() and strcmp()
+#include <signal.h>         // For sigaction()
+#include <sys/time.h>       // For setitimer()
+#include "screw.h"
+
+#define NO_LOOP ((size_t)-1)    // The token outside every loop
+
+#define HOT_LOOPS 10        // Loops listed in the report
+#define UNROLL_PASSES 1000  // Fewest passes a loop made in the recorded run to be unrolled
+#define UNROLL_MAX 8        // Most copies of a loop body run at a time (fits PLAN_UNROLL)
+#define PROFILE_VERSION 1   // Bump whenever what a recorded profile holds changes
+
+typedef struct {            // A loop of the source, fused or not
+    int first;              // OP_LOOP or OP_MUL_LOOP it starts with
+    int end;                // Its last OP_END
+    unsigned long long entries;     // Times it was reached
+    unsigned long long passes;      // Times its body ran
+    unsigned long long inclusive;   // Instructions executed inside it, nested loops included
+    unsigned long long skipped;     // Times its '{' found the cell 0
+    Position at;            // Where its '{' is
+} Loop;
+
+typedef struct {            // A loop of a recorded profile
+    size_t token;           // Its '{'
+    unsigned long long entries, skipped, passes;
+} Record;
+
+static const char *const op_names[] = {
+    [OP_HALT] = "HALT", [OP_MOVE] = "MOVE", [OP_INC] = "INC", [OP_OUT] = "OUT",
+    [OP_IN] = "IN", [OP_DUMP] = "DUMP", [OP_ADD] = "ADD", [OP_SUB] = "SUB",
+    [OP_LOOP] = "LOOP", [OP_END] = "END", [OP_CLEAR] = "CLEAR",
+    [OP_MUL_LOOP] = "MUL_LOOP", [OP_MUL] = "MUL", [OP_SCAN] = "SCAN", [OP_BLOCK] = "BLOCK",
+    [OP_JUMP] = "JUMP", [OP_ERROR] = "ERROR"
+};
+
+static Sampler *volatile sampling = NULL;              // The sampler SIGPROF counts into
+static struct sigaction unsampled;                     // What SIGPROF did before
+
+static int countInstrs(const Instr *);                  // Number of instructions, OP_HALT included
+static int findLoops(const Profile *, const Instr *, int, unsigned long long *, Loop *); // The loops and their counts (-1: no memory)
+static int compareRecords(const void *, const void *);  // Lower token first
+static int compareHot(const void *, const void *);      // Most instructions executed first
+static int compareTokens(const void *, const void *);   // Lower token first
+static void takeSample(int);                            // SIGPROF handler
+static int writeJson(const Profile *, const Instr *, int, const Position *, const Loop *, int, unsigned long long, const char *);
+
+Profile *newProfile(const Instr *code){                 // Start an empty profile of code
+    int count = countInstrs(code);
+    Profile *prof = (Profile *)calloc(1, sizeof(Profile));
+
+    if(prof == NULL)
+        return NULL;
+    prof->counts = (unsigned long long *)calloc(count, sizeof(unsigned long long));
+    prof->passes = (unsigned long long *)calloc(count, sizeof(unsigned long long));
+    prof->skipped = (unsigned long long *)calloc(count, sizeof(unsigned long long));
+    if(prof->counts == NULL || prof->passes == NULL || prof->skipped == NULL){
+        freeProfile(prof);
+        return NULL;
+    }
+    return prof;
+}
+
+void freeProfile(Profile *prof){
+    if(prof == NULL)
+        return;
+    free(prof->counts);
+    free(prof->passes);
+    free(prof->skipped);
+    free(prof);
+}
+
+// Prints the report to stderr, after the program's own output, and writes the JSON dump
+// to json_path unless it is NULL. origins holds the token of every instruction.
+int reportProfile(const Profile *prof, const Instr *code, const size_t *origins, const Source *src, const char *json_path){
+    int count = countInstrs(code);
+    unsigned long long *before = NULL;                 // before[i]: instructions executed at indexes below i
+    Position *positions = NULL;                        // Where every instruction came from
+    Loop *loops = NULL, *hot = NULL;
+    int loop_count = 0;
+    int result = -1;
+
+    before = (unsigned long long *)malloc((count + 1) * sizeof(unsigned long long));
+    positions = (Position *)malloc(count * sizeof(Position));
+    loops = (Loop *)malloc(count * sizeof(Loop));
+    hot = (Loop *)malloc(count * sizeof(Loop));
+    if(before == NULL || positions == NULL || loops == NULL || hot == NULL
+       || locateTokens(src, origins, count, positions) != 0
+       || (loop_count = findLoops(prof, code, count, before, loops)) < 0){
+        fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+        goto done;
+    }
+    for(int i = 0; i < loop_count; ++i){
+        loops[i].at = positions[loops[i].first];
+        hot[i] = loops[i];
+    }
+    qsort(hot, loop_count, sizeof(Loop), compareHot);
+
+    fprintf(stderr, "%sProfile:%s %llu instructions executed, %d loops\n", YELLOW, RESET, before[count], loop_count);
+    fprintf(stderr, "  Tape: furthest cell reached %ld of %ld\n", prof->high, prof->cells - 1);
+    fprintf(stderr, "  I/O: %llu bytes written by '.', %llu read by '?', %llu written by '*'\n",
+            prof->out_bytes, prof->in_bytes, prof->dump_bytes);
+    if(loop_count > 0)
+        fprintf(stderr, "  %-12s %14s %16s %18s %7s\n", "Hot loops", "entries", "passes", "instructions", "share");
+    for(int i = 0; i < loop_count && i < HOT_LOOPS && hot[i].inclusive > 0; ++i){
+        char where[48];
+        snprintf(where, sizeof(where), "%zu:%zu", hot[i].at.line, hot[i].at.col);
+        fprintf(stderr, "  %-12s %14llu %16llu %18llu %6.1f%%\n", where, hot[i].entries, hot[i].passes,
+                hot[i].inclusive, 100.0 * hot[i].inclusive / before[count]);
+    }
+
+    result = 0;
+    if(json_path != NULL && writeJson(prof, code, count, positions, loops, loop_count, before[count], json_path) != 0){
+        fprintf(stderr, "%sError:%s Failed to write %s!\n", RED, RESET, json_path);
+        result = -1;
+    }
+
+done:
+    free(before);
+    free(positions);
+    free(loops);
+    free(hot);
+    return result;
+}
+
+// Writes the counts of every loop to path, keyed by the token of its '{' (origins holds the
+// token of every instruction), for planProfile() to read back.
+int recordProfile(const Profile *prof, const Instr *code, const size_t *origins, const Source *src, const char *path){
+    int count = countInstrs(code);
+    unsigned long long *before = (unsigned long long *)malloc((count + 1) * sizeof(unsigned long long));
+    Loop *loops = (Loop *)malloc(count * sizeof(Loop));
+    size_t *tokens = (size_t *)malloc(count * sizeof(size_t));
+    Position *positions = (Position *)malloc(count * sizeof(Position));
+    FILE *out = NULL;
+    int loop_count = 0, result = -1;
+
+    if(before == NULL || loops == NULL || tokens == NULL || positions == NULL
+       || (loop_count = findLoops(prof, code, count, before, loops)) < 0){
+        fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+        goto done;
+    }
+    for(int i = 0; i < loop_count; ++i)
+        tokens[i] = origins[loops[i].first];
+    if(locateTokens(src, tokens, loop_count, positions) != 0){
+        fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+        goto done;
+    }
+    if((out = fopen(path, "w")) == NULL){
+        fprintf(stderr, "%sError:%s Failed to write %s!\n", RED, RESET, path);
+        goto done;
+    }
+    fprintf(out, "scrint profile %d\nsource %016llx %zu\n", PROFILE_VERSION, hashSource(src), src->size);
+    fprintf(out, "# loop token line:col entries skipped passes\n");
+    for(int i = 0; i < loop_count; ++i)
+        fprintf(out, "loop %zu %zu:%zu %llu %llu %llu\n", tokens[i], positions[i].line, positions[i].col,
+                loops[i].entries, loops[i].skipped, loops[i].passes);
+    result = ferror(out) ? -1 : 0;
+    if(fclose(out) != 0 || result != 0){
+        fprintf(stderr, "%sError:%s Failed to write %s!\n", RED, RESET, path);
+        result = -1;
+    }
+
+done:
+    free(before);
+    free(loops);
+    free(tokens);
+    free(positions);
+    return result;
+}
+
+// Reads the profile recordProfile() wrote to path and plans code by it: a PLAN_* for every
+// OP_LOOP whose '{' it has counts for. Prints what is wrong and returns NULL if the profile
+// can't be used, such as one recorded of another source.
+unsigned char *planProfile(const char *path, const Instr *code, const size_t *origins, const Source *src){
+    int count = countInstrs(code);
+    unsigned char *plan = (unsigned char *)calloc(count, 1);
+    unsigned char *slow = (unsigned char *)calloc(count, 1);   // Original loops kept behind an OP_MUL_LOOP
+    Record *records = NULL, record;
+    size_t record_count = 0, cap = 0, size = 0;
+    unsigned long long key = 0;
+    int version = 0;
+    char word[16];
+    FILE *in = NULL;
+
+    if(plan == NULL || slow == NULL){
+        fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+        goto fail;
+    }
+    if((in = fopen(path, "r")) == NULL){
+        fprintf(stderr, "%sError:%s Could not open %s\n", RED, RESET, path);
+        goto fail;
+    }
+    if(fscanf(in, "scrint profile %d source %llx %zu", &version, &key, &size) != 3 || version != PROFILE_VERSION){
+        fprintf(stderr, "%sError:%s %s is not a profile\n", RED, RESET, path);
+        goto fail;
+    }
+    if(key != hashSource(src) || size != src->size){
+        fprintf(stderr, "%sError:%s %s is a profile of another program\n", RED, RESET, path);
+        goto fail;
+    }
+    while(fscanf(in, " %15s", word) == 1){
+        if(word[0] == '#'){                            // A comment, to the end of the line
+            int c = 0;
+            while((c = getc(in)) != EOF && c != '\n')
+                ;
+            continue;
+        }
+        if(strcmp(word, "loop") != 0 || fscanf(in, "%zu %*u:%*u %llu %llu %llu", &record.token, &record.entries,
+                                                 &record.skipped, &record.passes) != 4){
+            fprintf(stderr, "%sError:%s %s is cut short or damaged\n", RED, RESET, path);
+            goto fail;
+        }
+        if(record_count == cap){
+            Record *grown = (Record *)realloc(records, (cap = cap ? cap * 2 : 64) * sizeof(Record));
+            if(grown == NULL){
+                fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+                goto fail;
+            }
+            records = grown;
+        }
+        records[record_count++] = record;
+    }
+    fclose(in);
+    in = NULL;
+    if(record_count > 0)
+        qsort(records, record_count, sizeof(Record), compareRecords);
+
+    for(int i = 0; i < count; ++i)
+        if(code[i].op == OP_MUL_LOOP)
+            slow[code[i].a] = 1;
+    for(int i = 0; i < count; ++i){
+        const Record *loop = NULL;
+        unsigned long long entered = 0;
+        int copies = 1;
+        if(code[i].op != OP_LOOP || slow[i] || record_count == 0)
+            continue;
+        record.token = origins[i];
+        if((loop = (const Record *)bsearch(&record, records, record_count, sizeof(Record), compareRecords)) == NULL)
+            continue;                                  // Fused at the level it was recorded at
+        entered = loop->entries - loop->skipped;
+        if(entered == 0){
+            plan[i] = PLAN_COLD;
+            continue;
+        }
+        while(copies * 2 <= UNROLL_MAX && loop->passes >= UNROLL_PASSES && loop->passes / entered >= (unsigned long long)copies * 2)
+            copies *= 2;
+        plan[i] = copies > 1 ? (unsigned char)copies : 0;
+    }
+    free(records);
+    free(slow);
+    return plan;
+
+fail:
+    if(in != NULL)
+        fclose(in);
+    free(records);
+    free(slow);
+    free(plan);
+    return NULL;
+}
+
+static int writeJson(const Profile *prof, const Instr *code, int count, const Position *positions,
+                     const Loop *loops, int loop_count, unsigned long long total, const char *path){
+    FILE *out = fopen(path, "w");                      // One loop or instruction per line, in source order, so runs diff well
+
+    if(out == NULL)
+        return -1;
+    fprintf(out, "{\n\"executed\": %llu,\n\"tape_high\": %ld,\n", total, prof->high);
+    fprintf(out, "\"io\": {\"out\": %llu, \"in\": %llu, \"dump\": %llu},\n", prof->out_bytes, prof->in_bytes, prof->dump_bytes);
+    fprintf(out, "\"loops\": [\n");
+    for(int i = 0; i < loop_count; ++i)
+        fprintf(out, "  {\"line\": %zu, \"col\": %zu, \"entries\": %llu, \"passes\": %llu, \"instructions\": %llu}%s\n",
+                loops[i].at.line, loops[i].at.col, loops[i].entries, loops[i].passes, loops[i].inclusive,
+                i + 1 < loop_count ? "," : "");
+    fprintf(out, "],\n\"instructions\": [\n");
+    for(int i = 0; i < count; ++i)
+        fprintf(out, "  {\"index\": %d, \"op\": \"%s\", \"line\": %zu, \"col\": %zu, \"count\": %llu}%s\n",
+                i, op_names[code[i].op], positions[i].line, positions[i].col, prof->counts[i], i + 1 < count ? "," : "");
+    fprintf(out, "]\n}\n");
+    if(ferror(out)){
+        fclose(out);
+        return -1;
+    }
+    return fclose(out) == 0 ? 0 : -1;
+}
+
+// Starts sampling where the sampled engine is in code: the run that is given the Sampler
+// (in its Options) is then sampled until stopSampler(). Returns NULL if it can't be.
+Sampler *startSampler(const Instr *code){
+    Sampler *sampler = (Sampler *)calloc(1, sizeof(Sampler));
+    struct sigaction action;
+    struct itimerval every;
+
+    if(sampler == NULL)
+        return NULL;
+    sampler->count = countInstrs(code);
+    if((sampler->hits = (unsigned long long *)calloc(sampler->count, sizeof(unsigned long long))) == NULL){
+        freeSampler(sampler);
+        return NULL;
+    }
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = takeSample;
+    action.sa_flags = SA_RESTART;                      // Reads and writes of the program go on after a sample
+    sigemptyset(&action.sa_mask);
+    every.it_interval.tv_sec = every.it_value.tv_sec = 0;
+    every.it_interval.tv_usec = every.it_value.tv_usec = SAMPLE_US;
+    sampling = sampler;
+    if(sigaction(SIGPROF, &action, &unsampled) != 0)
+        goto fail;
+    if(setitimer(ITIMER_PROF, &every, NULL) != 0){
+        sigaction(SIGPROF, &unsampled, NULL);
+        goto fail;
+    }
+    return sampler;
+
+fail:
+    sampling = NULL;
+    freeSampler(sampler);
+    return NULL;
+}
+
+void stopSampler(Sampler *sampler){                    // Stop the timer, keeping the samples taken
+    struct itimerval never;
+
+    memset(&never, 0, sizeof(never));
+    setitimer(ITIMER_PROF, &never, NULL);
+    sigaction(SIGPROF, &unsampled, NULL);
+    if(sampling == sampler)
+        sampling = NULL;
+}
+
+void freeSampler(Sampler *sampler){
+    if(sampler == NULL)
+        return;
+    free(sampler->hits);
+    free(sampler);
+}
+
+// Writes the samples to path as collapsed stacks, nesting every instruction in the loops of
+// the source around the token it came from (origins holds the token of every instruction),
+// and says on stderr how many there were.
+int reportSamples(const Sampler *sampler, const Instr *code, const size_t *origins, const Source *src, const char *path){
+    int count = countInstrs(code);
+    size_t braces = 0;                                 // Loops in the source
+    size_t *outer = NULL;                              // outer[t]: '{' of the innermost loop around token t ('{' are outside their own)
+    size_t *wanted = NULL;                             // Tokens to locate: every instruction's, then every '{' in order
+    Position *positions = NULL;                        // Where they are
+    size_t *frames = NULL;                             // The loops around an instruction, innermost first
+    size_t open = NO_LOOP;                             // Innermost loop around the token
+    unsigned long long in_program = 0;                 // Samples that found the engine on an instruction
+    FILE *out = NULL;
+    int result = -1;
+
+    for(size_t t = 0; t < src->count; ++t)
+        braces += src->tokens[t] == '{';
+    outer = (size_t *)malloc((src->count + 1) * sizeof(size_t));
+    wanted = (size_t *)malloc((count + braces) * sizeof(size_t));
+    positions = (Position *)malloc((count + braces) * sizeof(Position));
+    frames = (size_t *)malloc((braces + 1) * sizeof(size_t));
+    if(outer == NULL || wanted == NULL || positions == NULL || frames == NULL){
+        fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+        goto done;
+    }
+    braces = 0;
+    for(size_t t = 0; t <= src->count; ++t){           // The '~' too, which OP_HALT comes from
+        outer[t] = open;
+        if(src->tokens[t] == '{'){
+            wanted[count + braces++] = t;
+            open = t;
+        }
+        else if(src->tokens[t] == '}')
+            open = outer[open];
+    }
+    for(int i = 0; i < count; ++i)
+        wanted[i] = origins[i];
+    if(locateTokens(src, wanted, count + braces, positions) != 0){
+        fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+        goto done;
+    }
+    if((out = fopen(path, "w")) == NULL){
+        fprintf(stderr, "%sError:%s Failed to write %s!\n", RED, RESET, path);
+        goto done;
+    }
+
+    for(int i = 0; i < count; ++i){
+        size_t token = origins[i], depth = 0;
+        if(sampler->hits[i] == 0)
+            continue;
+        for(size_t loop = src->tokens[token] == '{' ? token : outer[token]; loop != NO_LOOP; loop = outer[loop])
+            frames[depth++] = loop;
+        fprintf(out, "%s", src->name);
+        while(depth-- > 0){
+            const size_t *brace = (const size_t *)bsearch(&frames[depth], &wanted[count], braces, sizeof(size_t), compareTokens);
+            const Position *at = &positions[brace - wanted];
+            fprintf(out, ";loop %zu:%zu", at->line, at->col);
+        }
+        fprintf(out, ";%s %zu:%zu %llu\n", op_names[code[i].op], positions[i].line, positions[i].col, sampler->hits[i]);
+        in_program += sampler->hits[i];
+    }
+    result = ferror(out) ? -1 : 0;
+    if(fclose(out) != 0 || result != 0){
+        fprintf(stderr, "%sError:%s Failed to write %s!\n", RED, RESET, path);
+        result = -1;
+        goto done;
+    }
+    fprintf(stderr, "%sSamples:%s %llu taken, one every %d us of CPU time, %llu in the program, written to %s\n",
+            YELLOW, RESET, sampler->taken, SAMPLE_US, in_program, path);
+
+done:
+    free(outer);
+    free(wanted);
+    free(positions);
+    free(frames);
+    return result;
+}
+
+static void takeSample(int signal){                    // Count a sample against the instruction the engine is on
+    Sampler *sampler = sampling;
+    const char *ip = NULL, *code = NULL;
+
+    (void)signal;
+    if(sampler == NULL)
+        return;
+    ip = (const char *)sampler->ip;
+    code = (const char *)sampler->code;
+    if(ip != NULL && code != NULL && ip >= code && ip < code + sampler->count * sampler->stride)
+        ++sampler->hits[(ip - code) / sampler->stride];
+    ++sampler->taken;
+}
+
+// Fills loops with every loop of code (count instructions) that prof counted, fused or not,
+// and before[i] with the instructions executed at indexes below i. Returns how many loops.
+static int findLoops(const Profile *prof, const Instr *code, int count, unsigned long long *before, Loop *loops){
+    unsigned char *slow = (unsigned char *)calloc(count, 1);   // Original loops kept behind an OP_MUL_LOOP
+    int loop_count = 0;
+
+    if(slow == NULL)
+        return -1;
+    before[0] = 0;
+    for(int i = 0; i < count; ++i){
+        before[i + 1] = before[i] + prof->counts[i];
+        if(code[i].op == OP_MUL_LOOP)
+            slow[code[i].a] = 1;
+    }
+    for(int i = 0; i < count; ++i){
+        Loop *loop = &loops[loop_count];
+        if(code[i].op == OP_LOOP && !slow[i])
+            loop->end = code[i].a - 1;
+        else if(code[i].op == OP_MUL_LOOP)
+            loop->end = code[code[i].a].a - 1;
+        else
+            continue;
+        loop->first = i;
+        loop->entries = prof->counts[i];
+        loop->skipped = prof->skipped[code[i].op == OP_LOOP ? i : code[i].a];
+        loop->passes = prof->counts[loop->end] + prof->passes[i];
+        loop->inclusive = before[loop->end + 1] - before[i];
+        ++loop_count;
+    }
+    free(slow);
+    return loop_count;
+}
+
+static int countInstrs(const Instr *code){
+    int count = 1;
+
+    while(code[count - 1].op != OP_HALT)
+        ++count;
+    return count;
+}
+
+static int compareHot(const void *a, const void *b){
+    unsigned long long x = ((const Loop *)a)->inclusive, y = ((const Loop *)b)->inclusive;
+    if(x != y)
+        return x < y ? 1 : -1;
+    return ((const Loop *)a)->first - ((const Loop *)b)->first;   // Ties in source order
+}
+
+static int compareRecords(const void *a, const void *b){
+    size_t x = ((const Record *)a)->token, y = ((const Record *)b)->token;
+    return x < y ? -1 : x > y;
+}
+
+static int compareTokens(const void *a, const void *b){
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+    return x < y ? -1 : x > y;
+}
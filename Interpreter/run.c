@@ -0,0 +1,281 @@
+//
+//  run.c
+//
+//  Screw Interpreter
+//
+//  Executes compiled screw programs.
+//
+
+#include <stdio.h>
+#include <stdlib.h>         // For malloc() and free()
+#include <string.h>         // For memset()
+#include <unistd.h>         // For STDOUT_FILENO
+#include <time.h>           // For clock_gettime()
+#include "screw.h"
+
+const char *errorMessage(int error){                    // Message for a runtime error ('%c' stands for the offending symbol)
+    switch(error){
+        case ERR_SHIFT_RIGHT: return "Invalid instruction, cannot shift right anymore! Exiting...";
+        case ERR_SHIFT_LEFT: return "Invalid instruction, cannot shift left anymore! Exiting...";
+        case ERR_DUMP_LOWER: return "Cell Dumping - Expected integer for lower bound!";
+        case ERR_DUMP_RANGE: return "Cell Dumping may only be applied to cells on the tape";
+        case ERR_DUMP_CARET: return "Cell Dumping - Expected '^'";
+        case ERR_DUMP_UPPER: return "Cell Dumping - Expected integer for upper bound!";
+        case ERR_DUMP_ORDER: return "Cell Dumping - Lower bound is greater than upper bound!";
+        case ERR_ADD_INT: return "Add - Expected integer!";
+        case ERR_ADD_OVERFLOW: return "Add - Cell Overflow!";
+        case ERR_SUB_INT: return "Sub - Expected integer!";
+        case ERR_SUB_OVERFLOW: return "Sub - Cell Overflow!";
+        case ERR_STEP_LIMIT: return "Step limit reached! Exiting...";
+        case ERR_TIMEOUT: return "Time limit reached! Exiting...";
+        default: return "Unknown symbol '%c' found!";
+    }
+}
+
+void runtimeError(int error, char symbol){             // Print the message for a runtime error
+    fprintf(stderr, "%sError:%s ", RED, RESET);
+    fprintf(stderr, errorMessage(error), symbol);
+    fprintf(stderr, "\n");
+}
+
+typedef struct {                                       // A pre-decoded instruction for direct-threaded dispatch
+    const void *handler;                               // Address of the code that runs it
+    int off;
+    int a;
+    int b;
+} Thread;
+
+static _Thread_local Thread *decoded = NULL;           // Program pre-decoded by the threaded engine on this thread, until it returns
+
+typedef int Engine(const Instr *, Tape *, Output *, Profile *, Budget *);
+
+static int runGuarded(Engine *, const Instr *, Tape *, Output *, Budget *);    // Run an engine, catching faults in the guards
+static void grant(Budget *);                           // Hand out the steps the engine may take before charging again
+static double now(void);                               // Seconds on a monotonic clock
+
+// One engine for every cell width, overflow policy and bounds policy, so each only runs the
+// checks it needs: the switch engine is portable, the threaded one needs labels as values (a
+// GCC extension clang has too), and --profile and --sample get their own so the others don't
+// pay for them. Runs with --max-steps, --timeout, --checkpoint-every or --stats-file take a
+// threaded engine that counts steps, so runs without them don't pay for that either.
+#define ENGINE_ID(kind, overflow, checked) ENGINE_ID_(kind, CELL_BITS, overflow, checked)
+#define ENGINE_ID_(kind, bits, overflow, checked) ENGINE_ID__(kind, bits, overflow, checked)
+#define ENGINE_ID__(kind, bits, overflow, checked) kind##bits##_##overflow##checked
+
+_Static_assert(OVERFLOW_ERROR == 0 && OVERFLOW_WRAP == 1 && OVERFLOW_SATURATE == 2, "ON_OVERFLOW takes these values");
+
+#define CELL char
+#define UCELL unsigned char
+#define CELL_MAX 127
+#define CELL_BYTE 1
+#define CELL_BITS 8
+#include "engines.h"
+#undef CELL
+#undef UCELL
+#undef CELL_MAX
+#undef CELL_BYTE
+#undef CELL_BITS
+
+#define CELL short
+#define UCELL unsigned short
+#define CELL_MAX 32767
+#define CELL_BYTE 0
+#define CELL_BITS 16
+#include "engines.h"
+#undef CELL
+#undef UCELL
+#undef CELL_MAX
+#undef CELL_BYTE
+#undef CELL_BITS
+
+#define CELL int
+#define UCELL unsigned int
+#define CELL_MAX 2147483647
+#define CELL_BYTE 0
+#define CELL_BITS 32
+#include "engines.h"
+
+#define BY_CHECKS(kind, bits, overflow) { kind##bits##_##overflow##0, kind##bits##_##overflow##1 }
+#define BY_POLICY(kind, bits) { BY_CHECKS(kind, bits, 0), BY_CHECKS(kind, bits, 1), BY_CHECKS(kind, bits, 2) }
+
+static Engine *const switch_engines[3][3][2] = {      // [width 1, 2, 4][OVERFLOW_*][moves checked]
+    BY_POLICY(runSwitch, 8), BY_POLICY(runSwitch, 16), BY_POLICY(runSwitch, 32)
+};
+#if defined(__GNUC__)
+static Engine *const threaded_engines[3][3][2] = {
+    BY_POLICY(runThreaded, 8), BY_POLICY(runThreaded, 16), BY_POLICY(runThreaded, 32)
+};
+static Engine *const limited_engines[3][3][2] = {
+    BY_POLICY(runLimited, 8), BY_POLICY(runLimited, 16), BY_POLICY(runLimited, 32)
+};
+#endif
+static Engine *const profiled_engines[3][3] = {
+    { runProfiled8_01, runProfiled8_11, runProfiled8_21 },
+    { runProfiled16_01, runProfiled16_11, runProfiled16_21 },
+    { runProfiled32_01, runProfiled32_11, runProfiled32_21 }
+};
+static Engine *const sampled_engines[3][3] = {
+    { runSampled8_01, runSampled8_11, runSampled8_21 },
+    { runSampled16_01, runSampled16_11, runSampled16_21 },
+    { runSampled32_01, runSampled32_11, runSampled32_21 }
+};
+
+// Executes a compiled screw program (counting into prof unless NULL), printing its runtime
+// error. Returns what execute() does; budget (unless NULL) tells how far a stopped run got.
+int run(const Instr *code, const Options *opts, Profile *prof, Budget *budget){
+    Output out;                                        // Program output, written according to the flush mode
+    int result = 0;                                    // What the program ended with
+
+    initOutput(&out, STDOUT_FILENO, opts->flush);
+    if(opts->input != NULL)                            // --input
+        feedInput(&out, opts->input, opts->input_len);
+    result = execute(code, opts, &out, prof, budget);
+    if(result == -1)
+        fprintf(stderr, "%sError:%s Malloc() failed to allocate memory! Exiting...\n", RED, RESET);
+    else if(result != 0)
+        runtimeError(result & 0xff, (char)(result >> 8));
+    return result;
+}
+
+// Runs code on a fresh tape with out for I/O, and flushes out. Returns 0, the runtime error
+// (with the offending symbol in bits 8-15), or -1 if there is no memory for the tape.
+int execute(const Instr *code, const Options *opts, Output *out, Profile *prof, Budget *budget){
+    Tape tape;                                         // Memory cells initialized to 0
+    int result = -1;                                   // What the program ended with
+
+    if(newTape(&tape, opts->cells, opts->width, opts->tape) != 0)
+        return -1;
+    result = executeOn(code, opts, &tape, out, prof, budget);
+    freeTape(&tape);
+    return result;
+}
+
+// Runs code on tape, which the caller allocated (with newTape() and the width in opts) and
+// zeroed, and flushes out; a run with a start in opts goes on from there, and one with stats
+// in opts reports how far it got as it goes and once it is over. Returns 0 or the
+// runtime error. The tape is left the way the program left it, and budget (unless NULL) the
+// way the limits in opts left it.
+int executeOn(const Instr *code, const Options *opts, Tape *tape, Output *out, Profile *prof, Budget *budget){
+    int width = opts->width == 4 ? 2 : opts->width == 2 ? 1 : 0;
+    int checked = opts->tape != TAPE_UNCHECKED;
+    Engine *engine = switch_engines[width][opts->overflow][checked];
+    Budget own;                                        // The budget, if the caller doesn't want it back
+    int result = -1;                                   // What the program ended with
+
+#if defined(__GNUC__)
+    if(opts->engine == ENGINE_THREADED)
+        engine = (opts->max_steps != 0 || opts->timeout_ms != 0 || opts->checkpoint != NULL || opts->stats != NULL
+                  ? limited_engines : threaded_engines)[width][opts->overflow][checked];
+#endif
+    if(opts->sampler != NULL)
+        engine = sampled_engines[width][opts->overflow];
+    out->eof = opts->eof;
+    if(budget == NULL)
+        budget = &own;
+    startBudget(budget, opts);
+    if(opts->stats != NULL){                           // What its reports are about
+        opts->stats->tape = tape;
+        opts->stats->out = out;
+    }
+    if(opts->checkpoint != NULL){                      // What its checkpoints are taken of
+        opts->checkpoint->tape = tape;
+        opts->checkpoint->out = out;
+    }
+    if(opts->start != NULL)                            // Pick up where the snapshot stopped
+        resumeRun(opts->start, tape, out);
+    if(prof != NULL){
+        prof->cells = tape->size;
+        result = profiled_engines[width][opts->overflow](code, tape, out, prof, budget);
+    }
+    else if((result = runGuarded(engine, code, tape, out, budget)) == -1 && opts->sampler == NULL) // The threaded engine had no memory to pre-decode into
+        result = runGuarded(switch_engines[width][opts->overflow][checked], code, tape, out, budget);
+    flushOutput(out);                                  // Everything the program printed comes before its error
+    if(opts->stats != NULL)
+        writeStats(opts->stats, budget, 0);            // The last report says the run is over
+    return result;
+}
+
+// Runs an engine, turning a fault in the guards of tape into the error it stands for.
+// Kept out of the engines: sigsetjmp() there would slow every instruction.
+static int runGuarded(Engine *engine, const Instr *code, Tape *tape, Output *out, Budget *budget){
+    sigjmp_buf fault;                                  // Where a move off the tape into a guard lands
+    int result = 0;
+
+    if(tape->map == NULL)
+        return engine(code, tape, out, NULL, budget);
+    if(sigsetjmp(fault, 1) != 0){
+        free(decoded);                                 // Left behind by a threaded engine
+        decoded = NULL;
+        return tapeFault();
+    }
+    armTape(tape, &fault);
+    result = engine(code, tape, out, NULL, budget);
+    disarmTape();
+    return result;
+}
+
+void startBudget(Budget *budget, const Options *opts){ // Take the limits of a run and start its clock
+    budget->max_steps = opts->max_steps;
+    budget->timeout_ms = opts->timeout_ms;
+    budget->start = now();
+    budget->steps = opts->start != NULL ? opts->start->steps : 0;  // Steps taken at compile time count too
+    budget->at = opts->start != NULL ? opts->start->at : 0;
+    budget->checkpoint = opts->checkpoint;
+    if(budget->checkpoint != NULL)
+        budget->checkpoint->next = budget->steps + budget->checkpoint->every;
+    budget->sampler = opts->sampler;
+    budget->stats = opts->stats;
+    if(budget->stats != NULL){
+        budget->stats->due_ms = 0;                     // The first report is at the first charge
+        budget->stats->last_ms = 0;
+        budget->stats->last_steps = budget->steps;
+    }
+    grant(budget);
+}
+
+// Called by an engine at instruction at, with the cursor on cell cursor, once the fuel it was
+// granted has run out (gone below 0). Counts the grant as taken and returns the limit that was
+// reached, or 0 after taking a checkpoint and writing the stats file if either is due and
+// refilling fuel with the next grant. Engines only charge steps at loop back-edges and scans,
+// so the clock is read once every STEP_BATCH steps at most.
+int chargeBudget(Budget *budget, long long *fuel, int at, long cursor){
+    budget->steps += (unsigned long long)(budget->granted - *fuel);
+    budget->at = at;
+    if(budget->max_steps != 0 && budget->steps > budget->max_steps)
+        return ERR_STEP_LIMIT;
+    if(budget->timeout_ms != 0 && elapsedMs(budget) >= budget->timeout_ms)
+        return ERR_TIMEOUT;
+    if(budget->checkpoint != NULL && budget->steps >= budget->checkpoint->next){
+        takeCheckpoint(budget->checkpoint, at, cursor, budget->steps);
+        budget->checkpoint->next = budget->steps + budget->checkpoint->every;
+    }
+    if(budget->stats != NULL && elapsedMs(budget) >= budget->stats->due_ms)
+        writeStats(budget->stats, budget, 1);
+    grant(budget);
+    *fuel = budget->granted;
+    return 0;
+}
+
+long elapsedMs(const Budget *budget){                  // Milliseconds since the run started
+    return (long)((now() - budget->start) * 1000);
+}
+
+static void grant(Budget *budget){                     // Up to the step limit or the next checkpoint, in batches under a timeout or stats file
+    long long left = 1LL << 62;                        // Never runs out, and can't overflow once spent
+
+    if(budget->max_steps != 0 && budget->steps >= budget->max_steps)
+        left = 0;                                      // A restored run already past it stops at its first charge
+    else if(budget->max_steps != 0 && budget->max_steps - budget->steps < (unsigned long long)left)
+        left = (long long)(budget->max_steps - budget->steps);
+    if(budget->checkpoint != NULL && budget->checkpoint->next - budget->steps < (unsigned long long)left)
+        left = (long long)(budget->checkpoint->next - budget->steps);
+    if((budget->timeout_ms != 0 || budget->stats != NULL) && left > STEP_BATCH)
+        left = STEP_BATCH;
+    budget->granted = left;
+}
+
+static double now(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
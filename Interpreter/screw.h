@@ -0,0 +1,353 @@
+//
+//  screw.h
+//
+//  Screw Interpreter
+//
+//  Definitions shared by the compiler and the runtime.
+//
+
+#ifndef SCREW_H
+#define SCREW_H
+
+#include <stdio.h>
+#include <setjmp.h>         // For sigjmp_buf
+
+#define CELLS 60000             // How many memory cells there will be
+#define OUTPUT_BUFFER 65536     // Bytes of program output held before writing
+#define INPUT_BUFFER 65536      // Bytes of standard input read at a time
+#define OPERAND_MAX 0x3fffffff  // Largest operand kept after decoding or folding (bigger values always fail their checks)
+#define CELLS_MIN 10            // Smallest tape --cells allows
+#define GUARD_CELLS 65536       // Cells of guard at each end of a guard tape; no unchecked move goes further
+#define STEP_BATCH 65536        // Steps run between looks at the clock under --timeout
+#define PREFIX_STEPS 1000000    // Steps a program may run at compile time before it needs input (--prefix-steps)
+#define CHECKPOINT_PAGE 4096    // Bytes of tape in a page of a checkpoint file; pages of zeros are left out
+#define SAMPLE_US 1000          // Microseconds of CPU time between samples under --sample
+#define STATS_MS 1000           // Milliseconds between rewrites of --stats-file
+#define EXIT_LIMIT 124          // Exit status of a run stopped by --max-steps or --timeout (the same as timeout(1))
+#define RESET "\033[0m"         // Default color
+#define RED "\033[0;31m"        // Red
+#define YELLOW "\033[0;33m"     // Yellow
+
+enum {                          // Operations of a compiled screw program
+    OP_HALT,                    // '~'  : End of program
+    OP_MOVE,                    // '>'/'<' : Shift a cells (negative is left)
+    OP_INC,                     // '+'/'-' : Add a to cell, wrapping around
+    OP_OUT,                     // '.'  : Output cell
+    OP_IN,                      // '?'  : Input cell
+    OP_DUMP,                    // '*'  : Dump cells a through b
+    OP_ADD,                     // 'A'  : Add a to cell
+    OP_SUB,                     // 'S'  : Subtract a from cell
+    OP_LOOP,                    // '{'  : Jump to instruction a if cell is 0
+    OP_END,                     // '}'  : Jump to instruction a if cell is not 0, counting b steps
+    OP_CLEAR,                   // "{-}": Set cell to 0
+    OP_MUL_LOOP,                // Start of a multiply loop, jump to instruction a if cell is 0, cells off through b must exist
+    OP_MUL,                     // Add cell times a to the cell off cells away
+    OP_SCAN,                    // "{>}", "{<<}": Shift a cells at a time until cell is 0
+    OP_BLOCK,                   // Start of offset-addressed code, jump to its original code at instruction a unless
+                                // cells off through b exist
+    OP_JUMP,                    // Jump to instruction a
+    OP_ERROR                    // Malformed instruction, raises runtime error a (b is the offending symbol)
+};
+
+enum {                          // Runtime errors
+    ERR_SHIFT_RIGHT = 1,
+    ERR_SHIFT_LEFT,
+    ERR_DUMP_LOWER,
+    ERR_DUMP_RANGE,
+    ERR_DUMP_CARET,
+    ERR_DUMP_UPPER,
+    ERR_DUMP_ORDER,
+    ERR_ADD_INT,
+    ERR_ADD_OVERFLOW,
+    ERR_SUB_INT,
+    ERR_SUB_OVERFLOW,
+    ERR_UNKNOWN_SYMBOL,
+    ERR_STEP_LIMIT,             // --max-steps ran out
+    ERR_TIMEOUT                 // --timeout ran out
+};
+
+enum {                          // Interpreter engines
+    ENGINE_THREADED,            // Direct-threaded dispatch (falls back to ENGINE_SWITCH without GCC extensions)
+    ENGINE_SWITCH               // Switch dispatch
+};
+
+enum {                          // Kinds of tape
+    TAPE_GUARD,                 // mmap'd between guard pages, most moves unchecked (falls back to TAPE_CHECKED)
+    TAPE_CHECKED,               // Every move checked
+    TAPE_UNCHECKED              // Trusted code: no move checked, only the guard pages catch the near misses
+};
+
+enum {                          // What 'A' and 'S' do when the result leaves 0 through the largest cell value
+    OVERFLOW_ERROR,             // Raise ERR_ADD_OVERFLOW/ERR_SUB_OVERFLOW
+    OVERFLOW_WRAP,              // Wrap around like '+' and '-'
+    OVERFLOW_SATURATE           // Stop at 0 or the largest value
+};
+
+enum {                          // What '?' sets the cell to once the input has ended
+    EOF_MINUS1,                 // -1 (255 as a byte), what getchar() gave
+    EOF_ZERO,                   // 0
+    EOF_KEEP                    // Leave the cell as it is
+};
+
+enum {                          // Instruction flags
+    F_PROBED = 1,               // OP_MOVE whose next instruction uses the new cell, so a guard page catches it
+    F_SAFE = 2,                 // OP_MOVE, OP_ADD, OP_SUB, OP_MUL_LOOP or OP_BLOCK whose check proveChecks() showed
+                                // can't fail; on OP_LOOP, no check inside the loop is left
+    F_COVERED = 4               // OP_MOVE ending offset-addressed code, which its OP_BLOCK already checked
+};
+
+enum {                          // What --profile-use decided for the loop an OP_LOOP starts
+    PLAN_UNROLL = 0x0f,         // Copies of its body to run for one check of the cells they reach (0: as it is)
+    PLAN_COLD = 0x10            // Never entered in the recorded run: laid out of the way
+};
+
+enum {                          // Errors found while tokenizing a screw file
+    SRC_OK,
+    SRC_NO_END,                 // No '~'
+    SRC_UNMATCHED_OPEN,         // '{' without a '}'
+    SRC_UNMATCHED_CLOSE,        // '}' without a '{'
+    SRC_NO_MEMORY
+};
+
+enum {                          // When buffered program output is written
+    FLUSH_FULL,                 // Only when the buffer fills up, and at the end
+    FLUSH_LINE,                 // Also after every newline and before every '?'
+    FLUSH_INPUT                 // Also before every '?'
+};
+
+typedef struct {                // Buffered program output (and buffered input)
+    unsigned char buf[OUTPUT_BUFFER];
+    size_t len;                 // Bytes waiting in buf
+    int fd;                     // Where the output goes (-1: into capture)
+    int mode;                   // When it is written (FLUSH_*)
+    unsigned char *capture;     // Output kept in memory, if fd is -1
+    size_t captured;            // Bytes in capture
+    size_t capture_cap;         // Bytes capture has room for
+    const unsigned char *input; // Input not yet read: in_buf, or a block of memory given whole
+    size_t input_len;           // Bytes in input
+    size_t input_pos;           // Bytes of input read so far
+    unsigned long long input_base;  // Bytes of input read before the ones in input
+    int in_fd;                  // Where in_buf is refilled from once input runs out (-1: nowhere)
+    int eof;                    // What '?' sets the cell to after the end of the input (EOF_*)
+    unsigned char in_buf[INPUT_BUFFER];
+    void (*put)(void *, const void *, size_t);  // Where output goes instead, if not NULL
+    int (*get)(void *);         // Where input comes from instead, if not NULL (-1 at the end)
+    void *user;                 // Passed to put and get
+    unsigned long long written; // Bytes of output sent on so far
+} Output;
+
+typedef struct {                // A loaded screw file
+    const char *name;           // File name, for error messages
+    const char *text;           // The file, memory-mapped (NULL if empty)
+    size_t size;                // Bytes in text
+    char *tokens;               // Code without comments and whitespace, ending with '~'
+    size_t count;               // Tokens before the '~'
+    size_t error_at;            // Byte a tokenizing error is about
+} Source;
+
+typedef struct {                // What a program did before it needed input, run at compile time (prefix.c)
+    long cells;                 // Length of the tape it ran on
+    int width;                  // Bytes in a cell
+    int overflow;               // What 'A' and 'S' did past the cell range (OVERFLOW_*)
+    int at;                     // Instruction it goes on from
+    long cursor;                // Cell the cursor is on
+    long used;                  // Cells from the first that were written to (the rest are 0)
+    const char *tape;           // Those cells
+    size_t output_len;          // Bytes it wrote
+    const unsigned char *output;    // What it wrote
+    unsigned long long steps;   // Steps it took
+    unsigned long long input_read;  // Bytes of input it read, which the run skips
+    unsigned long long written; // Bytes it wrote before output, which are already out
+    void *own;                  // Memory holding tape and output (NULL if mapped from the cache)
+} Snapshot;
+
+typedef struct Checkpoint Checkpoint;
+typedef struct Sampler Sampler;
+typedef struct Stats Stats;
+
+typedef struct {                // How a compiled program is run
+    int engine;                 // Interpreter engine (ENGINE_*)
+    int flush;                  // When output is written (FLUSH_*)
+    long cells;                 // Length of the tape
+    int tape;                   // Kind of tape (TAPE_*)
+    int width;                  // Bytes in a cell: 1, 2 or 4
+    int overflow;               // What 'A' and 'S' do past the cell range (OVERFLOW_*)
+    int eof;                    // What '?' does at the end of the input (EOF_*)
+    const void *input;          // Input to read instead of stdin, such as a mapped file (NULL: stdin)
+    size_t input_len;           // Bytes in input
+    unsigned long long max_steps;   // Steps the run may take (0: no limit)
+    long timeout_ms;            // Milliseconds the run may take (0: no limit)
+    const Snapshot *start;      // Where the run starts (NULL: at the first instruction, on a zeroed tape)
+    Checkpoint *checkpoint;     // Where the run writes checkpoints (NULL: nowhere)
+    Sampler *sampler;           // Where the run says which instruction it is on (NULL: it doesn't)
+    Stats *stats;               // Where the run reports how far it got as it goes (NULL: nowhere)
+    const unsigned char *plan;  // PLAN_* of every instruction, from a recorded run (NULL: none); only --jit and -c use it
+} Options;
+
+typedef struct {                // The memory cells of a run
+    char *cells;                // First cell
+    long size;                  // Number of cells
+    int width;                  // Bytes in a cell
+    void *map;                  // Mapping the cells sit in, guards included (NULL if not a guard tape)
+    size_t map_len;             // Bytes in map
+    size_t guard_len;           // Bytes of guard at each end of map
+    _Bool exact_left;           // True if the cell before the first is in a guard
+    _Bool exact_right;          // True if the cell after the last is in a guard
+    long cursor;                // Cell the cursor starts on
+} Tape;
+
+typedef struct {                // Where a token is in its source file
+    size_t line;
+    size_t col;
+} Position;
+
+typedef struct {                // What a profiled run did (--profile)
+    unsigned long long *counts; // Executions of each instruction
+    unsigned long long *passes; // Body passes done by each OP_MUL_LOOP without running its loop
+    unsigned long long *skipped;    // Times each OP_LOOP found its cell 0 and skipped its loop
+    long high;                  // Furthest cell the cursor reached or an instruction changed
+    long cells;                 // Length of the tape
+    unsigned long long out_bytes;   // Bytes written by '.'
+    unsigned long long in_bytes;    // Bytes read by '?' (EOF included)
+    unsigned long long dump_bytes;  // Bytes written by '*'
+} Profile;
+
+typedef struct {                // How far a run may go (--max-steps, --timeout) and how far it got
+    unsigned long long max_steps;   // Steps allowed (0: no limit)
+    long timeout_ms;            // Milliseconds allowed (0: no limit)
+    double start;               // When the run started, in seconds on a monotonic clock
+    unsigned long long steps;   // Steps taken before the current grant
+    long long granted;          // Steps in the current grant, which the engine counts down
+    int at;                     // Instruction the run starts at, then the one it was stopped at
+    Checkpoint *checkpoint;     // Where checkpoints are written as steps are charged (NULL: nowhere)
+    Sampler *sampler;           // Where the engine keeps the instruction it is on (NULL: nowhere)
+    Stats *stats;               // Where the steps are reported as they are charged (NULL: nowhere)
+} Budget;
+
+typedef struct {                // A single compiled instruction
+    unsigned char op;           // Operation (OP_*)
+    unsigned char flags;        // Operation specific flags (F_*)
+    int off;                    // Cell offset from the cursor
+    int a;                      // First operand
+    int b;                      // Second operand
+} Instr;
+
+struct Checkpoint {             // Where a run writes its state every so many steps (--checkpoint-every)
+    const char *path;           // File, replaced each time
+    unsigned long long every;   // Steps between checkpoints
+    unsigned long long next;    // Steps at which the next one is due
+    const Instr *code;          // The program the run is of
+    unsigned long long key;     // Hash of its source
+    size_t source_size;         // Bytes in that source
+    int level;                  // Optimization level it was compiled at
+    int overflow;               // What 'A' and 'S' do past the cell range (OVERFLOW_*)
+    int eof;                    // What '?' does at the end of the input (EOF_*)
+    const Tape *tape;           // The run's tape and I/O, once it has started
+    Output *out;
+    int writer;                 // Process still writing the last checkpoint (0: none)
+};
+
+struct Sampler {                // Where a run spends its time, sampled every SAMPLE_US of CPU time (--sample)
+    const void *volatile ip;    // Instruction the engine is on, in its own copy of the code (NULL before it starts)
+    const void *volatile code;  // That copy, and the bytes in each of its instructions
+    volatile size_t stride;
+    int count;                  // Instructions in the program, OP_HALT included
+    unsigned long long *hits;   // Samples that found the engine on each instruction
+    unsigned long long taken;   // Samples taken, those before the engine started included
+};
+
+struct Stats {                  // Where a run reports how far it got every STATS_MS (--stats-file)
+    const char *path;           // File, replaced each time
+    long due_ms;                // When the next report is due, in milliseconds since the run started
+    long last_ms;               // When the last one was written
+    unsigned long long last_steps;  // Steps taken then
+    const Tape *tape;           // The run's tape and output, once it has started
+    const Output *out;
+};
+
+typedef struct {                // A compiled program in the cache (--cache)
+    Instr *code;                // Its instructions, mapped copy-on-write from the image (NULL on a miss)
+    void *map;                  // The mapped image file
+    size_t map_len;             // Bytes in map
+    unsigned long long key;     // Hash of the source it was compiled from
+    size_t source_size;         // Bytes in that source
+    int level;                  // Optimization level it was compiled at
+    char path[4160];            // Image file
+    _Bool prefixed;             // True if prefix was saved with it
+    Snapshot prefix;            // What it did before it needed input, mapped from the image
+} Image;
+
+int loadSource(const char *, Source *);  // Map, check and tokenize a screw file
+int mapSource(const char *, Source *);   // Just map it
+int tokenizeSource(Source *);       // Check and tokenize a mapped screw file
+int checkSource(Source *);          // The same without printing errors (SRC_*)
+const char *sourceMessage(int);     // Message for a SRC_* error
+void sourcePosition(const Source *, size_t, Position *);    // Line and column of a byte of the source
+void freeSource(Source *);          // Release a loaded screw file
+int locateTokens(const Source *, const size_t *, size_t, Position *);   // Find tokens in the source
+Instr *compile(const char *, size_t, int, size_t **);  // Compile tokenized screw code into instructions at an optimization level
+int proveChecks(Instr *, const Options *, const Source *, const size_t *);  // Flag the checks that can't fail (and explain why)
+int openImage(const Source *, int, Image *);   // Map the cached compiled program of a source (-1 on a miss)
+void saveImage(const Image *, const Instr *, const Snapshot *);  // Cache a compiled program (and its snapshot) where openImage() looked
+void closeImage(Image *);
+unsigned long long hashSource(const Source *);  // Hash of a source's text, which names its image
+const char *errorMessage(int);      // Message for a runtime error
+void runtimeError(int, char);       // Print the message for a runtime error
+Snapshot *runPrefix(const Instr *, const Options *, unsigned long long);   // Run compiled screw code until it needs input
+_Bool prefixFits(const Snapshot *, const Options *);   // Whether a run can start from a snapshot
+void resumeRun(const Snapshot *, Tape *, Output *);     // Put a run's tape and output where a snapshot left them
+void freeSnapshot(Snapshot *);
+void takeCheckpoint(Checkpoint *, int, long, unsigned long long);  // Write a run's state out in the background
+void finishCheckpoints(Checkpoint *);   // Wait for the last checkpoint to be written
+Snapshot *loadCheckpoint(const char *, const Checkpoint *, const Options *);  // Read a checkpoint back to resume from
+int run(const Instr *, const Options *, Profile *, Budget *);  // Execute compiled screw code with an interpreter engine, returning its error
+int execute(const Instr *, const Options *, Output *, Profile *, Budget *);    // The same with other I/O, printing nothing
+int executeOn(const Instr *, const Options *, Tape *, Output *, Profile *, Budget *);  // The same on a tape of its own
+void startBudget(Budget *, const Options *);    // Take the limits of a run and start its clock
+int chargeBudget(Budget *, long long *, int, long); // Count a spent grant and hand out the next (or the limit error)
+long elapsedMs(const Budget *);     // Milliseconds since the run started
+int runBatch(const char *, int, const Options *, int);    // Run the jobs of a manifest on worker threads
+Profile *newProfile(const Instr *); // Start an empty profile of compiled screw code
+void freeProfile(Profile *);
+int reportProfile(const Profile *, const Instr *, const size_t *, const Source *, const char *); // Print the hot loops (and write JSON)
+int recordProfile(const Profile *, const Instr *, const size_t *, const Source *, const char *);    // Write the loop counts for --profile-use
+unsigned char *planProfile(const char *, const Instr *, const size_t *, const Source *);   // Read them back into a plan of the code
+Sampler *startSampler(const Instr *);   // Start sampling where a run of compiled screw code spends its time
+void stopSampler(Sampler *);
+void freeSampler(Sampler *);
+int reportSamples(const Sampler *, const Instr *, const size_t *, const Source *, const char *); // Write the samples as collapsed stacks
+void writeStats(Stats *, const Budget *, _Bool);   // Replace the stats file of a run with how far it got
+int jitRun(const Instr *, const Options *, Budget *);  // Execute compiled screw code as machine code (-1 if not available)
+int emitC(const Instr *, const Options *, FILE *);  // Write compiled screw code as a standalone C program
+int buildNative(const Instr *, const Options *, const char *); // Build compiled screw code into a native executable
+
+int newTape(Tape *, long, int, int);    // Allocate a zeroed tape of a length, cell width and kind
+void freeTape(Tape *);
+void armTape(const Tape *, sigjmp_buf *);   // Catch faults in the guards of a tape on this thread
+void disarmTape(void);
+int tapeFault(void);                // Error of the fault that was just caught
+char *scanRight(char *, char *, int);   // First 0 cell on a stride up to the last cell (NULL if none)
+char *scanLeft(char *, char *, int);    // First 0 cell on a stride down to the first cell (NULL if none)
+
+void initOutput(Output *, int, int);    // Start buffering output for a file descriptor
+void captureOutput(Output *, const void *, size_t); // Keep output in memory, reading input from a block of memory
+void feedInput(Output *, const void *, size_t);     // Read input from a block of memory, without copying it
+void hookOutput(Output *, void (*)(void *, const void *, size_t), int (*)(void *), void *); // Do I/O through callbacks
+void flushOutput(Output *);             // Write everything buffered so far
+void writeOutput(Output *, const void *, size_t);   // Output a block of bytes
+int refillInput(Output *, int);         // readInput() once the input buffer is empty
+void skipInput(Output *, unsigned long long);  // Read past input a run read before it was resumed
+
+static inline void putOutput(Output *out, char c){ // Output one byte
+    out->buf[out->len++] = (unsigned char)c;
+    if(out->len == OUTPUT_BUFFER || (c == '\n' && out->mode == FLUSH_LINE))
+        flushOutput(out);
+}
+
+static inline int readInput(Output *out, int cell){ // What '?' sets a cell holding cell to
+    if(out->input_pos < out->input_len)
+        return out->input[out->input_pos++];
+    return refillInput(out, cell);
+}
+
+#endif
@@ -0,0 +1,122 @@
+//
+//  scrint.h
+//
+//  Screw Interpreter
+//
+//  libscrint: the interpreter as a library. Compile a screw program once,
+//  create as many contexts (a tape and I/O) as it needs, and run them as
+//  often as you like. Nothing is printed and nothing exits: every call
+//  returns a status, and errors say what and where. There is no global state,
+//  so different contexts can run on different threads at the same time.
+//
+//  Build with "make lib" and link libscrint.a (and -pthread).
+//
+
+#ifndef SCRINT_H
+#define SCRINT_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {                          // What a call ended with
+    SCRINT_OK = 0,
+    SCRINT_ERR_SHIFT_RIGHT,     // Runtime errors, raised by scrintRun()
+    SCRINT_ERR_SHIFT_LEFT,
+    SCRINT_ERR_DUMP_LOWER,
+    SCRINT_ERR_DUMP_RANGE,
+    SCRINT_ERR_DUMP_CARET,
+    SCRINT_ERR_DUMP_UPPER,
+    SCRINT_ERR_DUMP_ORDER,
+    SCRINT_ERR_ADD_INT,
+    SCRINT_ERR_ADD_OVERFLOW,
+    SCRINT_ERR_SUB_INT,
+    SCRINT_ERR_SUB_OVERFLOW,
+    SCRINT_ERR_UNKNOWN_SYMBOL,
+    SCRINT_ERR_STEP_LIMIT,      // Ran out of max_steps
+    SCRINT_ERR_TIMEOUT,         // Ran out of timeout_ms
+    SCRINT_ERR_NO_END = 64,     // Compile errors, returned by scrintCompile()
+    SCRINT_ERR_UNMATCHED_OPEN,
+    SCRINT_ERR_UNMATCHED_CLOSE,
+    SCRINT_ERR_NO_MEMORY = 96,  // Either
+    SCRINT_ERR_ARGUMENT
+};
+
+enum {                          // What 'A' and 'S' do when the cell would go below 0 or past its largest value
+    SCRINT_OVERFLOW_ERROR,      // Raise SCRINT_ERR_ADD_OVERFLOW/SCRINT_ERR_SUB_OVERFLOW (default)
+    SCRINT_OVERFLOW_WRAP,       // Wrap around like '+' and '-'
+    SCRINT_OVERFLOW_SATURATE    // Stop at 0 or the largest value
+};
+
+enum {                          // What '?' sets the cell to once the input has ended
+    SCRINT_EOF_MINUS1,          // -1 (default)
+    SCRINT_EOF_ZERO,            // 0
+    SCRINT_EOF_KEEP             // Leave the cell as it is
+};
+
+enum {                          // Interpreter engines
+    SCRINT_ENGINE_THREADED,     // Direct-threaded dispatch where the compiler supports it (default)
+    SCRINT_ENGINE_SWITCH        // Switch dispatch
+};
+
+typedef struct {                // Details of a status other than SCRINT_OK
+    int status;                 // SCRINT_*
+    char symbol;                // The symbol of SCRINT_ERR_UNKNOWN_SYMBOL
+    size_t line;                // Where a compile error is in the source (1-based, 0 for other errors)
+    size_t column;
+} ScrintError;
+
+typedef struct {                // How a context runs its program; zero for the defaults
+    long cells;                 // Length of the tape (0: 60000, otherwise at least 10)
+    int engine;                 // SCRINT_ENGINE_*
+    int guard_pages;            // Non-zero to put the tape between guard pages, which skips most shift
+                                // checks but installs a SIGSEGV/SIGBUS handler for the whole process
+                                // (other faults go on to the handler there was before)
+    int cell_bits;              // 8 (0 means 8, the largest value being 127), 16 or 32
+    int overflow;               // SCRINT_OVERFLOW_*
+    int eof;                    // SCRINT_EOF_*
+    unsigned long long max_steps;   // Steps a run may take, counted as loops go round (0: no limit)
+    long timeout_ms;            // Milliseconds a run may take, checked as loops go round (0: no limit)
+} ScrintOptions;
+
+typedef struct {                // Where a context's I/O goes
+    void (*write)(void *user, const void *bytes, size_t n);    // Output, in blocks (NULL: thrown away)
+    int (*read)(void *user);    // Next input byte for '?', or -1 at the end (NULL: no input)
+    void *user;                 // Passed to both
+} ScrintIO;
+
+typedef struct ScrintProgram ScrintProgram;    // A compiled screw program, read-only once compiled
+typedef struct ScrintContext ScrintContext;    // A tape and I/O to run a program on, used by one thread at a time
+
+// Compiles size bytes of screw source (up to its '~') at optimization level 0, 1 or 2.
+// On success *program is set; on failure, error (unless NULL) tells what and where.
+int scrintCompile(const char *source, size_t size, int level, ScrintProgram **program, ScrintError *error);
+void scrintFreeProgram(ScrintProgram *program);
+
+// Allocates the tape and output buffer for runs of program, which must outlive the
+// context. options and io may be NULL for the defaults.
+int scrintNewContext(const ScrintProgram *program, const ScrintOptions *options, const ScrintIO *io, ScrintContext **context);
+void scrintSetIO(ScrintContext *context, const ScrintIO *io);  // Use other callbacks from the next run on
+void scrintFreeContext(ScrintContext *context);
+
+// Runs the program from the start on a zeroed tape. Output is all passed to io.write by
+// the time it returns. A runtime error is returned (and described in error) just where
+// scrint would print it, and so is SCRINT_ERR_STEP_LIMIT or SCRINT_ERR_TIMEOUT where a
+// loop goes round past the limits in the options.
+int scrintRun(ScrintContext *context, ScrintError *error);
+
+// Zeroes the tape now. scrintRun() does this itself before reusing a tape, so this is
+// only needed to wipe what the last run left in memory without running again.
+void scrintReset(ScrintContext *context);
+
+// Writes the message for an error into buf (at most size bytes, always terminated, like
+// snprintf()) and returns its length.
+int scrintFormatError(const ScrintError *error, char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,72 @@
+//
+//  stats.c
+//
+//  Screw Interpreter
+//
+//  --stats-file FILE: every STATS_MS milliseconds, as steps are charged, the
+//  run replaces FILE with how far it got, in the Prometheus text format, so
+//  a monitoring agent (such as node_exporter's textfile collector) can
+//  scrape a job while it runs: the steps taken, the steps a second since the
+//  last report, the bytes of output written and the cells from the first to
+//  the last that isn't 0. The file is written next to its place and renamed
+//  into it, so a scrape never sees half of one. A last report, once the run
+//  is over, says it stopped.
+//
+//  Steps are only counted where they are charged, so a report is up to
+//  STEP_BATCH steps behind, and one that is due waits for the next charge.
+//
+
+#include <stdio.h>
+#include <string.h>         // For memcpy()
+#include <unistd.h>         // For getpid() and unlink()
+#include "screw.h"
+
+static long tapeExtent(const Tape *);                  // Cells up to the last that isn't 0
+
+// Replaces the stats file of the run budget counts the steps of with how far it got,
+// saying whether it is still running, and sets when the next report is due.
+void writeStats(Stats *stats, const Budget *budget, _Bool running){
+    char temp[4160];
+    long ms = elapsedMs(budget);
+    double rate = ms > stats->last_ms ? (budget->steps - stats->last_steps) * 1000.0 / (ms - stats->last_ms) : 0;
+    FILE *file = NULL;
+    int failed = 0;
+
+    stats->due_ms = ms + STATS_MS;
+    stats->last_ms = ms;
+    stats->last_steps = budget->steps;
+    if(snprintf(temp, sizeof(temp), "%s.%ld.tmp", stats->path, (long)getpid()) >= (int)sizeof(temp)
+       || (file = fopen(temp, "w")) == NULL)
+        return;                                        // Nothing to report to; the run goes on regardless
+    fprintf(file, "# HELP scrint_steps Steps the program has taken.\n# TYPE scrint_steps counter\n");
+    fprintf(file, "scrint_steps %llu\n", budget->steps);
+    fprintf(file, "# HELP scrint_steps_per_second Steps a second since the last report.\n# TYPE scrint_steps_per_second gauge\n");
+    fprintf(file, "scrint_steps_per_second %.0f\n", rate);
+    fprintf(file, "# HELP scrint_output_bytes Bytes of output the program has written.\n# TYPE scrint_output_bytes counter\n");
+    fprintf(file, "scrint_output_bytes %llu\n", stats->out != NULL ? stats->out->written + stats->out->len : 0);
+    fprintf(file, "# HELP scrint_tape_cells Cells from the first to the last that is not 0.\n# TYPE scrint_tape_cells gauge\n");
+    fprintf(file, "scrint_tape_cells %ld\n", stats->tape != NULL ? tapeExtent(stats->tape) : 0);
+    fprintf(file, "# HELP scrint_elapsed_seconds Seconds since the run started.\n# TYPE scrint_elapsed_seconds gauge\n");
+    fprintf(file, "scrint_elapsed_seconds %.3f\n", ms / 1000.0);
+    fprintf(file, "# HELP scrint_running 1 while the program runs, 0 once it stopped.\n# TYPE scrint_running gauge\n");
+    fprintf(file, "scrint_running %d\n", running ? 1 : 0);
+    failed = ferror(file);
+    if(fclose(file) != 0 || failed || rename(temp, stats->path) != 0)
+        unlink(temp);
+}
+
+static long tapeExtent(const Tape *tape){              // A word at a time from the end, where a tape is mostly zeros
+    const unsigned char *cells = (const unsigned char *)tape->cells;
+    size_t n = (size_t)tape->size * tape->width;
+    unsigned long word = 0;
+
+    while(n >= sizeof(word)){
+        memcpy(&word, cells + n - sizeof(word), sizeof(word));
+        if(word != 0)
+            break;
+        n -= sizeof(word);
+    }
+    while(n > 0 && cells[n - 1] == 0)
+        --n;
+    return (long)((n + tape->width - 1) / tape->width);
+}
@@ -0,0 +1,196 @@
+//
+//  tape.c
+//
+//  Screw Interpreter
+//
+//  The memory cells a program runs on. The guard tape (the default) is
+//  mmap'd between two PROT_NONE guard regions, so a move that is followed
+//  straight away by a use of the new cell needs no bounds check: stepping
+//  off the tape faults on that use, and the fault is turned back into the
+//  usual "cannot shift" error. The checked tape is a plain allocation for
+//  systems without mmap.
+//
+//  Scan loops ("{>}", "{<<}") search the tape for a zero cell here, 16 cells
+//  at a time with SSE2 where there is, with memchr()/memrchr() otherwise.
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>         // For calloc() and free()
+#include <signal.h>         // For sigaction(), siglongjmp()
+#include <unistd.h>         // For sysconf()
+#include <string.h>         // For memchr(), memrchr()
+#include <sys/mman.h>       // For mmap(), mprotect(), munmap()
+#include <pthread.h>        // For pthread_once()
+#ifdef __SSE2__
+#include <emmintrin.h>      // For the 16-cell compares
+#endif
+#include "screw.h"
+
+static _Thread_local const Tape *armed_tape = NULL;   // Tape of the run on this thread, while its faults are expected
+static _Thread_local sigjmp_buf *armed_env = NULL;    // Where that run picks up after a fault
+static _Thread_local int armed_error = 0;             // Error of the last fault
+static pthread_once_t handler_once = PTHREAD_ONCE_INIT;   // Installs onFault() once, whichever thread arms a tape first
+static struct sigaction previous_segv, previous_bus;   // What SIGSEGV and SIGBUS did before, for faults that aren't ours
+
+static void onFault(int, siginfo_t *, void *);         // SIGSEGV/SIGBUS handler
+static void installHandler(void);                      // Make onFault() the SIGSEGV/SIGBUS handler
+#ifdef __SSE2__
+static int strideMask(int);                            // Bits of a 16-cell compare that land on the stride
+#endif
+
+int newTape(Tape *tape, long cells, int width, int kind){  // Allocate a zeroed tape of cells cells of width bytes (-1 if out of memory)
+    long page = sysconf(_SC_PAGESIZE);
+    size_t bytes = (size_t)cells * width;
+
+    tape->size = cells;
+    tape->width = width;
+    tape->map = NULL;
+    tape->map_len = 0;
+    tape->guard_len = 0;
+    tape->exact_left = tape->exact_right = 0;
+    tape->cursor = 0;
+
+    if((kind == TAPE_GUARD || kind == TAPE_UNCHECKED) && page > 0){
+        size_t guard = ((size_t)GUARD_CELLS * width + page - 1) / page * page;
+        size_t data = (bytes + page - 1) / page * page;
+        char *map = mmap(NULL, guard + data + guard, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(map != MAP_FAILED){
+            if(mprotect(map + guard, data, PROT_READ | PROT_WRITE) == 0){
+                tape->map = map;
+                tape->map_len = guard + data + guard;
+                tape->guard_len = guard;
+                tape->cells = map + guard + data - bytes;  // The last cell sits right against the upper guard;
+                tape->exact_right = 1;
+                tape->exact_left = (data == bytes);    // the first against the lower one only if cells fill whole pages
+                return 0;
+            }
+            munmap(map, guard + data + guard);
+        }
+    }
+    tape->cells = (char *)calloc(cells, width);        // TAPE_CHECKED, or no mmap
+    return tape->cells != NULL ? 0 : -1;
+}
+
+void freeTape(Tape *tape){
+    if(tape->map != NULL)
+        munmap(tape->map, tape->map_len);
+    else
+        free(tape->cells);
+    tape->cells = NULL;
+    tape->map = NULL;
+}
+
+// From here until disarmTape(), a fault in one of tape's guards on this thread jumps to env
+// (which must have been set with sigsetjmp(env, 1)), where tapeFault() tells the error.
+void armTape(const Tape *tape, sigjmp_buf *env){
+    pthread_once(&handler_once, installHandler);
+    armed_env = env;
+    armed_tape = tape;
+}
+
+void disarmTape(void){
+    armed_tape = NULL;
+    armed_env = NULL;
+}
+
+int tapeFault(void){                                   // Error of the fault that was just caught
+    return armed_error;
+}
+
+static void installHandler(void){
+    struct sigaction action;
+
+    action.sa_sigaction = onFault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &previous_segv);
+    sigaction(SIGBUS, &action, &previous_bus);
+}
+
+static void onFault(int sig, siginfo_t *info, void *context){
+    const Tape *tape = armed_tape;
+    const struct sigaction *previous = sig == SIGBUS ? &previous_bus : &previous_segv;
+    char *at = (char *)info->si_addr;
+
+    if(tape != NULL && tape->map != NULL){
+        char *lower = (char *)tape->map;                               // Lower guard
+        char *upper = (char *)tape->map + tape->map_len - tape->guard_len; // Upper guard
+        sigjmp_buf *env = armed_env;
+        if(at >= lower && at < lower + tape->guard_len)
+            armed_error = ERR_SHIFT_LEFT;
+        else if(at >= upper && at < upper + tape->guard_len)
+            armed_error = ERR_SHIFT_RIGHT;
+        else
+            env = NULL;
+        if(env != NULL){
+            disarmTape();
+            siglongjmp(*env, 1);
+        }
+    }
+    if(previous->sa_flags & SA_SIGINFO)                // Not a screw program stepping off its tape: the host's handler
+        previous->sa_sigaction(sig, info, context);
+    else if(previous->sa_handler != SIG_DFL && previous->sa_handler != SIG_IGN)
+        previous->sa_handler(sig);
+    else
+        sigaction(sig, previous, NULL);                // No handler: the fault happens again and crashes as usual
+}
+
+// First zero cell among at, at + stride, at + 2 * stride, ... up to last, or NULL if the
+// scan runs off the end of the tape first.
+char *scanRight(char *at, char *last, int stride){
+    size_t steps = 0;                                  // Cells at + stride * i for i < steps are not 0
+
+    if(stride == 1)
+        return (char *)memchr(at, 0, last - at + 1);
+#ifdef __SSE2__
+    if(strideMask(stride) != 0){                       // Whole blocks of 16 keep their cells on the stride
+        int mask = strideMask(stride);
+        for(; last - at >= 15; at += 16){
+            int zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)at), _mm_setzero_si128())) & mask;
+            if(zeros != 0)
+                return at + __builtin_ctz(zeros);
+        }
+    }
+#endif
+    for(; at <= last && steps <= (size_t)(last - at) / stride; ++steps) // The blocks may have stepped past last
+        if(at[steps * stride] == 0)
+            return at + steps * stride;
+    return NULL;
+}
+
+// Last zero cell among at, at - stride, at - 2 * stride, ... down to first, or NULL.
+char *scanLeft(char *at, char *first, int stride){
+    size_t steps = 0;
+
+#ifdef __GLIBC__
+    if(stride == 1)
+        return (char *)memrchr(first, 0, at - first + 1);
+#endif
+#ifdef __SSE2__
+    if(strideMask(stride) != 0){
+        int mask = strideMask(stride) << (stride - 1);  // Bit 15 and every stride-th bit below it
+        for(; at - first >= 15; at -= 16){
+            int zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(at - 15)), _mm_setzero_si128())) & mask;
+            if(zeros != 0)
+                return at - 15 + (31 - __builtin_clz(zeros));
+        }
+    }
+#endif
+    for(; at >= first && steps <= (size_t)(at - first) / stride; ++steps)
+        if(*(at - steps * stride) == 0)
+            return at - steps * stride;
+    return NULL;
+}
+
+#ifdef __SSE2__
+static int strideMask(int stride){                     // Bit 0 and every stride-th bit after it, if stride divides 16
+    int mask = 0;
+
+    if(stride <= 0 || 16 % stride != 0)
+        return 0;
+    for(int bit = 0; bit < 16; bit += stride)
+        mask |= 1 << bit;
+    return mask;
+}
+#endif
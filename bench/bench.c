@@ -0,0 +1,322 @@
+//
+//  bench.c
+//
+//  Screw Interpreter
+//
+//  Benchmark harness: runs each workload through scrint several times and
+//  prints one JSON object per workload and configuration with the wall
+//  time, the CPU instructions retired per second (null where perf events
+//  aren't available) and the peak resident set size.
+//
+//  As a gate (-b), it also reads the lines of an earlier run and fails if a
+//  workload got more than -t percent slower in any configuration: in
+//  instructions where both runs counted them, otherwise in its fastest wall
+//  time (differences under NOISE_S are put down to noise).
+//
+//  usage: scrbench [-n runs] [-s scrint] [-b baseline [-t percent]] [-a "args"]... <file>.scw...
+//
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>         // For malloc(), qsort(), strtol(), strtod(), atof()
+#include <string.h>         // For strcmp(), strrchr(), strtok()
+#include <fcntl.h>          // For open()
+#include <unistd.h>         // For fork(), execv(), pipe(), dup2()
+#include <time.h>           // For clock_gettime()
+#include <sys/wait.h>       // For wait4()
+#include <sys/resource.h>   // For struct rusage
+#ifdef __linux__
+#include <sys/syscall.h>    // For SYS_perf_event_open
+#include <linux/perf_event.h>
+#endif
+
+#define MAX_CONFIGS 16      // Most -a options
+#define MAX_ARGS 32         // Most words in one -a option
+#define MAX_BASELINE 256    // Most lines read from a baseline
+#define NOISE_S 0.002       // Wall time differences too small to call a regression
+
+typedef struct {            // Measurements of a single run
+    double wall;            // Seconds
+    long long instructions; // CPU instructions retired, -1 if unknown
+    long max_rss;           // Peak resident set size in KB
+    int status;             // Exit code, or 128 + signal
+} Sample;
+
+typedef struct {            // A workload and configuration as measured before
+    char workload[256];
+    char args[512];
+    double wall;            // Fastest run, in seconds
+    long long instructions; // Median count, -1 if unknown
+} Baseline;
+
+static int runOnce(const char *, char *const *, Sample *);  // Run scrint once and measure it
+static int openCounter(pid_t);                          // Start counting the instructions of a process (-1 if not possible)
+static int compareDoubles(const void *, const void *);
+static int compareCounts(const void *, const void *);
+static void putJsonString(const char *);                // Print a JSON string
+static int readBaseline(const char *, Baseline *, int); // Read the lines of an earlier run (-1 if unreadable)
+static const char *getJsonString(const char *, const char *, char *, size_t);  // Value of a string field on a line
+static int regressed(const Baseline *, int, const char *, const char *, double, long long, double);    // Compare, reporting a regression
+
+int main(int argc, char *argv[]){
+    const char *scrint = "./scrint";                   // Interpreter to benchmark
+    const char *configs[MAX_CONFIGS] = { "" };         // Extra arguments for each configuration
+    int config_count = 0;
+    int runs = 5;                                      // Runs per workload and configuration
+    int arg = 1;
+    int failed = 0;
+    static Baseline baseline[MAX_BASELINE];            // Lines of the earlier run (-b)
+    int baseline_count = -1;                           // -1 if not gating
+    double threshold = 10;                             // Percent slower that fails the gate (-t)
+
+    for(; arg < argc && argv[arg][0] == '-'; ++arg){
+        if(strcmp(argv[arg], "-n") == 0 && arg + 1 < argc && (runs = atoi(argv[arg + 1])) > 0)
+            ++arg;
+        else if(strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+            scrint = argv[++arg];
+        else if(strcmp(argv[arg], "-a") == 0 && arg + 1 < argc && config_count < MAX_CONFIGS)
+            configs[config_count++] = argv[++arg];
+        else if(strcmp(argv[arg], "-b") == 0 && arg + 1 < argc){
+            if((baseline_count = readBaseline(argv[++arg], baseline, MAX_BASELINE)) == -1){
+                fprintf(stderr, "scrbench: cannot read baseline %s (make perf-baseline writes one)\n", argv[arg]);
+                return 2;
+            }
+        }
+        else if(strcmp(argv[arg], "-t") == 0 && arg + 1 < argc && (threshold = atof(argv[arg + 1])) > 0)
+            ++arg;
+        else{
+            fprintf(stderr, "usage: scrbench [-n runs] [-s scrint] [-b baseline [-t percent]] [-a \"args\"]... <file>.scw...\n");
+            return 2;
+        }
+    }
+    if(arg == argc){
+        fprintf(stderr, "usage: scrbench [-n runs] [-s scrint] [-b baseline [-t percent]] [-a \"args\"]... <file>.scw...\n");
+        return 2;
+    }
+    if(config_count == 0)                              // Just the defaults
+        config_count = 1;
+
+    for(; arg < argc; ++arg){
+        const char *name = strrchr(argv[arg], '/') ? strrchr(argv[arg], '/') + 1 : argv[arg];
+        for(int c = 0; c < config_count; ++c){
+            char words[512];                           // Copy of the configuration split into arguments
+            char *args[MAX_ARGS + 3];
+            int count = 0;
+            Sample *samples = (Sample *)calloc(runs, sizeof(Sample));
+            double *walls = (double *)calloc(runs, sizeof(double));
+            long long *counts = (long long *)calloc(runs, sizeof(long long));
+            long max_rss = 0;
+            int status = 0, counted = 1;
+
+            if(samples == NULL || walls == NULL || counts == NULL){
+                fprintf(stderr, "scrbench: out of memory\n");
+                return 1;
+            }
+            snprintf(words, sizeof(words), "%s", configs[c]);
+            args[count++] = (char *)scrint;
+            for(char *word = strtok(words, " "); word != NULL && count < MAX_ARGS + 1; word = strtok(NULL, " "))
+                args[count++] = word;
+            args[count++] = argv[arg];
+            args[count] = NULL;
+
+            for(int r = 0; r < runs; ++r){
+                if(runOnce(scrint, args, &samples[r]) != 0){
+                    fprintf(stderr, "scrbench: cannot run %s\n", scrint);
+                    return 1;
+                }
+                walls[r] = samples[r].wall;
+                counts[r] = samples[r].instructions;
+                counted &= (samples[r].instructions >= 0);
+                max_rss = samples[r].max_rss > max_rss ? samples[r].max_rss : max_rss;
+                if(samples[r].status != 0)
+                    status = samples[r].status;
+            }
+            qsort(walls, runs, sizeof(double), compareDoubles);
+            qsort(counts, runs, sizeof(long long), compareCounts);
+
+            printf("{\"workload\": ");
+            putJsonString(name);
+            printf(", \"args\": ");
+            putJsonString(configs[c]);
+            printf(", \"runs\": %d, \"wall_s\": {\"min\": %.6f, \"median\": %.6f, \"max\": %.6f}",
+                   runs, walls[0], walls[runs / 2], walls[runs - 1]);
+            if(counted)
+                printf(", \"instructions\": %lld, \"instructions_per_s\": %.0f",
+                       counts[runs / 2], counts[runs / 2] / walls[runs / 2]);
+            else
+                printf(", \"instructions\": null, \"instructions_per_s\": null");
+            printf(", \"max_rss_kb\": %ld, \"exit\": %d}\n", max_rss, status);
+            fflush(stdout);
+            failed |= (status != 0);
+            if(baseline_count != -1)
+                failed |= regressed(baseline, baseline_count, name, configs[c], walls[0], counted ? counts[runs / 2] : -1, threshold);
+
+            free(samples);
+            free(walls);
+            free(counts);
+        }
+    }
+    return failed;
+}
+
+static int runOnce(const char *scrint, char *const *args, Sample *sample){ // Run scrint with output to /dev/null
+    struct timespec start, end;
+    struct rusage usage;
+    int ready[2];                                      // Holds the child back until its counter is attached
+    int counter = -1, status = 0;
+    pid_t pid;
+    char go = 0;
+
+    if(pipe(ready) == -1)
+        return -1;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid = fork();
+    if(pid == 0){
+        int null = open("/dev/null", O_RDWR);
+        close(ready[1]);
+        if(read(ready[0], &go, 1) != 1)
+            _exit(126);
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        execv(scrint, args);
+        _exit(127);
+    }
+    close(ready[0]);
+    if(pid == -1){
+        close(ready[1]);
+        return -1;
+    }
+    counter = openCounter(pid);                        // Counts from the exec() on
+    if(write(ready[1], &go, 1) != 1){
+        close(ready[1]);
+        return -1;
+    }
+    close(ready[1]);
+    if(wait4(pid, &status, 0, &usage) == -1)
+        return -1;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    sample->wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    sample->max_rss = usage.ru_maxrss;
+    sample->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    sample->instructions = -1;
+    if(counter != -1){
+        long long count = 0;
+        if(read(counter, &count, sizeof(count)) == sizeof(count))
+            sample->instructions = count;
+        close(counter);
+    }
+    if(sample->status == 127)                          // execv() failed
+        return -1;
+    return 0;
+}
+
+static int openCounter(pid_t pid){
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.exclude_kernel = 1;                           // Allowed for ordinary users on most systems
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0);
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+static int compareDoubles(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int compareCounts(const void *a, const void *b){
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static void putJsonString(const char *text){
+    putchar('"');
+    for(; *text != '\0'; ++text){
+        if(*text == '"' || *text == '\\')
+            putchar('\\');
+        putchar(*text);
+    }
+    putchar('"');
+}
+
+// Reads up to max lines of scrbench output from path into lines. Returns how many were read,
+// or -1 if the file can't be opened.
+static int readBaseline(const char *path, Baseline *lines, int max){
+    FILE *file = fopen(path, "r");
+    char line[2048];
+    int count = 0;
+
+    if(file == NULL)
+        return -1;
+    while(count < max && fgets(line, sizeof(line), file) != NULL){
+        const char *wall = strstr(line, "\"min\": ");
+        const char *instructions = strstr(line, "\"instructions\": ");
+        if(getJsonString(line, "workload", lines[count].workload, sizeof(lines[count].workload)) == NULL
+           || getJsonString(line, "args", lines[count].args, sizeof(lines[count].args)) == NULL || wall == NULL)
+            continue;                                  // Not one of ours
+        lines[count].wall = strtod(wall + strlen("\"min\": "), NULL);
+        if(instructions != NULL)
+            instructions += strlen("\"instructions\": ");
+        lines[count].instructions = instructions != NULL && *instructions != 'n' ? strtoll(instructions, NULL, 10) : -1;
+        ++count;
+    }
+    fclose(file);
+    return count;
+}
+
+// Copies the string field key of a JSON line into value (at most size bytes, unescaped).
+// Returns value, or NULL if the line has no such field.
+static const char *getJsonString(const char *line, const char *key, char *value, size_t size){
+    char field[64];
+    const char *p = NULL;
+    size_t len = 0;
+
+    snprintf(field, sizeof(field), "\"%s\": \"", key);
+    if((p = strstr(line, field)) == NULL)
+        return NULL;
+    for(p += strlen(field); *p != '"' && *p != '\0' && len + 1 < size; ++p){
+        if(*p == '\\' && p[1] != '\0')
+            ++p;
+        value[len++] = *p;
+    }
+    value[len] = '\0';
+    return value;
+}
+
+// Finds workload run with args among the count lines of baseline and reports (returning 1)
+// if it got more than threshold percent slower: in instructions if both counted them,
+// otherwise in wall time.
+static int regressed(const Baseline *baseline, int count, const char *workload, const char *args, double wall,
+                     long long instructions, double threshold){
+    for(int i = 0; i < count; ++i){
+        const Baseline *before = &baseline[i];
+        if(strcmp(before->workload, workload) != 0 || strcmp(before->args, args) != 0)
+            continue;
+        if(instructions >= 0 && before->instructions > 0){
+            if(instructions > before->instructions * (1 + threshold / 100)){
+                fprintf(stderr, "scrbench: %s %s regressed: %lld instructions, %.1f%% more than %lld\n", workload, args,
+                        instructions, 100.0 * (instructions - before->instructions) / before->instructions, before->instructions);
+                return 1;
+            }
+        }
+        else if(wall > before->wall * (1 + threshold / 100) && wall - before->wall > NOISE_S){
+            fprintf(stderr, "scrbench: %s %s regressed: %.6f s, %.1f%% slower than %.6f s\n", workload, args,
+                    wall, 100 * (wall - before->wall) / before->wall, before->wall);
+            return 1;
+        }
+        return 0;
+    }
+    fprintf(stderr, "scrbench: no baseline for %s %s\n", workload, args);
+    return 0;
+}
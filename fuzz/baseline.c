@@ -0,0 +1,300 @@
+//
+//  baseline.c
+//
+//  Screw Interpreter
+//
+//  The oracle scrfuzz checks the baseline configuration against: run() as
+//  it was before the interpreter compiled anything (8-bit cells, 60000 of
+//  them, 'A' and 'S' failing past the cell range and '?' reading -1 at the
+//  end of the input), copied from the original main.c word for word. Only
+//  its name and its I/O are changed, by the macros below: output and input
+//  go to memory, and the error it prints is kept for scrfuzz to read back.
+//  Bounds of '*' past 9 aren't errors any more, so programs with them are
+//  left out of what it checks, and so are programs that shift right off
+//  the tape: its check lets the cursor onto memory[CELLS], past the end,
+//  and only fails on the next '>'.
+//
+
+#include <stdio.h>
+#include <stdlib.h>         // For atoi(), realloc()
+#include <string.h>         // For memset()
+#include <stdarg.h>         // For va_list
+#include <ctype.h>          // isdigit()
+
+#define CELLS 60000         // How many memory cells there will be
+#define RESET "\033[0m"     // Default color
+#define RED "\033[0;31m"    // Red
+
+static const unsigned char *input;                     // What getchar() reads
+static size_t input_len, input_pos;
+static unsigned char *output;                          // What putchar() wrote
+static size_t output_len, output_cap;
+static char *error;                                    // What fprintf() printed
+static size_t error_size;
+
+static int baselinePut(int);
+static int baselineGet(void);
+static int baselineError(FILE *, const char *, ...);
+
+#define run baselineRun
+#define putchar(c) baselinePut(c)
+#define getchar() baselineGet()
+#define fprintf baselineError
+
+void baselineRun(char *);
+
+// Runs the tokenized code (ending in '~') the way the original run() did, reading in and
+// writing *out (malloc()ed, *out_len bytes), with what it printed on stderr in err.
+void runBaseline(char *code, const void *in, size_t in_len, unsigned char **out, size_t *out_len, char *err, size_t err_size){
+    input = (const unsigned char *)in;
+    input_len = in_len;
+    input_pos = 0;
+    output = NULL;
+    output_len = output_cap = 0;
+    error = err;
+    error_size = err_size;
+    error[0] = '\0';
+    run(code);
+    *out = output;
+    *out_len = output_len;
+}
+
+static int baselinePut(int c){
+    if(output_len == output_cap){
+        unsigned char *grown = (unsigned char *)realloc(output, output_cap ? output_cap * 2 : 4096);
+        if(grown == NULL)
+            return EOF;
+        output = grown;
+        output_cap = output_cap ? output_cap * 2 : 4096;
+    }
+    output[output_len++] = (unsigned char)c;
+    return c;
+}
+
+static int baselineGet(void){
+    return input_pos < input_len ? input[input_pos++] : EOF;
+}
+
+static int baselineError(FILE *stream, const char *format, ...){
+    va_list args;
+    int n = 0;
+
+    (void)stream;
+    va_start(args, format);
+    n = vsnprintf(error, error_size, format, args);
+    va_end(args);
+    return n;
+}
+
+void run(char *code){                                  // Interpret tokenized screw file
+    char memory[CELLS];                                // 60,000 memory cells initialized to 0
+    memset(memory, 0, CELLS);
+    char *data_ptr = memory;                           // Cursor for modifying the memory cells
+    char *code_ptr = code;                             // Cursor to read the screw code
+    int braces = 0;                                    // Keep track of braces
+    int left_offset = 0;                               // Keep track of how far away the cell cursor is from the left-most cell
+    
+    while(*code_ptr != '~'){                           // Run code while the terminating character '~' has not been found
+        if(*code_ptr == '>'){                          // Shift cursor to right cell
+            if(left_offset == CELLS){
+                fprintf(stderr, "%sError:%s Invalid instruction, cannot shift right anymore! Exiting...\n", RED, RESET);
+                return;
+            }
+            ++data_ptr;
+            ++left_offset;                             // Update offset from left
+        }
+        else if(*code_ptr == '<'){                     // Shift cursor to left cell
+            if(left_offset == 0){
+                fprintf(stderr, "%sError:%s Invalid instruction, cannot shift left anymore! Exiting...\n", RED, RESET);
+                return;
+            }
+            --data_ptr;
+            --left_offset;                             // Update offset from left
+        }
+        else if(*code_ptr == '+')                      // Increment value in cell
+            ++*data_ptr;
+        else if(*code_ptr == '-')                      // Decrement value in cell
+            --*data_ptr;
+        else if(*code_ptr == '.')                      // Output cell contents
+            putchar(*data_ptr);
+        else if (*code_ptr == '*'){                    // Dump multiple cell's contents
+            int lower_bound = 0;                       // First cell user wants dumped
+            int upper_bound = 0;                       // Last cell user wants dumped
+            
+            ++code_ptr;                                // Increment instruction pointer
+            if(!isdigit(*code_ptr)){                   // Check to make sure the instruction is a digit
+                fprintf(stderr, "%sError:%s Cell Dumping - Expected integer for lower bound!\n", RED, RESET);
+                return;
+            }
+            lower_bound = *code_ptr - '0';             // Set lower bound
+            
+            ++code_ptr;                                // Increment instruction pointer
+            if(*code_ptr != '^'){                      // Make sure instruction is '^'
+                if(isdigit(*code_ptr)){                // If not '^' and is digit
+                    fprintf(stderr, "%sError:%s Cell Dumping may only be applied to cells 0-9\n", RED, RESET);
+                }
+                else                                   // If not '^' and is anything else
+                    fprintf(stderr, "%sError:%s Cell Dumping - Expected '^'\n", RED, RESET);
+                return;
+            }
+            ++code_ptr;                                // Increment instruction pointer
+            
+            if(!isdigit(*code_ptr)){                   // Check to make sure next instruction is digit
+                fprintf(stderr, "%sError:%s Cell Dumping - Expected integer for upper bound!\n", RED, RESET);
+                return;
+            }
+            upper_bound = *code_ptr - '0';             // Set upper bound
+            
+            ++code_ptr;                                // Temporarily increment instruction pointer
+            if(isdigit(*code_ptr)){                    // Check to see is the next instruction is a digit
+                fprintf(stderr, "%sError:%s Cell Dumping may only be applied to cells 0-9\n", RED, RESET);
+                return;
+            }
+            --code_ptr;                                // Decrement instruction pointer if not a digit
+            
+            if(lower_bound > upper_bound) {            // Check to make sure the lower bound is less than the upper bound
+                fprintf(stderr, "%sError:%s Cell Dumping - Lower bound is greater than upper bound!\n", RED, RESET);
+                return;
+            }
+            
+            if(left_offset < lower_bound){             // If the data pointer is below the lower bound, then move it to the lower bound
+                while(left_offset != lower_bound){
+                    ++data_ptr;
+                    ++left_offset;
+                }
+            }
+            else if(left_offset > lower_bound){        // If the data pointer is above the lower bound, then move it to the lower bound
+                while(left_offset != lower_bound){
+                    --data_ptr;
+                    --left_offset;
+                }
+            }
+            if(left_offset == lower_bound){           // If the data pointer is at the lower bound, then output data until upper bound, inclusive
+                while(left_offset != upper_bound + 1){
+                    putchar(*data_ptr);
+                    if(left_offset != upper_bound){
+                        ++data_ptr;
+                        ++left_offset;
+                    }
+                    else
+                        break;
+                }
+            }
+            
+            while(left_offset != lower_bound -1){    // Reset all dumped cells to default value (0)
+                *data_ptr = 0;
+                if(left_offset != lower_bound){
+                    --data_ptr;
+                    --left_offset;
+                }
+                else
+                    break;
+            }
+        }
+        else if(*code_ptr == 'A'){                  // Add value to current cell
+            int current_value = *data_ptr;          // Get current cell's value
+            char num_to_add_str[127];               // String to hold number being added
+            int num_to_add = 0;                     // To hold converted string as an integer
+            
+            memset(num_to_add_str, '\0', 127);      // Initialize string with 0
+            
+            ++code_ptr;                             // Increment instruction
+            if(!isdigit(*code_ptr)){                // Check to make sure the current instruction is an integer
+                fprintf(stderr, "%sError:%s Add - Expected integer!\n", RED, RESET);
+                return;
+            }
+            
+            int i = 0;                              // Index for num_to_add_str
+            while(isdigit(*code_ptr)){              // Loop as long as there are integers found in instructions
+                num_to_add_str[i] = *code_ptr;      // Add each integer found to the string
+                ++i;
+                ++code_ptr;
+            }
+            
+            --code_ptr;                             // Decrement instruction
+            
+            num_to_add = atoi(num_to_add_str);      // Convert string to actual integer
+            
+            if(current_value + num_to_add > 127){   // Check to make sure the result stays within the ASCII table
+                fprintf(stderr, "%sError:%s Add - Cell Overflow!\n", RED, RESET);
+                return;
+            }
+            
+            num_to_add += current_value;            // Create a stopping place for the loop
+            while(current_value != num_to_add){     // Loop and increment cell until x is added
+                ++*data_ptr;
+                ++current_value;
+            }
+        }
+        else if(*code_ptr == 'S'){                  // Sub value from the current cell
+            int current_value = *data_ptr;          // Get current cell's value
+            char num_to_sub_str[127];               // String to hold number being subtracted
+            int num_to_sub = 0;                     // To hold converted string as an integer
+            int num_to_stop_at = 0;                 // Stopping place for the loop below
+            
+            memset(num_to_sub_str, '\0', 127);      // Initialize string with 0
+            
+            ++code_ptr;                             // Increment instruction
+            if(!isdigit(*code_ptr)){                // Check to make sure the current instruction is an integer
+                fprintf(stderr, "%sError:%s Sub - Expected integer!\n", RED, RESET);
+                return;
+            }
+            
+            int i = 0;                              // Index for num_to_add_str
+            while(isdigit(*code_ptr)){              // Loop as long as there are integers found in instructions
+                num_to_sub_str[i] = *code_ptr;      // Add each integer found to the string
+                ++i;
+                ++code_ptr;
+            }
+            
+            --code_ptr;                             // Decrement instruction
+            
+            num_to_sub = atoi(num_to_sub_str);      // Convert string to actual integer
+            
+            if(current_value - num_to_sub < 0){     // Check to make sure the result stays within the ASCII table
+                fprintf(stderr, "%sError:%s Sub - Cell Overflow!\n", RED, RESET);
+                return;
+            }
+            
+            num_to_stop_at = current_value - num_to_sub; // Create a stopping place for the loop
+            while(current_value != num_to_stop_at){ // Loop and decrement cell until x is subtracted
+                --*data_ptr;
+                --current_value;
+            }
+        }
+        else if(*code_ptr == '?')                      // Input char
+            *data_ptr = getchar();
+        else if(*code_ptr == '{'){                     // Loop instructions between braces until the start cell reaches 0
+            if(!(*data_ptr))                             //===============================================================
+            {                                                                       //
+                braces++;                                                           //
+                while(braces)                                                       //
+                {                                                                   //
+                    ++code_ptr;                                                     //
+                    if(*code_ptr == '}')                                            //
+                        braces--;                                                   //
+                    else if(*code_ptr == '{')                                       //
+                        braces++;                                                   //
+                }                                                                   //
+            }                                                                       //
+        }                                                                           //
+        else if(*code_ptr == '}'){                                                  //
+            if(*data_ptr){                                                          //
+                braces++;                                                           //
+                while(braces)                                                       //
+                {                                                                   //
+                    code_ptr--;                                                     //
+                    if(*code_ptr == '{')                                            //
+                        braces--;                                                   //
+                    else if(*code_ptr == '}')                                       //
+                        braces++;                                                   //
+                }                                                                   //
+            }                                                                       //
+        }                                              //================================================================
+        else{
+            fprintf(stderr, "%sError:%s Unknown symbol '%c' found!\n", RED, RESET, *code_ptr); // Error if an unknown symbol has been found
+            return;
+        }
+        ++code_ptr;                                   // Increment to next screw instruction
+    }
+}
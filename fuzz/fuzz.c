@@ -0,0 +1,872 @@
+//
+//  fuzz.c
+//
+//  Screw Interpreter
+//
+//  Differential fuzzer: generates random well-formed screw programs and
+//  runs each one through every engine at every optimization level,
+//  comparing the output, the runtime error (with its symbol) and the final
+//  tape against the reference: the switch engine at -O0, every check in
+//  place. Under the baseline configuration (8-bit cells, 60000 of them,
+//  --overflow=error, --eof=minus1) the output and error are taken from the
+//  original run() instead (baseline.c), which the switch engine must agree
+//  with too, unless the reference shifts right off the tape: run() let the
+//  cursor onto the cell past the end first, which is undefined. Tapes are only compared after a clean end: folding "+A2A300"
+//  into one add, say, leaves the cell where it was when the add fails, and
+//  nothing can look at a tape after an error. The programs lean on what is
+//  easy to get wrong: 'A' and 'S' past the cell range, '*a^b' bounds that
+//  aren't numbers, are out of order or are past the end of the tape, shifts
+//  off either end of a short tape, '?' past the end of the input, and the
+//  loops the compiler rewrites.
+//
+//  Besides the switch and threaded engines on a checked, a guard and an
+//  unchecked tape (only for programs that stay on the tape), every program
+//  runs on the engine that counts steps, the profiling engine, the sampled
+//  engine (--sample), from a snapshot taken at compile time, from the last
+//  checkpoint of a run stopped part way (which must be refused under
+//  another --eof), through libscrint, as machine code (--jit), also under a
+//  random plan that unrolls loops and moves others out of the way
+//  (--profile-use), and built into an executable (-c, at one level a
+//  program). The JIT and the executable keep their tapes to themselves, so
+//  they run in a child process and only their output and error are
+//  compared. A program the reference doesn't finish in FUZZ_STEPS steps is
+//  skipped; one that hangs an engine counts as a mismatch. Every mismatch
+//  is reported with its seed and configuration and the program is kept as
+//  fuzz-<seed>.scw.
+//
+//  Links the interpreter's own sources (everything but main.c) and
+//  libscrint.c.
+//
+//  Programs kept as fuzz-<seed>.scw and given after the options run first,
+//  each with the tape, cells, policies, input and plans its seed draws.
+//
+//  usage: scrfuzz [-n programs] [-s first seed] [fuzz-<seed>.scw ...]
+//
+
+#include <stdio.h>
+#include <stdlib.h>         // For malloc(), calloc(), free(), strtoull()
+#include <string.h>         // For memcmp(), memcpy(), strlen(), strncmp(), strstr(), strrchr()
+#include <ctype.h>          // For isdigit()
+#include <signal.h>         // For signal()
+#include <fcntl.h>          // For open()
+#include <unistd.h>         // For fork(), pipe(), dup2(), read(), write(), alarm(), _exit()
+#include <sys/wait.h>       // For waitpid()
+#include "screw.h"
+#include "scrint.h"
+
+#define FUZZ_STEPS 1000000      // Steps the reference may take before a program is skipped
+#define FUZZ_SECONDS 10         // Seconds any other run may take before it counts as hung
+#define FUZZ_SOURCE 65536       // Most bytes of source generated
+
+enum {                          // How a configuration runs
+    RUN_PLAIN,                  // executeOn() with the engine and tape given
+    RUN_LIMITED,                // The same under a step limit it never reaches, so steps are counted
+    RUN_PROFILED,               // With a profile
+    RUN_SAMPLED,                // On the sampled engine, with SIGPROF firing
+    RUN_PREFIX,                 // From the snapshot runPrefix() took
+    RUN_RESTORED,               // Stopped part way, then gone on from its last checkpoint
+    RUN_LIBRARY,                // scrintRun(), from the source
+    RUN_JIT,                    // jitRun(), in a child process
+    RUN_PLANNED,                // The same with a random plan: loops unrolled or laid out of the way (--profile-use)
+    RUN_BUILT                   // buildNative(), the executable run in a child process
+};
+
+typedef struct {                // A way of running a program
+    const char *name;
+    int engine;                 // ENGINE_*
+    int tape;                   // TAPE_*
+    int kind;                   // RUN_*
+} Config;
+
+typedef struct {                // What a run did
+    unsigned char *output;      // What it printed
+    size_t output_len;
+    int result;                 // Its error, with the symbol in bits 8-15
+    char *tape;                 // Its final tape (NULL if it can't be seen)
+} Result;
+
+typedef struct {                // Source being generated
+    char text[FUZZ_SOURCE];
+    size_t len;
+} Buffer;
+
+typedef struct {                // Where libscrint's callbacks read and write
+    Result *res;                // Output goes on its output
+    size_t cap;                 // Bytes its output has room for
+    const unsigned char *input;
+    size_t input_len, input_pos;
+} Feed;
+
+static const Config configs[] = {
+    { "switch", ENGINE_SWITCH, TAPE_CHECKED, RUN_PLAIN },
+    { "threaded", ENGINE_THREADED, TAPE_CHECKED, RUN_PLAIN },
+    { "threaded guard", ENGINE_THREADED, TAPE_GUARD, RUN_PLAIN },
+    { "unchecked", ENGINE_THREADED, TAPE_UNCHECKED, RUN_PLAIN },
+    { "limited", ENGINE_THREADED, TAPE_GUARD, RUN_LIMITED },
+    { "profiled", ENGINE_THREADED, TAPE_CHECKED, RUN_PROFILED },
+    { "sampled", ENGINE_THREADED, TAPE_GUARD, RUN_SAMPLED },
+    { "prefix", ENGINE_THREADED, TAPE_GUARD, RUN_PREFIX },
+    { "restored", ENGINE_THREADED, TAPE_GUARD, RUN_RESTORED },
+    { "library", ENGINE_THREADED, TAPE_CHECKED, RUN_LIBRARY },
+    { "jit", ENGINE_THREADED, TAPE_GUARD, RUN_JIT },
+    { "jit planned", ENGINE_THREADED, TAPE_GUARD, RUN_PLANNED },
+    { "built", ENGINE_THREADED, TAPE_GUARD, RUN_BUILT }
+};
+
+static unsigned long long state;                       // The generator's random state
+static volatile unsigned long long current_seed;       // What is running, for the alarm to report
+static const char *volatile current_config;
+static volatile int current_level;
+static const Buffer *volatile current_source;
+
+static unsigned long long next(void);                  // Next random number
+static int pick(int);                                  // Random number from 0 through n - 1
+static void emit(Buffer *, const char *);              // Append text
+static void genCode(Buffer *, int, int);               // Append random statements
+static Instr *build(const Buffer *, int);              // Tokenize and compile at a level
+static int runConfig(const Buffer *, const Config *, int, const Options *, Result *);  // Run one configuration (-1: can't)
+static int runJit(const Instr *, const Options *, Result *);   // Run as machine code in a child process
+static int runRestored(const Instr *, int, const Options *, Result *); // Run part way with checkpoints, then go on from the last
+static int runFresh(const Instr *, const Options *, Result *); // Run on a fresh tape, keeping the output and tape
+static int runLibrary(const Buffer *, int, const Options *, Result *);  // Run through libscrint
+static int runBuilt(const Instr *, const Options *, Result *); // Build an executable and run it in a child process
+static int runOriginal(const Buffer *, const Options *, Result *);    // Run the original run() (-1: not its configuration)
+static int readError(const char *);                    // The error (with its symbol) printed as text
+static void drain(int, Result *);                      // Read a pipe to its end into the output
+static int quiet(void);                                // Send stderr to /dev/null, returning where it went
+static void loud(int);                                 // Send it back
+static void libraryWrite(void *, const void *, size_t);
+static int libraryRead(void *);
+static void report(const char *, int, const char *, const Options *, int *);   // Print a mismatch, keeping the program once
+static int compare(const Result *, const Result *, const Options *, char *, size_t);   // What differs (0: nothing)
+static void keep(unsigned long long, const Buffer *);  // Save a program as fuzz-<seed>.scw
+static unsigned long long keptSeed(const char *);      // Seed of a kept program, from its name (0: not one)
+static int readKept(const char *, Buffer *);           // Read a kept program back
+static void hung(int);                                 // SIGALRM: report the run that hung and stop
+static void freeResult(Result *);
+
+void runBaseline(char *, const void *, size_t, unsigned char **, size_t *, char *, size_t);    // baseline.c
+
+int main(int argc, char *argv[]){
+    unsigned long long count = 1000, first = 1;       // Programs to run, and the seed of the first
+    unsigned long long ran = 0, skipped = 0, failed = 0;
+    char *end = NULL;
+    char **kept = argv + argc;                         // Kept programs to run again first, and how many
+    int nkept = 0;
+
+    for(int arg = 1; arg < argc; ++arg){
+        if(strcmp(argv[arg], "-n") == 0 && arg + 1 < argc)
+            count = strtoull(argv[++arg], &end, 10);
+        else if(strcmp(argv[arg], "-s") == 0 && arg + 1 < argc)
+            first = strtoull(argv[++arg], &end, 10);
+        else if(argv[arg][0] != '-' && nkept == 0 && keptSeed(argv[arg]) != 0){
+            kept = argv + arg;                         // The rest are kept programs
+            nkept = argc - arg;
+            break;
+        }
+        else
+            end = NULL;
+        if(end == NULL || *end != '\0'){
+            fprintf(stderr, "usage: scrfuzz [-n programs] [-s first seed] [fuzz-<seed>.scw ...]\n");
+            return 2;
+        }
+    }
+    signal(SIGALRM, hung);
+
+    for(unsigned long long n = 0; n < nkept + count; ++n){
+        static Buffer source;
+        static unsigned char input[16];
+        const char *file = n < (unsigned long long)nkept ? kept[n] : NULL;
+        unsigned long long seed = file != NULL ? keptSeed(file) : first + (n - nkept);
+        Options opts = { ENGINE_SWITCH, FLUSH_FULL, CELLS, TAPE_CHECKED, 1, OVERFLOW_ERROR, EOF_MINUS1,
+                         input, 0, FUZZ_STEPS, 0, NULL, NULL, NULL, NULL, NULL };
+        Result ref, original;
+        int reported = 0;
+
+        if(file != NULL && seed == 0){
+            fprintf(stderr, "scrfuzz: %s isn't named fuzz-<seed>.scw\n", file);
+            return 2;
+        }
+        state = seed * 0x9e3779b97f4a7c15ULL + 1;
+        source.len = 0;
+        for(int shift = pick(4); shift > 0; --shift)
+            emit(&source, ">");
+        genCode(&source, 0, 3 + pick(23));
+        emit(&source, "~");
+        if(pick(4) != 0){                              // Otherwise what run() always ran with, for the original to check
+            opts.cells = pick(4) == 0 ? CELLS_MIN + pick(10) : CELLS;   // Short tapes make shifts fail
+            opts.width = 1 << pick(3);
+            opts.overflow = pick(3);
+            opts.eof = pick(3);
+        }
+        opts.input_len = (size_t)pick(sizeof(input) + 1);
+        for(size_t i = 0; i < opts.input_len; ++i)
+            input[i] = (unsigned char)pick(256);
+        if(file != NULL && readKept(file, &source) != 0){  // The same draw as its seed, but the program it failed on
+            fprintf(stderr, "scrfuzz: could not read %s\n", file);
+            return 1;
+        }
+
+        current_seed = seed;
+        current_source = &source;
+        current_config = "reference";
+        current_level = 0;
+        if(runConfig(&source, &configs[0], 0, &opts, &ref) != 0){
+            fprintf(stderr, "scrfuzz: could not run seed %llu\n", seed);
+            return 1;
+        }
+        if((ref.result & 0xff) == ERR_STEP_LIMIT){     // Too long, or never ends
+            freeResult(&ref);
+            ++skipped;
+            continue;
+        }
+        ++ran;
+        opts.max_steps = 0;
+        current_config = "original";
+        if((ref.result & 0xff) != ERR_SHIFT_RIGHT && runOriginal(&source, &opts, &original) == 0){
+            char what[256];
+            if(compare(&original, &ref, &opts, what, sizeof(what)) != 0)
+                report(configs[0].name, 0, what, &opts, &reported);
+            free(ref.output);                          // Everything else is held to what run() did, keeping the tape
+            ref.output = original.output;
+            ref.output_len = original.output_len;
+            ref.result = original.result;
+        }
+        for(int level = 0; level <= 2; ++level){
+            for(size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); ++c){
+                Result got;
+                char what[256];
+                if(level == 0 && c == 0)
+                    continue;                          // The reference itself
+                if(configs[c].tape == TAPE_UNCHECKED && ((ref.result & 0xff) == ERR_SHIFT_RIGHT || (ref.result & 0xff) == ERR_SHIFT_LEFT))
+                    continue;                          // It would walk off the tape
+                current_config = configs[c].name;
+                current_level = level;
+                if(runConfig(&source, &configs[c], level, &opts, &got) != 0)
+                    continue;                          // Not available here (the JIT, or wider cells on it)
+                if(compare(&ref, &got, &opts, what, sizeof(what)) != 0)
+                    report(configs[c].name, level, what, &opts, &reported);
+                freeResult(&got);
+            }
+        }
+        failed += reported;
+        freeResult(&ref);
+    }
+    printf("%llu programs, %llu skipped, %llu mismatched\n", ran, skipped, failed);
+    return failed != 0;
+}
+
+// Runs source compiled at level the way config says, with opts, into res. Returns 0, or -1
+// if that way isn't available or memory ran out.
+static int runConfig(const Buffer *source, const Config *config, int level, const Options *base, Result *res){
+    Options opts = *base;
+    Instr *code = build(source, level);
+    Tape tape;
+    Output *out = NULL;
+    Profile *prof = NULL;
+    Sampler *sampler = NULL;
+    Snapshot *snap = NULL;
+    unsigned char *plan = NULL;
+    Budget budget;
+    int result = -1;
+
+    memset(res, 0, sizeof(*res));
+    if(code == NULL || (config->kind == RUN_BUILT && level != (int)(current_seed % 3))){
+        free(code);                                    // Building takes a compiler run, so one level a program
+        return -1;
+    }
+    if(config->kind == RUN_LIBRARY){
+        free(code);
+        return runLibrary(source, level, &opts, res);
+    }
+    opts.engine = config->engine;
+    opts.tape = config->tape;
+    if(config->kind == RUN_LIMITED)
+        opts.max_steps = 1ULL << 62;
+    if(config->kind != RUN_PROFILED && opts.engine != ENGINE_SWITCH && proveChecks(code, &opts, NULL, NULL) == -1){
+        free(code);                                    // The same checks main() drops
+        return -1;
+    }
+    if(config->kind == RUN_RESTORED){
+        result = runRestored(code, level, &opts, res);
+        free(code);
+        return result;
+    }
+    if(config->kind == RUN_PREFIX){
+        if((snap = runPrefix(code, &opts, (unsigned long long)pick(1000))) == NULL){
+            free(code);
+            return -1;
+        }
+        opts.start = snap;
+    }
+    if(config->kind == RUN_PLANNED){
+        int count = 1;
+        while(code[count - 1].op != OP_HALT)
+            ++count;
+        if((opts.plan = plan = (unsigned char *)calloc(count, 1)) == NULL){
+            free(code);
+            return -1;
+        }
+        for(int i = 0; i < count; ++i)
+            if(code[i].op == OP_LOOP)                  // Any loop, even one a plan would leave alone
+                plan[i] = pick(4) == 0 ? PLAN_COLD : (unsigned char)(1 << pick(4));
+    }
+    if(config->kind == RUN_JIT || config->kind == RUN_PLANNED || config->kind == RUN_BUILT){
+        result = config->kind == RUN_BUILT ? runBuilt(code, &opts, res) : runJit(code, &opts, res);
+        free(code);
+        free(plan);
+        freeSnapshot(snap);
+        return result;
+    }
+    if(newTape(&tape, opts.cells, opts.width, opts.tape) != 0){
+        free(code);
+        freeSnapshot(snap);
+        return -1;
+    }
+    if((out = (Output *)malloc(sizeof(Output))) == NULL || (config->kind == RUN_PROFILED && (prof = newProfile(code)) == NULL)
+       || (config->kind == RUN_SAMPLED && (opts.sampler = sampler = startSampler(code)) == NULL)
+       || (res->tape = (char *)malloc((size_t)opts.cells * opts.width)) == NULL){
+        if(sampler != NULL)
+            stopSampler(sampler);
+        freeSampler(sampler);
+        free(out);
+        freeProfile(prof);
+        freeTape(&tape);
+        free(code);
+        freeSnapshot(snap);
+        return -1;
+    }
+    initOutput(out, -1, FLUSH_FULL);
+    captureOutput(out, opts.input, opts.input_len);
+    alarm(FUZZ_SECONDS);
+    res->result = executeOn(code, &opts, &tape, out, prof, &budget);
+    alarm(0);
+    if(sampler != NULL)
+        stopSampler(sampler);
+    res->output = out->capture;
+    res->output_len = out->captured;
+    memcpy(res->tape, tape.cells, (size_t)opts.cells * opts.width);
+    free(out);
+    freeProfile(prof);
+    freeSampler(sampler);
+    freeTape(&tape);
+    free(code);
+    freeSnapshot(snap);
+    return 0;
+}
+
+// Runs code with opts under a step limit, taking a checkpoint every so many steps, and makes
+// sure the last one is refused under another --eof (whose states the checks proven away don't
+// cover). Then goes on from it to the end into res: the output written before the checkpoint,
+// then what the restored run wrote. Returns -1 if the run ended before a checkpoint was due.
+static int runRestored(const Instr *code, int level, const Options *base, Result *res){
+    Options opts = *base, other = *base;
+    Checkpoint ck;
+    Snapshot *snap = NULL;
+    Result first, rest;
+    char path[64];
+    int saved = -1;
+
+    memset(&ck, 0, sizeof(ck));
+    snprintf(path, sizeof(path), "/tmp/scrfuzz-%ld.ckpt", (long)getpid());
+    unlink(path);
+    ck.path = path;
+    ck.every = 1 + (unsigned long long)pick(100);
+    ck.code = code;
+    ck.key = current_seed;
+    ck.source_size = current_source->len;
+    ck.level = level;
+    ck.overflow = opts.overflow;
+    ck.eof = opts.eof;
+    opts.checkpoint = &ck;
+    opts.max_steps = 1 + (unsigned long long)pick(1000);
+    if(runFresh(code, &opts, &first) != 0)
+        return -1;
+    finishCheckpoints(&ck);
+    if(access(path, F_OK) != 0){
+        freeResult(&first);
+        return -1;
+    }
+
+    other.eof = (opts.eof + 1 + pick(2)) % 3;
+    saved = quiet();                                   // Refusing it prints why
+    snap = loadCheckpoint(path, &ck, &other);
+    loud(saved);
+    if(snap != NULL){
+        freeSnapshot(snap);
+        freeResult(&first);
+        unlink(path);
+        res->result = -3;
+        return 0;
+    }
+
+    opts = *base;
+    if((opts.start = snap = loadCheckpoint(path, &ck, &opts)) == NULL || runFresh(code, &opts, &rest) != 0){
+        freeSnapshot(snap);
+        freeResult(&first);
+        unlink(path);
+        return -1;
+    }
+    unlink(path);
+    res->output_len = (size_t)snap->written + rest.output_len;
+    if((res->output = (unsigned char *)malloc(res->output_len + 1)) != NULL){
+        memcpy(res->output, first.output, (size_t)snap->written);
+        memcpy(res->output + snap->written, rest.output, rest.output_len);
+    }
+    else
+        res->output_len = 0;
+    res->result = rest.result;
+    res->tape = rest.tape;
+    rest.tape = NULL;
+    freeSnapshot(snap);
+    freeResult(&first);
+    freeResult(&rest);
+    return 0;
+}
+
+static int runFresh(const Instr *code, const Options *opts, Result *res){
+    Tape tape;
+    Output *out = NULL;
+    Budget budget;
+
+    memset(res, 0, sizeof(*res));
+    if(newTape(&tape, opts->cells, opts->width, opts->tape) != 0)
+        return -1;
+    if((out = (Output *)malloc(sizeof(Output))) == NULL
+       || (res->tape = (char *)malloc((size_t)opts->cells * opts->width)) == NULL){
+        free(out);
+        freeTape(&tape);
+        return -1;
+    }
+    initOutput(out, -1, FLUSH_FULL);
+    captureOutput(out, opts->input, opts->input_len);
+    alarm(FUZZ_SECONDS);
+    res->result = executeOn(code, opts, &tape, out, NULL, &budget);
+    alarm(0);
+    res->output = out->capture;
+    res->output_len = out->captured;
+    memcpy(res->tape, tape.cells, (size_t)opts->cells * opts->width);
+    free(out);
+    freeTape(&tape);
+    return 0;
+}
+
+// jitRun() prints to stdout and keeps its tape, so it runs in a child with stdout on a pipe,
+// sending its result back on another.
+static int runJit(const Instr *code, const Options *opts, Result *res){
+    int output[2], result[2];
+    int status = 0, got = -1;
+    pid_t pid;
+
+    if(pipe(output) != 0)
+        return -1;
+    if(pipe(result) != 0){
+        close(output[0]);
+        close(output[1]);
+        return -1;
+    }
+    fflush(stdout);
+    if((pid = fork()) == 0){
+        Budget budget;
+        int null = open("/dev/null", O_WRONLY);
+        int ended = 0;
+        dup2(output[1], STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);                     // jitRun() prints the error too
+        close(output[0]);
+        close(result[0]);
+        alarm(FUZZ_SECONDS);                           // Not inherited: the child times itself
+        ended = jitRun(code, opts, &budget);
+        if(write(result[1], &ended, sizeof(ended)) != sizeof(ended))
+            _exit(1);
+        _exit(0);
+    }
+    close(output[1]);
+    close(result[1]);
+    drain(output[0], res);                             // Read it all before waiting, or a big output fills the pipe
+    if(read(result[0], &got, sizeof(got)) != sizeof(got))
+        got = -2;                                      // Died without saying: hung or crashed
+    close(output[0]);
+    close(result[0]);
+    if(pid > 0)
+        waitpid(pid, &status, 0);
+    if(pid < 0 || got == -1){                          // No JIT here, or not for these cells
+        free(res->output);
+        res->output = NULL;
+        return -1;
+    }
+    res->result = got == -2 ? -2 : got;
+    return 0;
+}
+
+// Runs source compiled at level through libscrint, on a checked tape, with what opts says.
+static int runLibrary(const Buffer *source, int level, const Options *opts, Result *res){
+    ScrintProgram *program = NULL;
+    ScrintContext *context = NULL;
+    ScrintOptions options;
+    ScrintError error;
+    Feed feed = { res, 0, opts->input, opts->input_len, 0 };
+    ScrintIO io = { libraryWrite, libraryRead, &feed };
+    int status = SCRINT_OK;
+
+    memset(&options, 0, sizeof(options));
+    options.cells = opts->cells;
+    options.engine = SCRINT_ENGINE_THREADED;
+    options.cell_bits = opts->width * 8;
+    options.overflow = opts->overflow;                 // OVERFLOW_* and EOF_* are SCRINT_*
+    options.eof = opts->eof;
+    if(scrintCompile(source->text, source->len, level, &program, NULL) != SCRINT_OK)
+        return -1;
+    if(scrintNewContext(program, &options, &io, &context) != SCRINT_OK){
+        scrintFreeProgram(program);
+        return -1;
+    }
+    alarm(FUZZ_SECONDS);
+    status = scrintRun(context, &error);
+    alarm(0);
+    res->result = status == SCRINT_OK ? 0 : status | (unsigned char)error.symbol << 8;
+    scrintFreeContext(context);
+    scrintFreeProgram(program);
+    return 0;
+}
+
+// Builds code into an executable as scrint -c would and runs it in a child on the input,
+// reading back its output and the error it printed. Returns -1 if there's no C compiler.
+static int runBuilt(const Instr *code, const Options *opts, Result *res){
+    char path[64], message[256];
+    int input[2], output[2], error[2];
+    int status = 0, saved = -1, built = -1;
+    ssize_t n = 0;
+    pid_t pid;
+
+    snprintf(path, sizeof(path), "/tmp/scrfuzz-%ld", (long)getpid());
+    saved = quiet();                                   // No compiler is no mismatch
+    built = buildNative(code, opts, path);
+    loud(saved);
+    if(built != 0)
+        return -1;
+    if(pipe(input) != 0){
+        unlink(path);
+        return -1;
+    }
+    if(write(input[1], opts->input, opts->input_len) != (ssize_t)opts->input_len || pipe(output) != 0){
+        close(input[0]);
+        close(input[1]);
+        unlink(path);
+        return -1;
+    }
+    close(input[1]);                                   // The pipe holds all 16 bytes, then says it's done
+    if(pipe(error) != 0){
+        close(input[0]);
+        close(output[0]);
+        close(output[1]);
+        unlink(path);
+        return -1;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    if((pid = fork()) == 0){
+        dup2(input[0], STDIN_FILENO);
+        dup2(output[1], STDOUT_FILENO);
+        dup2(error[1], STDERR_FILENO);
+        close(output[0]);
+        close(error[0]);
+        alarm(FUZZ_SECONDS);                           // Kept across exec, so it times itself
+        execl(path, path, (char *)NULL);
+        _exit(127);
+    }
+    close(input[0]);
+    close(output[1]);
+    close(error[1]);
+    drain(output[0], res);
+    if((n = read(error[0], message, sizeof(message) - 1)) < 0)  // One line, long done by the time stdout closed
+        n = 0;
+    message[n] = '\0';
+    close(output[0]);
+    close(error[0]);
+    if(pid > 0)
+        waitpid(pid, &status, 0);
+    unlink(path);
+    if(pid < 0){
+        free(res->output);
+        res->output = NULL;
+        return -1;
+    }
+    res->result = !WIFEXITED(status) || WEXITSTATUS(status) != 0 ? -2 : readError(message);
+    return 0;
+}
+
+// Runs source the way the original run() did, if opts are what it always ran with and the
+// source has no '*' bound past 9 (an error to it, which they aren't now). Its error is read
+// back from what it printed. Returns -1 if it can't run source.
+static int runOriginal(const Buffer *source, const Options *opts, Result *res){
+    Source src = { "<fuzz>", source->text, source->len, NULL, 0, 0 };
+    char message[256];
+
+    memset(res, 0, sizeof(*res));
+    if(opts->width != 1 || opts->cells != CELLS || opts->overflow != OVERFLOW_ERROR || opts->eof != EOF_MINUS1
+       || checkSource(&src) != SRC_OK)
+        return -1;
+    for(size_t i = 0; i < src.count; ++i){
+        if(src.tokens[i] == '*' || src.tokens[i] == '^'){
+            if(i + 2 < src.count && isdigit((unsigned char)src.tokens[i + 1]) && isdigit((unsigned char)src.tokens[i + 2])){
+                free(src.tokens);
+                return -1;
+            }
+        }
+    }
+    alarm(FUZZ_SECONDS);
+    runBaseline(src.tokens, opts->input, opts->input_len, &res->output, &res->output_len, message, sizeof(message));
+    alarm(0);
+    free(src.tokens);
+    res->result = readError(message);
+    return 0;
+}
+
+// Reads back which error message printed as "Error: <message>" (with its colors) stands for:
+// 0 if it is empty, -4 if it's none scrfuzz knows.
+static int readError(const char *message){
+    const char *text = strstr(message, "Error:");
+    char symbol = 0;
+
+    if(message[0] == '\0')
+        return 0;
+    if(text == NULL)
+        return -4;
+    text += strlen("Error:");
+    if(strncmp(text, RESET, strlen(RESET)) == 0)
+        text += strlen(RESET);
+    if(*text == ' ')
+        ++text;
+    if(sscanf(text, "Unknown symbol '%c' found!", &symbol) == 1)
+        return ERR_UNKNOWN_SYMBOL | (unsigned char)symbol << 8;
+    for(int error = ERR_SHIFT_RIGHT; error <= ERR_TIMEOUT; ++error){
+        size_t len = strlen(errorMessage(error));
+        if(strncmp(text, errorMessage(error), len) == 0 && (text[len] == '\n' || text[len] == '\0'))
+            return error;
+    }
+    return -4;
+}
+
+// Describes in what (size bytes) how got differs from ref: its error first, then its output,
+// then its tape. Returns 0 if nothing does.
+static int compare(const Result *ref, const Result *got, const Options *opts, char *what, size_t size){
+    if(got->result == -2)
+        return snprintf(what, size, "hung or crashed"), 1;
+    if(got->result == -3)
+        return snprintf(what, size, "went on from a checkpoint taken with another --eof"), 1;
+    if(got->result == -4 || ref->result == -4)
+        return snprintf(what, size, "printed an error scrfuzz can't read"), 1;
+    if(got->result != ref->result)
+        return snprintf(what, size, "ended with error %d (symbol %d), not %d (symbol %d)", got->result & 0xff,
+                        (got->result >> 8) & 0xff, ref->result & 0xff, (ref->result >> 8) & 0xff), 1;
+    if(got->output_len != ref->output_len || (ref->output_len > 0 && memcmp(got->output, ref->output, ref->output_len) != 0))
+        return snprintf(what, size, "printed %zu bytes, not the %zu expected", got->output_len, ref->output_len), 1;
+    if(got->tape != NULL && ref->tape != NULL && ref->result == 0){  // After an error the levels may differ in what they folded
+        for(long cell = 0; cell < opts->cells * opts->width; ++cell)
+            if(got->tape[cell] != ref->tape[cell])
+                return snprintf(what, size, "left byte %ld of the tape %d, not %d", cell, got->tape[cell], ref->tape[cell]), 1;
+    }
+    return 0;
+}
+
+// Appends n statements, nesting loops up to 3 deep. Loops mostly count down their cell,
+// but not always, so some never end. Dumps to the end of the tape stay out of loops, which
+// could print gigabytes of them before running out of steps.
+static void genCode(Buffer *buf, int depth, int n){
+    static const char *const idioms[] = {
+        "{->+<}", "{->>++<<}", "{-<+>}", "{>+<-}", "{->+>+++<<}", "{-<<+>>}", "{->+<<+>}",
+        "{>}", "{<}", "{>>}", "{<<<<}", "{-}", "{+}"
+    };
+    static const char *const malformed[] = { "5", "^", "*x", "*12", "Ax", "S.", "*3^", "*^2", "A-1", "S9x", "A", "*" };
+    char text[32];
+
+    for(; n > 0 && buf->len < FUZZ_SOURCE / 2; --n){   // Leaves room to close every loop
+        int c = pick(100);
+        if(c < 25){
+            int times = 1 + pick(5);
+            const char *op = pick(2) ? "+" : "-";
+            while(times-- > 0)
+                emit(buf, op);
+        }
+        else if(c < 45){
+            int times = 1 + pick(3);
+            const char *op = pick(2) ? ">" : "<";
+            while(times-- > 0)
+                emit(buf, op);
+        }
+        else if(c < 50)
+            emit(buf, ".");
+        else if(c < 53)
+            emit(buf, "?");
+        else if(c < 63){                               // Near the 8-bit limit, or well past it for wider cells
+            snprintf(text, sizeof(text), "%c%d", pick(2) ? 'A' : 'S', pick(4) ? pick(131) : pick(70000));
+            emit(buf, text);
+        }
+        else if(c < 66){                               // Single digits, or many: past a short tape, or the end of the default one
+            int lower = pick(4) ? pick(10) : pick(40), upper = pick(4) ? pick(10) : pick(2) || depth > 0 ? lower + pick(40) : CELLS - 2 + pick(4);
+            snprintf(text, sizeof(text), "*%d^%d", lower, upper);
+            emit(buf, text);
+        }
+        else if(c < 68)
+            emit(buf, malformed[pick(sizeof(malformed) / sizeof(malformed[0]))]);
+        else if(c < 78)
+            emit(buf, idioms[pick(sizeof(idioms) / sizeof(idioms[0]))]);
+        else if(c < 95 && depth < 3){
+            emit(buf, "{");
+            genCode(buf, depth + 1, 1 + pick(12));
+            emit(buf, pick(8) ? "-}" : "}");
+        }
+        else
+            emit(buf, pick(2) ? " ;a comment {}\n" : "\n");
+    }
+}
+
+static Instr *build(const Buffer *buf, int level){      // Compile it as scrint would (NULL if memory ran out)
+    Source src = { "<fuzz>", buf->text, buf->len, NULL, 0, 0 };
+    Instr *code = NULL;
+
+    if(checkSource(&src) != SRC_OK)
+        return NULL;
+    code = compile(src.tokens, src.count, level, NULL);
+    free(src.tokens);
+    return code;
+}
+
+static void emit(Buffer *buf, const char *text){
+    size_t len = strlen(text);
+
+    memcpy(buf->text + buf->len, text, len);
+    buf->len += len;
+}
+
+static void report(const char *config, int level, const char *what, const Options *opts, int *reported){
+    printf("seed %llu: %s at -O%d %s (--cells %ld --cell-bits=%d, overflow %d, eof %d)\n", current_seed,
+           config, level, what, opts->cells, opts->width * 8, opts->overflow, opts->eof);
+    if(!*reported)
+        keep(current_seed, current_source);
+    *reported = 1;
+}
+
+static void keep(unsigned long long seed, const Buffer *buf){
+    char name[64];
+    FILE *file = NULL;
+
+    snprintf(name, sizeof(name), "fuzz-%llu.scw", seed);
+    if((file = fopen(name, "wb")) == NULL)
+        return;
+    fwrite(buf->text, 1, buf->len, file);
+    fclose(file);
+    printf("  kept as %s\n", name);
+}
+
+static unsigned long long keptSeed(const char *path){
+    const char *name = strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+    unsigned long long seed = 0;
+    char rest[8] = "";
+
+    if(sscanf(name, "fuzz-%llu%7s", &seed, rest) != 2 || strcmp(rest, ".scw") != 0)
+        return 0;
+    return seed;
+}
+
+static int readKept(const char *path, Buffer *buf){
+    FILE *file = fopen(path, "rb");
+
+    if(file == NULL)
+        return -1;
+    buf->len = fread(buf->text, 1, sizeof(buf->text), file);
+    fclose(file);
+    return buf->len == sizeof(buf->text) ? -1 : 0;
+}
+
+static void hung(int sig){                             // The run can't be trusted to come back, so this is the end
+    char message[160], name[64];
+    int len = snprintf(message, sizeof(message), "seed %llu: %s at -O%d hung for %d seconds\n",
+                       current_seed, current_config, current_level, FUZZ_SECONDS);
+    int fd = -1;
+
+    (void)sig;
+    if(write(STDOUT_FILENO, message, (size_t)len) != len)
+        _exit(1);
+    snprintf(name, sizeof(name), "fuzz-%llu.scw", current_seed);
+    if((fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) != -1){
+        if(write(fd, current_source->text, current_source->len) != (ssize_t)current_source->len)
+            _exit(1);
+        close(fd);
+    }
+    _exit(1);
+}
+
+static void freeResult(Result *res){
+    free(res->output);
+    free(res->tape);
+}
+
+static void drain(int fd, Result *res){
+    size_t cap = 0;
+
+    for(;;){
+        ssize_t n = 0;
+        if(res->output_len == cap){
+            unsigned char *grown = (unsigned char *)realloc(res->output, cap ? cap * 2 : 4096);
+            if(grown == NULL)
+                break;
+            res->output = grown;
+            cap = cap ? cap * 2 : 4096;
+        }
+        if((n = read(fd, res->output + res->output_len, cap - res->output_len)) <= 0)
+            break;
+        res->output_len += (size_t)n;
+    }
+}
+
+static int quiet(void){
+    int saved = -1, null = open("/dev/null", O_WRONLY);
+
+    fflush(stderr);
+    saved = dup(STDERR_FILENO);
+    dup2(null, STDERR_FILENO);
+    close(null);
+    return saved;
+}
+
+static void loud(int saved){
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+}
+
+static void libraryWrite(void *user, const void *bytes, size_t n){
+    Feed *feed = (Feed *)user;
+    Result *res = feed->res;
+
+    if(res->output_len + n > feed->cap){
+        size_t cap = feed->cap ? feed->cap : 4096;
+        unsigned char *grown = NULL;
+        while(cap < res->output_len + n)
+            cap *= 2;
+        if((grown = (unsigned char *)realloc(res->output, cap)) == NULL)
+            return;
+        res->output = grown;
+        feed->cap = cap;
+    }
+    memcpy(res->output + res->output_len, bytes, n);
+    res->output_len += n;
+}
+
+static int libraryRead(void *user){
+    Feed *feed = (Feed *)user;
+
+    return feed->input_pos < feed->input_len ? feed->input[feed->input_pos++] : -1;
+}
+
+static unsigned long long next(void){                  // xorshift64*
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545f4914f6cdd1dULL;
+}
+
+static int pick(int n){
+    return (int)(next() % (unsigned long long)n);
+}